@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <SDL3/SDL.h>
+#include "parallel_for.h"
+#include "raw_develop.h"
+#include "srgb_output.h"
+#include "texture_types.h"
+
+// Interactive look adjustments applied to a kept linear develop instead of developing again
+
+// Slider values, all 0 for the look the develop produced
+struct Adjustments {
+    float exposure = 0.0f;     // Stops
+    float temperature = 0.0f;  // -1 (cooler) to 1 (warmer)
+    float tint = 0.0f;         // -1 (greener) to 1 (more magenta)
+    float contrast = 0.0f;     // -1 to 1
+
+    bool operator==(const Adjustments& other) const {
+        return exposure == other.exposure && temperature == other.temperature &&
+               tint == other.tint && contrast == other.contrast;
+    }
+    bool operator!=(const Adjustments& other) const { return !(*this == other); }
+};
+
+// Linear develop of one image plus a reduced copy that can be re-rendered on every slider change
+struct AdjustableImage {
+    LinearImage full;
+    LinearImage proxy;     // Long edge at most kAdjustProxySize
+    int orientation = 0;   // LibRaw flip value of the develop
+};
+
+// Proxy long edge, small enough to re-render within a frame
+constexpr int kAdjustProxySize = 2048;
+
+// Box filter the full develop down to the proxy size
+inline void buildAdjustProxy(AdjustableImage& image) {
+    const LinearImage& full = image.full;
+    const int factor = std::max(1, (std::max(full.width, full.height) + kAdjustProxySize - 1) / kAdjustProxySize);
+    const int width = std::max(1, full.width / factor);
+    const int height = std::max(1, full.height / factor);
+    image.proxy.allocate(width, height, full.rgbCam);
+
+    parallelFor(static_cast<size_t>(height), [&](size_t y) {
+        std::vector<uint32_t> sums(static_cast<size_t>(width) * 3);
+        for (int sy = static_cast<int>(y) * factor; sy < static_cast<int>(y + 1) * factor; ++sy) {
+            const uint16_t* row = &full.cam[static_cast<size_t>(sy) * full.width * 3];
+            for (int x = 0; x < width; ++x) {
+                for (int sx = x * factor; sx < (x + 1) * factor; ++sx) {
+                    for (int c = 0; c < 3; ++c) {
+                        sums[static_cast<size_t>(x) * 3 + c] += row[static_cast<size_t>(sx) * 3 + c];
+                    }
+                }
+            }
+        }
+        uint16_t* out = &image.proxy.cam[y * width * 3];
+        const uint32_t count = static_cast<uint32_t>(factor * factor);
+        for (size_t i = 0; i < sums.size(); ++i) {
+            out[i] = static_cast<uint16_t>((sums[i] + count / 2) / count);
+        }
+    });
+}
+
+// Adjustments folded into a color matrix and an output table
+struct AdjustmentTransform {
+    float matrix[3][3] = {};
+    std::vector<uint8_t> lut;
+    float lutContrast = 0.0f;
+
+    void update(const Adjustments& adjustments, const float (&rgbCam)[3][3]) {
+        // White balance shifts scale the already balanced camera channels
+        const float gain = std::exp2(adjustments.exposure);
+        const float wb[3] = {std::exp2(adjustments.temperature * 0.5f), std::exp2(-adjustments.tint * 0.5f),
+                             std::exp2(-adjustments.temperature * 0.5f)};
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                matrix[i][j] = rgbCam[i][j] * wb[j] * gain;
+            }
+        }
+        if (lut.empty() || lutContrast != adjustments.contrast) {
+            lut = makeSrgbLut16(adjustments.contrast);
+            lutContrast = adjustments.contrast;
+        }
+    }
+};
+
+// Render a rectangle of a linear image to 8-bit RGB at dst (dstPitch bytes per row)
+inline void renderAdjusted(const LinearImage& image, const AdjustmentTransform& transform,
+                           int x0, int y0, int w, int h, uint8_t* dst, size_t dstPitch) {
+    std::vector<uint16_t> linear(static_cast<size_t>(w) * 3);
+    const float (&m)[3][3] = transform.matrix;
+    for (int y = 0; y < h; ++y) {
+        const uint16_t* cam = &image.cam[(static_cast<size_t>(y0 + y) * image.width + x0) * 3];
+        for (int x = 0; x < w; ++x, cam += 3) {
+            const float r = cam[0] * (1.0f / 65535.0f);
+            const float g = cam[1] * (1.0f / 65535.0f);
+            const float b = cam[2] * (1.0f / 65535.0f);
+            for (int c = 0; c < 3; ++c) {
+                linear[static_cast<size_t>(x) * 3 + c] = quantizeLinear16(m[c][0] * r + m[c][1] * g + m[c][2] * b);
+            }
+        }
+        linear16ToSrgb8Row(linear.data(), dst + y * dstPitch, w, 3, transform.lut.data());
+    }
+}
+
+// Displays an AdjustableImage with the current adjustments
+// Every change re-renders the whole proxy straight away, then the full size texture is brought up
+// to date a tile at a time within a per-frame budget, tiles in the viewport first.
+class AdjustedView {
+public:
+    explicit AdjustedView(SDL_Renderer* renderer) : renderer_(renderer) {}
+
+    const AdjustableImage* image() const { return image_.get(); }
+
+    // Time taken by the last proxy render, in milliseconds
+    double lastProxyMs() const { return lastProxyMs_; }
+
+    void setImage(std::shared_ptr<const AdjustableImage> image) {
+        if (image == image_) {
+            return;
+        }
+        image_ = std::move(image);
+        proxy_ = GpuTexture();
+        full_ = GpuTexture();
+        tileVersions_.clear();
+        renderedVersion_ = 0;
+        if (!image_) {
+            return;
+        }
+
+        const LinearImage& full = image_->full;
+        tilesAcross_ = (full.width + kTileSize - 1) / kTileSize;
+        tilesDown_ = (full.height + kTileSize - 1) / kTileSize;
+        tileVersions_.assign(static_cast<size_t>(tilesAcross_) * tilesDown_, 0);
+        proxy_ = makeStreamingTexture(image_->proxy);
+        full_ = makeStreamingTexture(full);
+        version_++;
+    }
+
+    void setAdjustments(const Adjustments& adjustments) {
+        if (adjustments != adjustments_) {
+            adjustments_ = adjustments;
+            version_++;
+        }
+    }
+
+    // Bring the textures up to date for this frame
+    // visibleUv is the part of the (unrotated) full texture on screen, in [0, 1]
+    void update(const SDL_FRect& visibleUv, double budgetMs) {
+        if (!image_ || !proxy_.texture || !full_.texture) {
+            return;
+        }
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        if (renderedVersion_ != version_) {
+            transform_.update(adjustments_, image_->full.rgbCam);
+            const LinearImage& proxy = image_->proxy;
+            std::vector<uint8_t> pixels(static_cast<size_t>(proxy.width) * proxy.height * 3);
+            const int rowsPerBand = 16;
+            parallelFor(static_cast<size_t>((proxy.height + rowsPerBand - 1) / rowsPerBand), [&](size_t band) {
+                const int y0 = static_cast<int>(band) * rowsPerBand;
+                const int h = std::min(rowsPerBand, proxy.height - y0);
+                renderAdjusted(proxy, transform_, 0, y0, proxy.width, h,
+                               &pixels[static_cast<size_t>(y0) * proxy.width * 3], static_cast<size_t>(proxy.width) * 3);
+            });
+            SDL_UpdateTexture(proxy_.texture, nullptr, pixels.data(), proxy.width * 3);
+            renderedVersion_ = version_;
+            lastProxyMs_ = std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - startTime).count();
+        }
+
+        // Stale tiles, the ones on screen first
+        std::vector<size_t> stale;
+        visibleTilesCurrent_ = true;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int ty = 0; ty < tilesDown_; ++ty) {
+                for (int tx = 0; tx < tilesAcross_; ++tx) {
+                    const size_t tile = static_cast<size_t>(ty) * tilesAcross_ + tx;
+                    if (tileVersions_[tile] == version_ || isTileVisible(tx, ty, visibleUv) != (pass == 0)) {
+                        continue;
+                    }
+                    stale.push_back(tile);
+                    if (pass == 0) {
+                        visibleTilesCurrent_ = false;
+                    }
+                }
+            }
+        }
+
+        // Render a batch per pool thread, upload, repeat until the budget runs out
+        const size_t batchSize = ParallelPool::instance().concurrency();
+        const LinearImage& full = image_->full;
+        std::vector<std::vector<uint8_t>> buffers(batchSize);
+        for (size_t first = 0; first < stale.size(); first += batchSize) {
+            const size_t count = std::min(batchSize, stale.size() - first);
+            parallelFor(count, [&](size_t i) {
+                SDL_Rect rect = tileRect(stale[first + i]);
+                buffers[i].resize(static_cast<size_t>(rect.w) * rect.h * 3);
+                renderAdjusted(full, transform_, rect.x, rect.y, rect.w, rect.h, buffers[i].data(),
+                               static_cast<size_t>(rect.w) * 3);
+            });
+            for (size_t i = 0; i < count; ++i) {
+                SDL_Rect rect = tileRect(stale[first + i]);
+                SDL_UpdateTexture(full_.texture, &rect, buffers[i].data(), rect.w * 3);
+                tileVersions_[stale[first + i]] = version_;
+            }
+
+            visibleTilesCurrent_ = true;
+            for (size_t i = first + count; i < stale.size(); ++i) {
+                const size_t tile = stale[i];
+                if (isTileVisible(static_cast<int>(tile % tilesAcross_), static_cast<int>(tile / tilesAcross_), visibleUv)) {
+                    visibleTilesCurrent_ = false;
+                    break;
+                }
+            }
+            double elapsed = std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - startTime).count();
+            if (elapsed > budgetMs) {
+                break;
+            }
+        }
+    }
+
+    // Texture to draw: full size once the tiles on screen are current, the proxy until then
+    GpuTexture* texture() {
+        if (!image_) {
+            return nullptr;
+        }
+        return visibleTilesCurrent_ ? &full_ : &proxy_;
+    }
+
+private:
+    static constexpr int kTileSize = 256;
+
+    SDL_Renderer* renderer_;
+    std::shared_ptr<const AdjustableImage> image_;
+    Adjustments adjustments_;
+    AdjustmentTransform transform_;
+    GpuTexture proxy_;
+    GpuTexture full_;
+    std::vector<uint64_t> tileVersions_;  // Version each full size tile was last rendered at
+    uint64_t version_ = 1;                // Bumped by every image or adjustment change
+    uint64_t renderedVersion_ = 0;        // Version of the proxy texture
+    int tilesAcross_ = 0;
+    int tilesDown_ = 0;
+    bool visibleTilesCurrent_ = false;
+    double lastProxyMs_ = 0.0;
+
+    GpuTexture makeStreamingTexture(const LinearImage& image) {
+        SDL_Texture* texture = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING,
+                                                 image.width, image.height);
+        return GpuTexture(texture, texture ? image.width : 0, texture ? image.height : 0, image_->orientation);
+    }
+
+    SDL_Rect tileRect(size_t tile) const {
+        const LinearImage& full = image_->full;
+        SDL_Rect rect;
+        rect.x = static_cast<int>(tile % tilesAcross_) * kTileSize;
+        rect.y = static_cast<int>(tile / tilesAcross_) * kTileSize;
+        rect.w = std::min(kTileSize, full.width - rect.x);
+        rect.h = std::min(kTileSize, full.height - rect.y);
+        return rect;
+    }
+
+    bool isTileVisible(int tx, int ty, const SDL_FRect& visibleUv) const {
+        const float tileU = static_cast<float>(kTileSize) / image_->full.width;
+        const float tileV = static_cast<float>(kTileSize) / image_->full.height;
+        return tx * tileU < visibleUv.x + visibleUv.w && (tx + 1) * tileU > visibleUv.x &&
+               ty * tileV < visibleUv.y + visibleUv.h && (ty + 1) * tileV > visibleUv.y;
+    }
+};
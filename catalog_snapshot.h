@@ -0,0 +1,456 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "catalog_view.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Snapshot of an opened folder's catalog, written when the folder is left and mapped read-only
+// when it's opened again, so the list is on screen before any of its directories are read.
+// Everything is fixed size records and one string table, used where it lies in the mapping.
+// The folders are kept with their modification times, so the scan that checks the snapshot
+// only lists those that changed.
+
+// A file mapped read-only into memory, unmapped when destroyed
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) {
+            return false;
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!view) {
+            return false;
+        }
+        data_ = static_cast<const unsigned char*>(view);
+        size_ = static_cast<size_t>(size.QuadPart);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size <= 0) {
+            ::close(file);
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);  // The mapping keeps the file
+        if (view == MAP_FAILED) {
+            return false;
+        }
+        data_ = static_cast<const unsigned char*>(view);
+        size_ = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void close() {
+        if (!data_) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const unsigned char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// String in the snapshot's string table
+struct SnapshotString {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+struct CatalogSnapshotImage {
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    int64_t captureTime = 0;
+    SnapshotString path;
+    SnapshotString sidecar;     // Empty if none
+    SnapshotString camera;
+    SnapshotString filterName;  // What the sidebar's filter box matches against
+};
+
+struct CatalogSnapshotFolder {
+    SnapshotString path;
+    int64_t modifiedTime = 0;
+    uint64_t inode = 0;
+};
+
+struct CatalogSnapshotHeader {
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t fileSize = 0;       // Of the whole snapshot, to catch truncated files
+    uint64_t imageCount = 0;
+    uint64_t imagesOffset = 0;   // CatalogSnapshotImage per image, in ID order
+    uint64_t folderCount = 0;
+    uint64_t foldersOffset = 0;  // CatalogSnapshotFolder per folder
+    uint64_t sortedOffset = 0;   // Per SortKey, CatalogView::sortedBy() as uint32_t
+    uint64_t tiedOffset = 0;     // Per SortKey, CatalogView::tiedBy() as bytes
+    uint64_t stringsOffset = 0;
+    uint64_t stringsSize = 0;
+    SnapshotString root;         // Folder or file the catalog was scanned from
+    uint32_t sortPrimary = 0;
+    uint32_t sortSecondary = 0;
+    uint32_t sortDescending = 0;
+    uint32_t currentImage = 0;   // ID, UINT32_MAX if none
+    float scrollY = 0.0f;        // Of the sidebar's list
+};
+
+// A folder as a scan last listed it. While its modification time and inode are the same, so
+// are its entries, though files in it may have been rewritten in place.
+struct CatalogFolder {
+    std::string path;
+    int64_t modifiedTime = 0;
+    uint64_t inode = 0;  // 0 where the platform has none
+};
+
+// Get a folder's modification time, as statFile gives a file's, and its inode
+// Returns false if the folder can't be stat'ed
+inline bool statFolder(const std::string& path, int64_t& modifiedTime, uint64_t& inode) {
+    std::error_code ec;
+    auto time = fs::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    modifiedTime = static_cast<int64_t>(time.time_since_epoch().count());
+    inode = 0;
+#ifndef _WIN32
+    struct stat info;
+    if (::stat(path.c_str(), &info) == 0) {
+        inode = static_cast<uint64_t>(info.st_ino);
+    }
+#endif
+    return true;
+}
+
+// What's saved alongside the catalog's images
+struct CatalogSnapshotState {
+    std::string root;
+    SortKey sortPrimary = SortKey::CaptureTime;
+    SortKey sortSecondary = SortKey::FileName;
+    bool sortDescending = false;
+    size_t currentImage = SIZE_MAX;
+    float scrollY = 0.0f;
+};
+
+// File name of the snapshot for a root, a hash of its path so each folder gets its own
+inline std::string catalogSnapshotFileName(const std::string& root) {
+    uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (unsigned char c : root) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    static const char* kDigits = "0123456789abcdef";
+    std::string name = "catalog_";
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        name += kDigits[(hash >> shift) & 0xF];
+    }
+    return name + ".bin";
+}
+
+class CatalogSnapshot {
+public:
+    static constexpr uint32_t kMagic = 0x43534250;  // "PBSC"
+    static constexpr uint32_t kVersion = 2;  // Version 2 added the folders
+    static constexpr int kKeyCount = static_cast<int>(SortKey::Count);
+
+    // Map a snapshot, checking everything in it lies within the file
+    // Returns false, leaving it closed, if it's missing, from another version or damaged
+    bool open(const std::string& snapshotPath) {
+        if (!file_.open(snapshotPath)) {
+            return false;
+        }
+        if (!valid()) {
+            std::cerr << "Ignoring damaged or outdated catalog snapshot: " << snapshotPath << std::endl;
+            file_.close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        file_.close();
+    }
+
+    const CatalogSnapshotHeader& header() const {
+        return *reinterpret_cast<const CatalogSnapshotHeader*>(file_.data());
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(header().imageCount);
+    }
+
+    const CatalogSnapshotImage& image(size_t id) const {
+        return reinterpret_cast<const CatalogSnapshotImage*>(file_.data() + header().imagesOffset)[id];
+    }
+
+    std::string_view text(SnapshotString string) const {
+        return std::string_view(reinterpret_cast<const char*>(file_.data() + header().stringsOffset) + string.offset,
+                                string.length);
+    }
+
+    size_t folderCount() const {
+        return static_cast<size_t>(header().folderCount);
+    }
+
+    const CatalogSnapshotFolder& folder(size_t index) const {
+        return reinterpret_cast<const CatalogSnapshotFolder*>(file_.data() + header().foldersOffset)[index];
+    }
+
+    const uint32_t* sorted(int key) const {
+        return reinterpret_cast<const uint32_t*>(file_.data() + header().sortedOffset) + key * size();
+    }
+
+    const char* tied(int key) const {
+        return reinterpret_cast<const char*>(file_.data() + header().tiedOffset) + key * size();
+    }
+
+    // Write the catalog, leaving out images whose keep flag is 0. IDs are renumbered over the
+    // images kept, in the same order. The catalog must be up to date (update() called).
+    static bool write(const std::string& snapshotPath, const CatalogSnapshotState& state, const CatalogView& catalog,
+                      const std::vector<fs::path>& sidecars, const std::vector<std::string>& filterNames,
+                      const std::vector<char>& keep, const std::vector<CatalogFolder>& folders) {
+        const size_t total = catalog.size();
+        std::vector<uint32_t> newId(total, UINT32_MAX);
+        uint32_t kept = 0;
+        for (size_t id = 0; id < total; ++id) {
+            if (keep[id]) {
+                newId[id] = kept++;
+            }
+        }
+
+        std::string strings;
+        auto addString = [&](const std::string& text) {
+            SnapshotString string;
+            string.offset = static_cast<uint32_t>(strings.size());
+            string.length = static_cast<uint32_t>(text.size());
+            strings += text;
+            return string;
+        };
+
+        CatalogSnapshotHeader header;
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.imageCount = kept;
+        header.root = addString(state.root);
+        header.sortPrimary = static_cast<uint32_t>(state.sortPrimary);
+        header.sortSecondary = static_cast<uint32_t>(state.sortSecondary);
+        header.sortDescending = state.sortDescending;
+        header.currentImage = state.currentImage < total ? newId[state.currentImage] : UINT32_MAX;
+        header.scrollY = state.scrollY;
+
+        std::vector<CatalogSnapshotImage> images;
+        images.reserve(kept);
+        for (size_t id = 0; id < total; ++id) {
+            if (!keep[id]) {
+                continue;
+            }
+            const CatalogKeys& keys = catalog.keys(static_cast<uint32_t>(id));
+            CatalogSnapshotImage image;
+            image.fileSize = keys.fileSize;
+            image.modifiedTime = keys.modifiedTime;
+            image.captureTime = keys.captureTime;
+            image.path = addString(keys.path);
+            image.sidecar = addString(sidecars[id].string());
+            image.camera = addString(keys.camera);
+            image.filterName = addString(filterNames[id]);
+            images.push_back(image);
+        }
+        std::vector<CatalogSnapshotFolder> folderRecords;
+        folderRecords.reserve(folders.size());
+        for (const CatalogFolder& folder : folders) {
+            CatalogSnapshotFolder record;
+            record.path = addString(folder.path);
+            record.modifiedTime = folder.modifiedTime;
+            record.inode = folder.inode;
+            folderRecords.push_back(record);
+        }
+        header.folderCount = folderRecords.size();
+        if (strings.size() > UINT32_MAX) {
+            std::cerr << "Catalog too large for a snapshot" << std::endl;
+            return false;
+        }
+
+        // Images left out take their place in each sorted list with them. Neighbours either
+        // side of a removed run are equal only if every pair across the run was.
+        std::vector<uint32_t> sorted(static_cast<size_t>(kKeyCount) * kept);
+        std::vector<char> tied(static_cast<size_t>(kKeyCount) * kept);
+        for (int key = 0; key < kKeyCount; ++key) {
+            const std::vector<uint32_t>& from = catalog.sortedBy(static_cast<SortKey>(key));
+            const std::vector<char>& fromTied = catalog.tiedBy(static_cast<SortKey>(key));
+            if (from.size() != total) {
+                std::cerr << "Catalog not sorted, snapshot not written" << std::endl;
+                return false;
+            }
+            size_t write = static_cast<size_t>(key) * kept;
+            const size_t begin = write;
+            bool tiedAcross = true;
+            for (size_t i = 0; i < total; ++i) {
+                tiedAcross = tiedAcross && fromTied[i];
+                if (keep[from[i]]) {
+                    sorted[write] = newId[from[i]];
+                    tied[write] = write > begin && tiedAcross;
+                    write++;
+                    tiedAcross = true;
+                }
+            }
+        }
+
+        auto align = [](uint64_t offset) { return (offset + 7) & ~uint64_t(7); };
+        header.imagesOffset = align(sizeof(CatalogSnapshotHeader));
+        header.foldersOffset = align(header.imagesOffset + images.size() * sizeof(CatalogSnapshotImage));
+        header.sortedOffset = align(header.foldersOffset + folderRecords.size() * sizeof(CatalogSnapshotFolder));
+        header.tiedOffset = align(header.sortedOffset + sorted.size() * sizeof(uint32_t));
+        header.stringsOffset = align(header.tiedOffset + tied.size());
+        header.stringsSize = strings.size();
+        header.fileSize = header.stringsOffset + header.stringsSize;
+
+        // Write to a temporary file first so a crash can't leave a truncated snapshot
+        std::string tempPath = snapshotPath + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Error writing catalog snapshot: " << tempPath << std::endl;
+            return false;
+        }
+        auto writeAt = [&](uint64_t offset, const void* data, size_t length) {
+            static const char kZeros[8] = {};
+            file.write(kZeros, static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp())));
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(length));
+        };
+        writeAt(0, &header, sizeof(header));
+        writeAt(header.imagesOffset, images.data(), images.size() * sizeof(CatalogSnapshotImage));
+        writeAt(header.foldersOffset, folderRecords.data(), folderRecords.size() * sizeof(CatalogSnapshotFolder));
+        writeAt(header.sortedOffset, sorted.data(), sorted.size() * sizeof(uint32_t));
+        writeAt(header.tiedOffset, tied.data(), tied.size());
+        writeAt(header.stringsOffset, strings.data(), strings.size());
+        file.close();
+        if (!file) {
+            std::cerr << "Error writing catalog snapshot: " << tempPath << std::endl;
+            return false;
+        }
+
+        std::error_code ec;
+        fs::rename(tempPath, snapshotPath, ec);
+        if (ec) {
+            std::cerr << "Error replacing catalog snapshot: " << ec.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    MappedFile file_;
+
+    bool valid() const {
+        const size_t fileSize = file_.size();
+        if (fileSize < sizeof(CatalogSnapshotHeader)) {
+            return false;
+        }
+        const CatalogSnapshotHeader& h = header();
+        if (h.magic != kMagic || h.version != kVersion || h.fileSize != fileSize ||
+            h.sortPrimary >= static_cast<uint32_t>(kKeyCount) || h.sortSecondary >= static_cast<uint32_t>(kKeyCount)) {
+            return false;
+        }
+        // Sections in order, each within the file, with the counts they imply. Every size is
+        // compared with what's left of the file after the section's offset, so nothing in a
+        // damaged header can wrap around.
+        auto fits = [&](uint64_t offset, uint64_t records, uint64_t recordSize) {
+            return offset <= fileSize && records <= (fileSize - offset) / recordSize;
+        };
+        auto end = [](uint64_t offset, uint64_t records, uint64_t recordSize) { return offset + records * recordSize; };
+        const uint64_t count = h.imageCount;
+        const uint64_t folders = h.folderCount;
+        if (h.imagesOffset % 8 != 0 || h.foldersOffset % 8 != 0 || h.sortedOffset % 8 != 0 ||
+            h.imagesOffset < sizeof(CatalogSnapshotHeader) ||
+            !fits(h.imagesOffset, count, sizeof(CatalogSnapshotImage)) ||
+            !fits(h.foldersOffset, folders, sizeof(CatalogSnapshotFolder)) ||
+            !fits(h.sortedOffset, count, kKeyCount * sizeof(uint32_t)) ||
+            !fits(h.tiedOffset, count, kKeyCount) ||
+            h.foldersOffset < end(h.imagesOffset, count, sizeof(CatalogSnapshotImage)) ||
+            h.sortedOffset < end(h.foldersOffset, folders, sizeof(CatalogSnapshotFolder)) ||
+            h.tiedOffset < end(h.sortedOffset, count, kKeyCount * sizeof(uint32_t)) ||
+            h.stringsOffset < end(h.tiedOffset, count, kKeyCount) ||
+            h.stringsOffset > fileSize || h.stringsSize != fileSize - h.stringsOffset) {
+            return false;
+        }
+        auto inStrings = [&](SnapshotString string) {
+            return static_cast<uint64_t>(string.offset) + string.length <= h.stringsSize;
+        };
+        if (!inStrings(h.root)) {
+            return false;
+        }
+        for (size_t id = 0; id < count; ++id) {
+            const CatalogSnapshotImage& i = image(id);
+            if (!inStrings(i.path) || !inStrings(i.sidecar) || !inStrings(i.camera) || !inStrings(i.filterName)) {
+                return false;
+            }
+        }
+        for (size_t index = 0; index < folders; ++index) {
+            if (!inStrings(folder(index).path)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
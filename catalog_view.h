@@ -0,0 +1,414 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "parallel_for.h"
+
+// Sorted views of the catalog. An image's ID is its index in the catalog and never changes
+// once assigned, so everything cached per image stays valid however the list is ordered.
+
+enum class SortKey {
+    CaptureTime,
+    FileName,
+    Folder,    // Full path, so each folder's images stay together
+    FileSize,
+    Camera,
+    Count
+};
+
+inline const char* sortKeyName(SortKey key) {
+    switch (key) {
+        case SortKey::CaptureTime: return "Capture time";
+        case SortKey::FileName: return "File name";
+        case SortKey::Folder: return "Folder";
+        case SortKey::FileSize: return "File size";
+        case SortKey::Camera: return "Camera";
+        default: return "Unknown";
+    }
+}
+
+// What an image is sorted by, filled in from the scan and, once its header has been read, the
+// metadata index
+struct CatalogKeys {
+    std::string path;
+    std::string name;         // File name
+    std::string camera;       // Empty if unknown
+    uint64_t fileSize = 0;
+    int64_t captureTime = 0;  // Seconds since 1970, the modification time until the header is read
+    int64_t modifiedTime = 0; // As the metadata index stores it, to look the header's keys up
+};
+
+// Keeps every image sorted by each key, marking where neighbours are equal. Any order over two
+// keys is then a single counting sort of one key's list by the other's ranks.
+// Images added or changed are sorted on their own and merged in, so a growing catalog never
+// sorts from scratch.
+class CatalogView {
+public:
+    void clear() {
+        keys_.clear();
+        for (int key = 0; key < kKeyCount; ++key) {
+            values_[key].clear();
+            sorted_[key].clear();
+            tied_[key].clear();
+        }
+        sortedCount_ = 0;
+        pending_.clear();
+        order_.clear();
+        position_.clear();
+        orderChanged_ = true;
+    }
+
+    size_t size() const {
+        return keys_.size();
+    }
+
+    // Add an image with the next ID (the catalog's size), applied by the next update()
+    uint32_t add(CatalogKeys keys) {
+        const uint32_t id = static_cast<uint32_t>(keys_.size());
+        keys_.push_back(Keys(std::move(keys)));
+        pending_.push_back(id);
+        return id;
+    }
+
+    const CatalogKeys& keys(uint32_t id) const {
+        return keys_[id].keys;
+    }
+
+    // Replace an image's keys, applied by the next update()
+    void setKeys(uint32_t id, CatalogKeys keys) {
+        keys_[id] = Keys(std::move(keys));
+        pending_.push_back(id);
+    }
+
+    void setOrder(SortKey primary, SortKey secondary, bool descending) {
+        if (primary != primary_ || secondary != secondary_ || descending != descending_) {
+            primary_ = primary;
+            secondary_ = secondary;
+            descending_ = descending;
+            orderChanged_ = true;
+        }
+    }
+
+    // Merge in added and changed images and rebuild the order if anything changed
+    // Returns true if order() changed
+    bool update() {
+        if (!pending_.empty()) {
+            mergePending();
+            orderChanged_ = true;
+        }
+        if (!orderChanged_) {
+            return false;
+        }
+        buildOrder();
+        orderChanged_ = false;
+        ++version_;
+        return true;
+    }
+
+    // IDs in display order, as of the last update()
+    const std::vector<uint32_t>& order() const {
+        return order_;
+    }
+
+    // Position of an ID in order()
+    size_t positionOf(uint32_t id) const {
+        return position_[id];
+    }
+
+    // Changes every time order() does
+    uint64_t version() const {
+        return version_;
+    }
+
+    // IDs ascending by one key as of the last update(), ties by ID, and per position whether
+    // it's equal to the one before. Saved with the catalog so it needn't be sorted again.
+    const std::vector<uint32_t>& sortedBy(SortKey key) const {
+        return sorted_[static_cast<int>(key)];
+    }
+
+    const std::vector<char>& tiedBy(SortKey key) const {
+        return tied_[static_cast<int>(key)];
+    }
+
+    // Replace the catalog with saved keys and, per SortKey, their sortedBy() and tiedBy() lists
+    // of keys.size() entries each. Lists that aren't an ordering of the IDs are sorted again
+    // instead. Returns false if they had to be.
+    bool restore(std::vector<CatalogKeys> keys, const uint32_t* const* sorted, const char* const* tied) {
+        clear();
+        const size_t count = keys.size();
+        keys_.reserve(count);
+        for (CatalogKeys& k : keys) {
+            keys_.push_back(Keys(std::move(k)));
+        }
+
+        std::vector<char> seen(count);
+        for (int key = 0; key < kKeyCount; ++key) {
+            std::fill(seen.begin(), seen.end(), 0);
+            for (size_t i = 0; i < count; ++i) {
+                if (sorted[key][i] >= count || seen[sorted[key][i]]) {
+                    for (uint32_t id = 0; id < count; ++id) {
+                        pending_.push_back(id);
+                    }
+                    return false;
+                }
+                seen[sorted[key][i]] = 1;
+            }
+        }
+
+        parallelFor(kKeyCount, [&](size_t index) {
+            const int key = static_cast<int>(index);
+            values_[key].resize(count);
+            for (size_t id = 0; id < count; ++id) {
+                values_[key][id] = value(key, keys_[id]);
+            }
+            sorted_[key].assign(sorted[key], sorted[key] + count);
+            tied_[key].assign(tied[key], tied[key] + count);
+            if (count > 0) {
+                tied_[key][0] = 0;
+            }
+        });
+        sortedCount_ = count;
+        return true;
+    }
+
+private:
+    static constexpr int kKeyCount = static_cast<int>(SortKey::Count);
+
+    // Keys with the strings prepared for comparing: lowercased, with a 64-bit sort value per key.
+    // Numbers are their value; strings are their first 8 bytes packed big endian, so most
+    // comparisons are one integer compare and only equal prefixes compare the strings.
+    struct Keys {
+        Keys() = default;
+        explicit Keys(CatalogKeys from) : keys(std::move(from)) {
+            pathLower = lowercase(keys.path);
+            nameLower = lowercase(keys.name);
+            cameraLower = lowercase(keys.camera);
+        }
+
+        CatalogKeys keys;
+        std::string pathLower, nameLower, cameraLower;
+
+        static std::string lowercase(std::string text) {
+            std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+            return text;
+        }
+    };
+
+    std::vector<Keys> keys_;
+    std::vector<uint64_t> values_[kKeyCount];  // Per ID, its sort value for each key
+    std::vector<uint32_t> sorted_[kKeyCount];  // IDs ascending by each key, ties by ID
+    std::vector<char> tied_[kKeyCount];        // Per position in sorted_, equal to the one before
+    size_t sortedCount_ = 0;                   // IDs below this are in sorted_
+    std::vector<uint32_t> pending_;            // Added or changed since the last update()
+    std::vector<uint32_t> order_;
+    std::vector<uint32_t> position_;
+    SortKey primary_ = SortKey::CaptureTime;
+    SortKey secondary_ = SortKey::FileName;
+    bool descending_ = false;
+    bool orderChanged_ = true;
+    uint64_t version_ = 0;
+
+    static uint64_t prefix(const std::string& text) {
+        uint64_t packed = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            packed = packed << 8 | (i < text.size() ? static_cast<unsigned char>(text[i]) : 0);
+        }
+        return packed;
+    }
+
+    static bool isText(int key) {
+        return key == static_cast<int>(SortKey::FileName) || key == static_cast<int>(SortKey::Folder) ||
+               key == static_cast<int>(SortKey::Camera);
+    }
+
+    const std::string& text(int key, uint32_t id) const {
+        const Keys& k = keys_[id];
+        return key == static_cast<int>(SortKey::FileName) ? k.nameLower
+             : key == static_cast<int>(SortKey::Folder) ? k.pathLower : k.cameraLower;
+    }
+
+    uint64_t value(int key, const Keys& k) const {
+        switch (static_cast<SortKey>(key)) {
+            case SortKey::CaptureTime: return static_cast<uint64_t>(k.keys.captureTime) ^ (1ull << 63);
+            case SortKey::FileName: return prefix(k.nameLower);
+            case SortKey::Folder: return prefix(k.pathLower);
+            case SortKey::FileSize: return k.keys.fileSize;
+            case SortKey::Camera: return prefix(k.cameraLower);
+            default: return 0;
+        }
+    }
+
+    // -1, 0 or 1 comparing two images by one key
+    int compare(int key, uint32_t a, uint32_t b) const {
+        const uint64_t x = values_[key][a], y = values_[key][b];
+        if (x != y) {
+            return x < y ? -1 : 1;
+        }
+        if (!isText(key)) {
+            return 0;
+        }
+        return text(key, a).compare(text(key, b)) < 0 ? -1 : (text(key, a) == text(key, b) ? 0 : 1);
+    }
+
+    // Sort the pending IDs by each key and merge them into the sorted lists, one key per thread
+    void mergePending() {
+        std::sort(pending_.begin(), pending_.end());
+        pending_.erase(std::unique(pending_.begin(), pending_.end()), pending_.end());
+        std::vector<char> isPending(keys_.size(), 0);
+        bool hasChanged = false;
+        for (uint32_t id : pending_) {
+            isPending[id] = 1;
+            hasChanged = hasChanged || id < sortedCount_;
+        }
+        sortedCount_ = keys_.size();
+
+        parallelFor(kKeyCount, [&](size_t index) {
+            const int key = static_cast<int>(index);
+            std::vector<uint64_t>& values = values_[key];
+            values.resize(keys_.size());
+            for (uint32_t id : pending_) {
+                values[id] = value(key, keys_[id]);
+            }
+            auto less = [&](uint32_t a, uint32_t b) {
+                const int order = compare(key, a, b);
+                return order != 0 ? order < 0 : a < b;
+            };
+
+            // Sort the batch on (value, ID) pairs held together, then settle equal text prefixes
+            std::vector<std::pair<uint64_t, uint32_t>> batch(pending_.size());
+            for (size_t i = 0; i < pending_.size(); ++i) {
+                batch[i] = {values[pending_[i]], pending_[i]};
+            }
+            std::sort(batch.begin(), batch.end());
+            std::vector<uint32_t> added(batch.size());
+            for (size_t i = 0; i < batch.size(); ++i) {
+                added[i] = batch[i].second;
+            }
+            if (isText(key)) {
+                for (size_t begin = 0; begin < added.size();) {
+                    size_t end = begin + 1;
+                    while (end < added.size() && values[added[end]] == values[added[begin]]) {
+                        ++end;
+                    }
+                    if (end - begin > 1) {
+                        std::sort(added.begin() + begin, added.begin() + end, less);
+                    }
+                    begin = end;
+                }
+            }
+
+            // Changed IDs leave their old place. Neighbours either side of a removed run are
+            // equal only if every pair across the run was, so no keys are compared.
+            std::vector<uint32_t>& sorted = sorted_[key];
+            std::vector<char>& tied = tied_[key];
+            if (hasChanged) {
+                size_t write = 0;
+                bool tiedAcross = true;
+                for (size_t i = 0; i < sorted.size(); ++i) {
+                    tiedAcross = tiedAcross && tied[i];
+                    if (!isPending[sorted[i]]) {
+                        sorted[write] = sorted[i];
+                        tied[write] = write > 0 && tiedAcross;
+                        write++;
+                        tiedAcross = true;
+                    }
+                }
+                sorted.resize(write);
+                tied.resize(write);
+            }
+
+            // Copy the batch in at the places a binary search finds, comparing only the new
+            // neighbours each insertion makes
+            std::vector<uint32_t> merged(sorted.size() + added.size());
+            std::vector<char> mergedTied(merged.size());
+            size_t next = 0, written = 0;
+            auto copyKept = [&](size_t end) {
+                if (end == next) {
+                    return;
+                }
+                std::copy(sorted.begin() + next, sorted.begin() + end, merged.begin() + written);
+                std::copy(tied.begin() + next, tied.begin() + end, mergedTied.begin() + written);
+                // The kept run now follows something new (an added ID, even ahead of the first
+                // kept one), so its first tie flag is recomputed
+                if (written > 0 && (next == 0 || merged[written - 1] != sorted[next - 1])) {
+                    mergedTied[written] = compare(key, merged[written - 1], sorted[next]) == 0;
+                }
+                written += end - next;
+                next = end;
+            };
+            for (uint32_t id : added) {
+                copyKept(std::lower_bound(sorted.begin() + next, sorted.end(), id, less) - sorted.begin());
+                mergedTied[written] = written > 0 && compare(key, merged[written - 1], id) == 0;
+                merged[written++] = id;
+            }
+            copyKept(sorted.size());
+            sorted.swap(merged);
+            tied.swap(mergedTied);
+        });
+        pending_.clear();
+    }
+
+    // IDs by one key, with ties in ID order either way round
+    void orderBy(int key, bool descending, std::vector<uint32_t>& out) const {
+        const std::vector<uint32_t>& sorted = sorted_[key];
+        const std::vector<char>& tied = tied_[key];
+        out.resize(sorted.size());
+        if (!descending) {
+            std::copy(sorted.begin(), sorted.end(), out.begin());
+            return;
+        }
+        size_t written = 0;
+        for (size_t end = sorted.size(); end > 0;) {
+            size_t begin = end - 1;
+            while (begin > 0 && tied[begin]) {
+                --begin;
+            }
+            std::copy(sorted.begin() + begin, sorted.begin() + end, out.begin() + written);
+            written += end - begin;
+            end = begin;
+        }
+    }
+
+    // The secondary key's order, then a stable counting sort of it by the primary key's rank,
+    // so ties on the primary keep the secondary order and remaining ties keep ID order
+    void buildOrder() {
+        const int primary = static_cast<int>(primary_);
+        const int secondary = static_cast<int>(secondary_);
+        if (primary == secondary) {
+            orderBy(primary, descending_, order_);
+        } else {
+            std::vector<uint32_t> bySecondary;
+            orderBy(secondary, descending_, bySecondary);
+            // Dense ranks of the primary key, equal keys sharing one
+            const std::vector<uint32_t>& sorted = sorted_[primary];
+            std::vector<uint32_t> rank(keys_.size());
+            uint32_t maxRank = 0;
+            for (size_t i = 0; i < sorted.size(); ++i) {
+                maxRank += i > 0 && !tied_[primary][i];
+                rank[sorted[i]] = maxRank;
+            }
+            // Gathered once in secondary order so the counting passes read them in sequence
+            std::vector<uint32_t> buckets(bySecondary.size());
+            std::vector<uint32_t> starts(static_cast<size_t>(maxRank) + 2, 0);
+            for (size_t i = 0; i < bySecondary.size(); ++i) {
+                buckets[i] = descending_ ? maxRank - rank[bySecondary[i]] : rank[bySecondary[i]];
+                starts[buckets[i] + 1]++;
+            }
+            for (size_t i = 1; i < starts.size(); ++i) {
+                starts[i] += starts[i - 1];
+            }
+            order_.resize(bySecondary.size());
+            for (size_t i = 0; i < bySecondary.size(); ++i) {
+                order_[starts[buckets[i]]++] = bySecondary[i];
+            }
+        }
+
+        position_.resize(order_.size());
+        for (size_t i = 0; i < order_.size(); ++i) {
+            position_[order_[i]] = static_cast<uint32_t>(i);
+        }
+    }
+};
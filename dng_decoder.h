@@ -0,0 +1,908 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "metadata_index.h"
+#include "parallel_for.h"
+#include "raw_develop.h"
+#include "raw_header_parser.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+// Native reader for the DNG layouts converters commonly write: a Bayer or X-Trans CFA image
+// stored uncompressed (8-16 bit) or as lossless JPEG, in strips or tiles. Tiles and strips are
+// independent, so they are decoded in parallel. Anything else (lossy, floating point, linear
+// DNGs, ...) is rejected so the caller can fall back to LibRaw.
+
+// Sensor data decoded from a DNG. Owns the samples that cfa points into.
+struct DngImage {
+    std::vector<uint16_t> samples;  // Decoded part of the raw image
+    CfaImage cfa;                   // The decoded part of the active area
+    int orientation = 0;            // LibRaw flip value
+    int activeWidth = 0;            // Size of the whole active area
+    int activeHeight = 0;
+    int regionX = 0;                // Position of cfa within the active area
+    int regionY = 0;
+
+    DngImage() = default;
+    DngImage(const DngImage&) = delete;
+    DngImage& operator=(const DngImage&) = delete;
+};
+
+// Check the extension before reading a whole file that is unlikely to be a DNG
+inline bool hasDngExtension(const std::string& path) {
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".dng";
+}
+
+namespace dng_detail {
+
+using raw_header_detail::TiffEntry;
+using raw_header_detail::readTiffEntry;
+using raw_header_detail::tiffEntryValue;
+
+// Read element index of any numeric entry (BYTE, SHORT, LONG, RATIONAL, FLOAT, ...)
+inline bool tiffEntryNumber(const ByteReader& r, const TiffEntry& entry, uint32_t index, double& out) {
+    if (index >= entry.count) return false;
+    const uint64_t position = entry.valuePosition;
+    switch (entry.type) {
+        case 1: case 7: {
+            uint8_t value;
+            if (!r.u8(position + index, value)) return false;
+            out = value;
+            return true;
+        }
+        case 3: case 4: case 13: {
+            uint32_t value;
+            if (!tiffEntryValue(r, entry, index, value)) return false;
+            out = value;
+            return true;
+        }
+        case 8: case 9: {
+            uint32_t value;
+            if (!tiffEntryValue(r, entry, index, value)) return false;
+            out = entry.type == 8 ? static_cast<int16_t>(value) : static_cast<int32_t>(value);
+            return true;
+        }
+        case 5: case 10: {
+            uint32_t numerator, denominator;
+            if (!r.u32(position + index * 8ull, numerator) || !r.u32(position + index * 8ull + 4, denominator) ||
+                denominator == 0) {
+                return false;
+            }
+            out = entry.type == 5 ? static_cast<double>(numerator) / denominator
+                                  : static_cast<double>(static_cast<int32_t>(numerator)) / static_cast<int32_t>(denominator);
+            return true;
+        }
+        case 11: {
+            uint32_t bits;
+            if (!r.u32(position + index * 4ull, bits)) return false;
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            out = value;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// The IFD holding the raw CFA image, plus the IFD0 tags describing its color
+struct DngLayout {
+    uint32_t width = 0, height = 0;
+    uint32_t bitsPerSample = 0;
+    uint32_t compression = 0;
+    uint32_t samplesPerPixel = 1;
+    uint32_t tileWidth = 0, tileHeight = 0;  // Strips are stored as full width tiles
+    TiffEntry offsets, byteCounts;
+    bool hasOffsets = false, hasByteCounts = false;
+    uint32_t cfaRepeat[2] = {0, 0};
+    TiffEntry cfaPattern, cfaPlaneColor, blackLevel, linearization;
+    bool hasCfaPattern = false, hasPlaneColor = false, hasBlackLevel = false, hasLinearization = false;
+    uint32_t blackRepeat[2] = {1, 1};
+    double whiteLevel = 0.0;
+    uint32_t activeArea[4] = {0, 0, 0, 0};  // top, left, bottom, right
+    bool hasActiveArea = false;
+
+    // From IFD0
+    bool isDng = false;
+    int orientation = 0;
+    double colorMatrix[2][9] = {};
+    uint32_t colorMatrixCount[2] = {0, 0};
+    uint32_t illuminant[2] = {0, 0};
+    double asShotNeutral[3] = {0, 0, 0};
+    bool hasAsShotNeutral = false;
+    bool foundRaw = false;
+};
+
+inline void readNumbers(const ByteReader& r, const TiffEntry& entry, double* out, uint32_t maxCount, uint32_t& count) {
+    count = 0;
+    for (uint32_t i = 0; i < entry.count && i < maxCount; ++i) {
+        if (!tiffEntryNumber(r, entry, i, out[i])) return;
+        count = i + 1;
+    }
+}
+
+// Walk IFD0 and its SubIFDs, picking up color tags and the full resolution CFA IFD
+inline void scanDngIfd(const ByteReader& r, uint64_t ifdPosition, int depth, bool isIfd0, DngLayout& layout,
+                       std::vector<uint64_t>& visited) {
+    if (depth > raw_header_detail::kMaxIfdDepth || visited.size() >= raw_header_detail::kMaxIfds) return;
+    if (std::find(visited.begin(), visited.end(), ifdPosition) != visited.end()) return;
+    visited.push_back(ifdPosition);
+
+    uint16_t entryCount;
+    if (!r.u16(ifdPosition, entryCount) || entryCount > raw_header_detail::kMaxIfdEntries) return;
+
+    DngLayout ifd;
+    uint32_t subFileType = 0, photometric = 0, rowsPerStrip = 0;
+    TiffEntry stripOffsets, stripCounts, tileOffsets, tileCounts, subIfds;
+    bool hasStrips = false, hasStripCounts = false, hasTiles = false, hasTileCounts = false, hasSubIfds = false;
+
+    for (uint16_t i = 0; i < entryCount; ++i) {
+        TiffEntry entry;
+        if (!readTiffEntry(r, 0, ifdPosition + 2 + i * 12ull, entry)) return;
+
+        uint32_t value = 0;
+        double number = 0.0;
+        switch (entry.tag) {
+            case 0x00FE: tiffEntryValue(r, entry, 0, subFileType); break;
+            case 0x0100: tiffEntryValue(r, entry, 0, ifd.width); break;
+            case 0x0101: tiffEntryValue(r, entry, 0, ifd.height); break;
+            case 0x0102: tiffEntryValue(r, entry, 0, ifd.bitsPerSample); break;
+            case 0x0103: tiffEntryValue(r, entry, 0, ifd.compression); break;
+            case 0x0106: tiffEntryValue(r, entry, 0, photometric); break;
+            case 0x0111: stripOffsets = entry; hasStrips = true; break;
+            case 0x0115: tiffEntryValue(r, entry, 0, ifd.samplesPerPixel); break;
+            case 0x0116: tiffEntryValue(r, entry, 0, rowsPerStrip); break;
+            case 0x0117: stripCounts = entry; hasStripCounts = true; break;
+            case 0x0142: tiffEntryValue(r, entry, 0, ifd.tileWidth); break;
+            case 0x0143: tiffEntryValue(r, entry, 0, ifd.tileHeight); break;
+            case 0x0144: tileOffsets = entry; hasTiles = true; break;
+            case 0x0145: tileCounts = entry; hasTileCounts = true; break;
+            case 0x014A: subIfds = entry; hasSubIfds = true; break;
+            case 0x828D:
+                tiffEntryValue(r, entry, 0, ifd.cfaRepeat[0]);
+                tiffEntryValue(r, entry, 1, ifd.cfaRepeat[1]);
+                break;
+            case 0x828E: ifd.cfaPattern = entry; ifd.hasCfaPattern = true; break;
+            case 0xC616: ifd.cfaPlaneColor = entry; ifd.hasPlaneColor = true; break;
+            case 0xC618: ifd.linearization = entry; ifd.hasLinearization = true; break;
+            case 0xC619:
+                tiffEntryValue(r, entry, 0, ifd.blackRepeat[0]);
+                tiffEntryValue(r, entry, 1, ifd.blackRepeat[1]);
+                break;
+            case 0xC61A: ifd.blackLevel = entry; ifd.hasBlackLevel = true; break;
+            case 0xC61D:
+                if (tiffEntryNumber(r, entry, 0, number)) ifd.whiteLevel = number;
+                break;
+            case 0xC68D:
+                ifd.hasActiveArea = entry.count == 4;
+                for (uint32_t k = 0; k < 4 && ifd.hasActiveArea; ++k) {
+                    ifd.hasActiveArea = tiffEntryValue(r, entry, k, ifd.activeArea[k]);
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (!isIfd0) continue;
+        switch (entry.tag) {
+            case 0x0112:
+                if (tiffEntryValue(r, entry, 0, value)) {
+                    layout.orientation = exifOrientationToFlip(static_cast<uint16_t>(value));
+                }
+                break;
+            case 0xC612: layout.isDng = true; break;
+            case 0xC621: readNumbers(r, entry, layout.colorMatrix[0], 9, layout.colorMatrixCount[0]); break;
+            case 0xC622: readNumbers(r, entry, layout.colorMatrix[1], 9, layout.colorMatrixCount[1]); break;
+            case 0xC65A: tiffEntryValue(r, entry, 0, layout.illuminant[0]); break;
+            case 0xC65B: tiffEntryValue(r, entry, 0, layout.illuminant[1]); break;
+            case 0xC628: {
+                uint32_t count;
+                readNumbers(r, entry, layout.asShotNeutral, 3, count);
+                layout.hasAsShotNeutral = count == 3;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // The main image is the full resolution (NewSubFileType 0) CFA one
+    if (!layout.foundRaw && subFileType == 0 && photometric == 32803) {
+        if (hasTiles && hasTileCounts) {
+            ifd.offsets = tileOffsets;
+            ifd.byteCounts = tileCounts;
+            ifd.hasOffsets = ifd.hasByteCounts = true;
+        } else if (hasStrips && hasStripCounts) {
+            ifd.offsets = stripOffsets;
+            ifd.byteCounts = stripCounts;
+            ifd.hasOffsets = ifd.hasByteCounts = true;
+            ifd.tileWidth = ifd.width;
+            ifd.tileHeight = rowsPerStrip ? std::min(rowsPerStrip, ifd.height) : ifd.height;
+        }
+        // Keep the IFD0 fields gathered so far
+        ifd.isDng = layout.isDng;
+        ifd.orientation = layout.orientation;
+        memcpy(ifd.colorMatrix, layout.colorMatrix, sizeof(ifd.colorMatrix));
+        memcpy(ifd.colorMatrixCount, layout.colorMatrixCount, sizeof(ifd.colorMatrixCount));
+        memcpy(ifd.illuminant, layout.illuminant, sizeof(ifd.illuminant));
+        memcpy(ifd.asShotNeutral, layout.asShotNeutral, sizeof(ifd.asShotNeutral));
+        ifd.hasAsShotNeutral = layout.hasAsShotNeutral;
+        ifd.foundRaw = true;
+        layout = ifd;
+    }
+
+    if (hasSubIfds) {
+        for (uint32_t i = 0; i < subIfds.count && i < 8; ++i) {
+            uint32_t offset;
+            if (tiffEntryValue(r, subIfds, i, offset)) {
+                scanDngIfd(r, offset, depth + 1, false, layout, visited);
+            }
+        }
+    }
+
+    uint32_t nextIfd;
+    if (isIfd0 && r.u32(ifdPosition + 2 + entryCount * 12ull, nextIfd) && nextIfd != 0) {
+        scanDngIfd(r, nextIfd, depth, false, layout, visited);
+    }
+}
+
+// Unpack one row of uncompressed samples. 12 and 16 bit rows use SIMD where available.
+// Packed samples are stored most significant bit first; 16-bit ones in the file's byte order.
+inline void unpack16(const uint8_t* src, uint16_t* dst, int count, bool bigEndian) {
+    if (!bigEndian) {
+        memcpy(dst, src, static_cast<size_t>(count) * 2);  // Hosts are little endian
+        return;
+    }
+    int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u16(dst + i, vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(src + i * 2))));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = static_cast<uint16_t>(src[i * 2] << 8 | src[i * 2 + 1]);
+    }
+}
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(__ARM_NEON) && (defined(__GNUC__) || defined(__clang__))
+// 16 samples from 24 bytes: gather each sample's two bytes, then shift the even/odd ones into place
+__attribute__((target("ssse3"))) inline int unpack12Ssse3(const uint8_t* src, uint16_t* dst, int count) {
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i lowMask = _mm_set1_epi32(0x0FFF0000);
+    const int available = (count * 12 + 7) / 8;
+    int i = 0;
+    for (; i + 8 <= count && (i / 2) * 3 + 16 <= available; i += 8) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (i / 2) * 3));
+        __m128i words = _mm_shuffle_epi8(bytes, shuffle);
+        // Even samples are the top 12 bits of their word, odd samples the bottom 12
+        __m128i even = _mm_srli_epi16(words, 4);
+        __m128i odd = _mm_and_si128(words, lowMask);
+        __m128i samples = _mm_or_si128(_mm_and_si128(even, _mm_set1_epi32(0x0000FFFF)), odd);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), samples);
+    }
+    return i;
+}
+
+inline bool cpuHasSsse3() {
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+#endif
+
+inline void unpack12(const uint8_t* src, uint16_t* dst, int count) {
+    int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 32 <= count; i += 32) {
+        uint8x16x3_t b = vld3q_u8(src + (i / 2) * 3);
+        uint16x8x2_t low, high;
+        low.val[0] = vorrq_u16(vshll_n_u8(vget_low_u8(b.val[0]), 4), vmovl_u8(vshr_n_u8(vget_low_u8(b.val[1]), 4)));
+        low.val[1] = vorrq_u16(vshll_n_u8(vand_u8(vget_low_u8(b.val[1]), vdup_n_u8(0x0F)), 8), vmovl_u8(vget_low_u8(b.val[2])));
+        high.val[0] = vorrq_u16(vshll_n_u8(vget_high_u8(b.val[0]), 4), vmovl_u8(vshr_n_u8(vget_high_u8(b.val[1]), 4)));
+        high.val[1] = vorrq_u16(vshll_n_u8(vand_u8(vget_high_u8(b.val[1]), vdup_n_u8(0x0F)), 8), vmovl_u8(vget_high_u8(b.val[2])));
+        vst2q_u16(dst + i, low);
+        vst2q_u16(dst + i + 16, high);
+    }
+#elif (defined(__SSE2__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+    if (cpuHasSsse3()) {
+        i = unpack12Ssse3(src, dst, count);
+    }
+#endif
+    for (; i + 2 <= count; i += 2) {
+        const uint8_t* p = src + (i / 2) * 3;
+        dst[i] = static_cast<uint16_t>(p[0] << 4 | p[1] >> 4);
+        dst[i + 1] = static_cast<uint16_t>((p[1] & 0x0F) << 8 | p[2]);
+    }
+    if (i < count) {
+        const uint8_t* p = src + (i / 2) * 3;
+        dst[i] = static_cast<uint16_t>(p[0] << 4 | p[1] >> 4);
+    }
+}
+
+// Any other depth (e.g. 10 or 14 bits) through a bit reader
+inline void unpackBits(const uint8_t* src, uint16_t* dst, int count, int bits) {
+    uint64_t buffer = 0;
+    int available = 0;
+    const uint32_t mask = (1u << bits) - 1;
+    for (int i = 0; i < count; ++i) {
+        while (available < bits) {
+            buffer = buffer << 8 | *src++;
+            available += 8;
+        }
+        available -= bits;
+        dst[i] = static_cast<uint16_t>((buffer >> available) & mask);
+    }
+}
+
+// Huffman table for lossless JPEG, with a lookup for codes up to kFastBits long
+struct HuffmanTable {
+    static constexpr int kFastBits = 10;
+    uint16_t fast[1 << kFastBits] = {};  // (length << 8) | symbol, 0 if the code is longer
+    int32_t maxCode[18] = {};            // Largest code of each length, -1 if none
+    int32_t valueOffset[17] = {};
+    uint8_t values[256] = {};
+    bool defined = false;
+
+    bool build(const uint8_t counts[16], const uint8_t* symbols, int symbolCount) {
+        memcpy(values, symbols, symbolCount);
+        memset(fast, 0, sizeof(fast));
+        int code = 0, k = 0;
+        for (int length = 1; length <= 16; ++length) {
+            valueOffset[length] = k - code;
+            for (int n = 0; n < counts[length - 1]; ++n, ++k, ++code) {
+                if (code >= (1 << length)) return false;  // Over-subscribed
+                if (length <= kFastBits) {
+                    int shift = kFastBits - length;
+                    for (int fill = 0; fill < (1 << shift); ++fill) {
+                        fast[(code << shift) | fill] = static_cast<uint16_t>(length << 8 | values[k]);
+                    }
+                }
+            }
+            maxCode[length] = counts[length - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+        maxCode[17] = INT32_MAX;
+        defined = true;
+        return true;
+    }
+};
+
+// Entropy coded data reader that removes stuffed zero bytes and stops at markers
+class JpegBitReader {
+public:
+    JpegBitReader(const uint8_t* data, size_t size, size_t position) : data_(data), size_(size), position_(position) {}
+
+    uint32_t peek(int bits) {
+        fill();
+        return static_cast<uint32_t>(buffer_ >> (available_ - bits)) & ((1u << bits) - 1);
+    }
+
+    void skip(int bits) { available_ -= bits; }
+
+    uint32_t read(int bits) {
+        if (bits == 0) return 0;
+        uint32_t value = peek(bits);
+        skip(bits);
+        return value;
+    }
+
+    // Drop the rest of the current byte and move past the next restart marker
+    bool restart() {
+        available_ = 0;
+        buffer_ = 0;
+        hitMarker_ = false;
+        while (position_ + 1 < size_) {
+            if (data_[position_] == 0xFF && data_[position_ + 1] >= 0xD0 && data_[position_ + 1] <= 0xD7) {
+                position_ += 2;
+                return true;
+            }
+            position_++;
+        }
+        return false;
+    }
+
+private:
+    void fill() {
+        while (available_ <= 56) {
+            uint8_t byte = 0;
+            if (!hitMarker_ && position_ < size_) {
+                byte = data_[position_];
+                if (byte == 0xFF) {
+                    uint8_t next = position_ + 1 < size_ ? data_[position_ + 1] : 0;
+                    if (next == 0x00) {
+                        position_ += 2;
+                    } else {
+                        hitMarker_ = true;  // Leave the marker; pad with zero bits
+                        byte = 0;
+                    }
+                } else {
+                    position_++;
+                }
+            }
+            buffer_ = buffer_ << 8 | byte;
+            available_ += 8;
+        }
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t position_;
+    uint64_t buffer_ = 0;
+    int available_ = 0;
+    bool hitMarker_ = false;
+};
+
+inline int decodeHuffmanDifference(JpegBitReader& bits, const HuffmanTable& table) {
+    uint32_t look = bits.peek(HuffmanTable::kFastBits);
+    uint16_t entry = table.fast[look];
+    int length, category;
+    if (entry) {
+        length = entry >> 8;
+        category = entry & 0xFF;
+    } else {
+        uint32_t code = bits.peek(16);
+        length = HuffmanTable::kFastBits + 1;
+        while (length <= 16 && static_cast<int32_t>(code >> (16 - length)) > table.maxCode[length]) {
+            length++;
+        }
+        if (length > 16) return 0;  // Corrupt data
+        category = table.values[(code >> (16 - length)) + table.valueOffset[length]];
+    }
+    bits.skip(length);
+
+    if (category == 0) return 0;
+    if (category >= 16) return 32768;
+    int value = static_cast<int>(bits.read(category));
+    if (value < (1 << (category - 1))) {
+        value -= (1 << category) - 1;
+    }
+    return value;
+}
+
+// Decode a lossless JPEG (ITU T.81 process 14) tile, calling storeRow(samples, count) for each
+// row of the frame (components interleaved) until it returns false
+template <typename StoreRow>
+inline bool decodeLosslessJpeg(const uint8_t* data, size_t size, StoreRow&& storeRow) {
+    ByteReader r(data, size, true);
+    uint16_t marker;
+    if (!r.u16(0, marker) || marker != 0xFFD8) return false;
+
+    HuffmanTable tables[4];
+    int precision = 0, width = 0, height = 0, components = 0;
+    int componentTable[4] = {};
+    int predictor = 0, pointTransform = 0;
+    uint16_t restartInterval = 0;
+    uint64_t position = 2;
+    uint64_t scanData = 0;
+
+    while (scanData == 0) {
+        uint16_t length;
+        if (!r.u16(position, marker) || !r.u16(position + 2, length) || (marker & 0xFF00) != 0xFF00) return false;
+        const uint64_t segment = position + 4;
+        if (marker == 0xFFC3) {
+            uint8_t p, count;
+            uint16_t h, w;
+            if (!r.u8(segment, p) || !r.u16(segment + 1, h) || !r.u16(segment + 3, w) || !r.u8(segment + 5, count)) return false;
+            precision = p;
+            height = h;
+            width = w;
+            components = count;
+            if (components < 1 || components > 4 || precision < 2 || precision > 16) return false;
+            for (int c = 0; c < components; ++c) {
+                uint8_t sampling;
+                if (!r.u8(segment + 7 + c * 3ull, sampling) || sampling != 0x11) return false;
+            }
+        } else if ((marker >= 0xFFC0 && marker <= 0xFFCF) && marker != 0xFFC4 && marker != 0xFFC8 && marker != 0xFFCC) {
+            return false;  // Not lossless Huffman
+        } else if (marker == 0xFFC4) {
+            uint64_t p = segment;
+            while (p < position + 2 + length) {
+                uint8_t classAndId;
+                uint8_t counts[16];
+                if (!r.u8(p, classAndId) || !r.has(p + 1, 16)) return false;
+                memcpy(counts, data + p + 1, 16);
+                int total = 0;
+                for (uint8_t count : counts) total += count;
+                if ((classAndId & 0x0F) > 3 || total > 256 || !r.has(p + 17, total)) return false;
+                if (!tables[classAndId & 0x0F].build(counts, data + p + 17, total)) return false;
+                p += 17 + total;
+            }
+        } else if (marker == 0xFFDD) {
+            if (!r.u16(segment, restartInterval)) return false;
+        } else if (marker == 0xFFDA) {
+            uint8_t count;
+            if (!r.u8(segment, count) || count != components) return false;
+            for (int c = 0; c < count; ++c) {
+                uint8_t selectors;
+                if (!r.u8(segment + 2 + c * 2ull, selectors)) return false;
+                componentTable[c] = selectors >> 4;
+                if (componentTable[c] > 3 || !tables[componentTable[c]].defined) return false;
+            }
+            uint8_t ss, ah;
+            if (!r.u8(segment + 1 + count * 2ull, ss) || !r.u8(segment + 3 + count * 2ull, ah)) return false;
+            predictor = ss;
+            pointTransform = ah & 0x0F;
+            scanData = position + 2 + length;
+        }
+        position += 2 + length;
+    }
+    if (width == 0 || height == 0 || predictor < 1 || predictor > 7 || pointTransform != 0) return false;
+
+    // Restarts only on row boundaries, where the next row is predicted like the first
+    const int rowLength = width * components;
+    if (restartInterval && restartInterval % width != 0) return false;
+    const int restartRows = restartInterval ? restartInterval / width : 0;
+
+    JpegBitReader bits(data, size, scanData);
+    std::vector<uint16_t> rows[2] = {std::vector<uint16_t>(rowLength), std::vector<uint16_t>(rowLength)};
+    const uint16_t initial = static_cast<uint16_t>(1u << (precision - 1));
+
+    for (int y = 0; y < height; ++y) {
+        uint16_t* row = rows[y & 1].data();
+        const uint16_t* above = rows[(y + 1) & 1].data();
+        bool firstRow = y == 0;
+        if (restartRows && y > 0 && y % restartRows == 0) {
+            if (!bits.restart()) return false;
+            firstRow = true;
+        }
+
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < components; ++c) {
+                const int i = x * components + c;
+                int diff = decodeHuffmanDifference(bits, tables[componentTable[c]]);
+                int prediction;
+                if (x == 0) {
+                    prediction = firstRow ? initial : above[i];
+                } else if (firstRow) {
+                    prediction = row[i - components];
+                } else {
+                    const int a = row[i - components], b = above[i], cc = above[i - components];
+                    switch (predictor) {
+                        case 1: prediction = a; break;
+                        case 2: prediction = b; break;
+                        case 3: prediction = cc; break;
+                        case 4: prediction = a + b - cc; break;
+                        case 5: prediction = a + ((b - cc) >> 1); break;
+                        case 6: prediction = b + ((a - cc) >> 1); break;
+                        default: prediction = (a + b) >> 1; break;
+                    }
+                }
+                row[i] = static_cast<uint16_t>(prediction + diff);
+            }
+        }
+        if (!storeRow(row, rowLength)) break;
+    }
+    return true;
+}
+
+}  // namespace dng_detail
+
+// Margin decoded around a requested region, enough for the demosaic to read real neighbours
+constexpr int kDngRegionMargin = 16;
+
+// Decode the CFA image of a DNG held in memory. Returns false for layouts this reader
+// doesn't handle, in which case LibRaw should be used instead.
+// With allowParallel, tiles/strips are decoded across the shared pool. With regionUv (0-1
+// coordinates of the active area) only the tiles/strips under that region are decoded.
+inline bool decodeDng(const uint8_t* file, size_t fileSize, DngImage& out, bool allowParallel,
+                      const SDL_FRect* regionUv = nullptr) {
+    using namespace dng_detail;
+    ByteReader r(file, fileSize);
+    if (r.matches(0, "II")) {
+        r.setBigEndian(false);
+    } else if (r.matches(0, "MM")) {
+        r.setBigEndian(true);
+    } else {
+        return false;
+    }
+    uint16_t magic;
+    uint32_t firstIfd;
+    if (!r.u16(2, magic) || magic != 42 || !r.u32(4, firstIfd)) return false;
+    const bool bigEndian = r.matches(0, "MM");
+
+    DngLayout layout;
+    std::vector<uint64_t> visited;
+    scanDngIfd(r, firstIfd, 0, true, layout, visited);
+
+    // Only the layouts handled below; everything else goes to LibRaw
+    const uint32_t bits = layout.bitsPerSample;
+    const uint32_t repeat = layout.cfaRepeat[0];
+    if (!layout.isDng || !layout.foundRaw || !layout.hasOffsets || !layout.hasByteCounts ||
+        layout.samplesPerPixel != 1 || !layout.hasCfaPattern ||
+        (layout.compression != 1 && layout.compression != 7) || bits < 8 || bits > 16 ||
+        repeat != layout.cfaRepeat[1] || (repeat != 2 && repeat != 6) ||
+        layout.width == 0 || layout.height == 0 || layout.width > 65535 || layout.height > 65535 ||
+        layout.tileWidth == 0 || layout.tileHeight == 0) {
+        return false;
+    }
+
+    const uint32_t width = layout.width, height = layout.height;
+    const uint32_t tilesAcross = (width + layout.tileWidth - 1) / layout.tileWidth;
+    const uint32_t tilesDown = (height + layout.tileHeight - 1) / layout.tileHeight;
+    const uint64_t tileCount = static_cast<uint64_t>(tilesAcross) * tilesDown;
+    if (layout.offsets.count < tileCount || layout.byteCounts.count < tileCount) return false;
+
+    // Every sample takes at least a bit, which also bounds what a corrupt header can allocate
+    uint64_t dataBytes = 0;
+    for (uint32_t tile = 0; tile < tileCount; ++tile) {
+        uint32_t length;
+        if (!tiffEntryValue(r, layout.byteCounts, tile, length)) return false;
+        dataBytes += length;
+    }
+    const uint64_t bitsPerSampleMin = layout.compression == 1 ? bits : 1;
+    if (dataBytes > fileSize || dataBytes * 8 < static_cast<uint64_t>(width) * height * bitsPerSampleMin / 2) {
+        return false;
+    }
+
+    std::vector<uint16_t> linearization;
+    if (layout.hasLinearization) {
+        for (uint32_t i = 0; i < layout.linearization.count && i < 65536; ++i) {
+            uint32_t value;
+            if (!tiffEntryValue(r, layout.linearization, i, value)) return false;
+            linearization.push_back(static_cast<uint16_t>(value));
+        }
+    }
+
+    // Active area and the CFA pattern relative to it
+    uint32_t top = 0, left = 0, bottom = height, right = width;
+    if (layout.hasActiveArea) {
+        top = layout.activeArea[0];
+        left = layout.activeArea[1];
+        bottom = std::min(layout.activeArea[2], height);
+        right = std::min(layout.activeArea[3], width);
+        if (top >= bottom || left >= right) return false;
+    }
+
+    // Tiles to decode and the raw rectangle they cover
+    uint32_t firstTileX = 0, lastTileX = tilesAcross - 1, firstTileY = 0, lastTileY = tilesDown - 1;
+    if (regionUv) {
+        SDL_Rect region = regionPixels(*regionUv, static_cast<int>(right - left), static_cast<int>(bottom - top),
+                                       kDngRegionMargin);
+        if (region.w <= 0 || region.h <= 0) return false;
+        firstTileX = (left + region.x) / layout.tileWidth;
+        lastTileX = (left + region.x + region.w - 1) / layout.tileWidth;
+        firstTileY = (top + region.y) / layout.tileHeight;
+        lastTileY = (top + region.y + region.h - 1) / layout.tileHeight;
+    }
+    const uint32_t boundsX = firstTileX * layout.tileWidth;
+    const uint32_t boundsY = firstTileY * layout.tileHeight;
+    const uint32_t pitch = std::min(width, (lastTileX + 1) * layout.tileWidth) - boundsX;
+    const uint32_t boundsHeight = std::min(height, (lastTileY + 1) * layout.tileHeight) - boundsY;
+    std::vector<uint32_t> tiles;
+    for (uint32_t ty = firstTileY; ty <= lastTileY; ++ty) {
+        for (uint32_t tx = firstTileX; tx <= lastTileX; ++tx) {
+            tiles.push_back(ty * tilesAcross + tx);
+        }
+    }
+
+    out.samples.assign(static_cast<size_t>(pitch) * boundsHeight, 0);
+    uint16_t* samples = out.samples.data();
+
+    // Each tile writes only its own rectangle, so tiles can be decoded in any order
+    std::atomic<bool> failed{false};
+    auto decodeTile = [&](size_t index) {
+        const uint32_t tile = tiles[index];
+        uint32_t offset, length;
+        if (!tiffEntryValue(r, layout.offsets, tile, offset) ||
+            !tiffEntryValue(r, layout.byteCounts, tile, length) || !r.has(offset, length)) {
+            failed = true;
+            return;
+        }
+        const uint32_t x0 = (tile % tilesAcross) * layout.tileWidth;
+        const uint32_t y0 = (tile / tilesAcross) * layout.tileHeight;
+        const uint32_t columns = std::min(layout.tileWidth, width - x0);
+        const uint32_t rows = std::min(layout.tileHeight, height - y0);
+        uint16_t* origin = samples + static_cast<size_t>(y0 - boundsY) * pitch + (x0 - boundsX);
+
+        if (layout.compression == 1) {
+            const uint64_t rowBytes = (static_cast<uint64_t>(layout.tileWidth) * bits + 7) / 8;
+            if (rowBytes * rows > length) {
+                failed = true;
+                return;
+            }
+            for (uint32_t y = 0; y < rows; ++y) {
+                const uint8_t* src = file + offset + rowBytes * y;
+                uint16_t* dst = origin + static_cast<size_t>(y) * pitch;
+                if (bits == 16) {
+                    unpack16(src, dst, columns, bigEndian);
+                } else if (bits == 12) {
+                    unpack12(src, dst, columns);
+                } else if (bits == 8) {
+                    std::copy(src, src + columns, dst);
+                } else {
+                    unpackBits(src, dst, columns, bits);
+                }
+            }
+        } else {
+            // Samples fill the tile row by row, whatever shape the JPEG frame claims
+            // (converters often store two CFA rows per JPEG row, or two columns per sample)
+            const uint32_t wrap = std::min(layout.tileWidth, width);
+            uint32_t y = 0, x = 0;
+            bool ok = decodeLosslessJpeg(file + offset, length, [&](const uint16_t* jpegRow, int count) {
+                while (count > 0 && y < rows) {
+                    const uint32_t run = std::min<uint32_t>(wrap - x, count);
+                    if (x < columns) {
+                        memcpy(origin + static_cast<size_t>(y) * pitch + x, jpegRow,
+                               std::min(run, columns - x) * sizeof(uint16_t));
+                    }
+                    jpegRow += run;
+                    count -= run;
+                    x += run;
+                    if (x == wrap) {
+                        x = 0;
+                        y++;
+                    }
+                }
+                return y < rows;
+            });
+            if (!ok || y < rows) {
+                failed = true;
+                return;
+            }
+        }
+
+        if (!linearization.empty()) {
+            const uint16_t last = static_cast<uint16_t>(linearization.size() - 1);
+            for (uint32_t y = 0; y < rows; ++y) {
+                uint16_t* row = origin + static_cast<size_t>(y) * pitch;
+                for (uint32_t x = 0; x < columns; ++x) {
+                    row[x] = linearization[std::min(row[x], last)];
+                }
+            }
+        }
+    };
+    if (allowParallel) {
+        parallelFor(tiles.size(), decodeTile);
+    } else {
+        for (size_t index = 0; index < tiles.size() && !failed; ++index) {
+            decodeTile(index);
+        }
+    }
+    if (failed) {
+        out.samples.clear();
+        return false;
+    }
+
+    // The decoded part of the active area
+    const uint32_t cfaTop = std::max(top, boundsY), cfaLeft = std::max(left, boundsX);
+    const uint32_t cfaBottom = std::min(bottom, boundsY + boundsHeight), cfaRight = std::min(right, boundsX + pitch);
+    if (cfaTop >= cfaBottom || cfaLeft >= cfaRight) return false;
+    out.activeWidth = static_cast<int>(right - left);
+    out.activeHeight = static_cast<int>(bottom - top);
+    out.regionX = static_cast<int>(cfaLeft - left);
+    out.regionY = static_cast<int>(cfaTop - top);
+
+    CfaImage& cfa = out.cfa;
+    cfa.pitch = pitch;
+    cfa.data = samples + static_cast<size_t>(cfaTop - boundsY) * pitch + (cfaLeft - boundsX);
+    cfa.width = static_cast<int>(cfaRight - cfaLeft);
+    cfa.height = static_cast<int>(cfaBottom - cfaTop);
+    cfa.patternSize = static_cast<int>(repeat);
+
+    uint8_t planeColor[4] = {0, 1, 2, 3};
+    for (uint32_t i = 0; layout.hasPlaneColor && i < layout.cfaPlaneColor.count && i < 4; ++i) {
+        r.u8(layout.cfaPlaneColor.valuePosition + i, planeColor[i]);
+    }
+    uint8_t rawPattern[6][6];
+    for (uint32_t row = 0; row < repeat; ++row) {
+        for (uint32_t col = 0; col < repeat; ++col) {
+            uint8_t index;
+            if (!r.u8(layout.cfaPattern.valuePosition + row * repeat + col, index) || index > 3 ||
+                planeColor[index] > 2) {
+                return false;  // Not an RGB CFA
+            }
+            rawPattern[row][col] = planeColor[index];
+        }
+    }
+    for (uint32_t row = 0; row < repeat; ++row) {
+        for (uint32_t col = 0; col < repeat; ++col) {
+            cfa.pattern[row][col] = rawPattern[(row + cfaTop) % repeat][(col + cfaLeft) % repeat];
+        }
+    }
+
+    // Average the black level repeat pattern (which starts at the active area) per color
+    double blackSum[3] = {}, blackCount[3] = {};
+    const uint32_t blackRows = std::max(1u, layout.blackRepeat[0]), blackCols = std::max(1u, layout.blackRepeat[1]);
+    if (blackRows > 16 || blackCols > 16) return false;
+    for (uint32_t row = 0; row < blackRows * repeat; ++row) {
+        for (uint32_t col = 0; col < blackCols * repeat; ++col) {
+            double level = 0.0;
+            if (layout.hasBlackLevel) {
+                tiffEntryNumber(r, layout.blackLevel, (row % blackRows) * blackCols + col % blackCols, level);
+            }
+            int c = rawPattern[(row + top) % repeat][(col + left) % repeat];
+            blackSum[c] += level;
+            blackCount[c] += 1.0;
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        cfa.black[c] = blackCount[c] > 0.0 ? static_cast<float>(blackSum[c] / blackCount[c]) : 0.0f;
+    }
+    cfa.white = static_cast<float>(layout.whiteLevel > 0.0 ? layout.whiteLevel : (1u << bits) - 1);
+
+    // Camera to sRGB: prefer the D65 matrix, as LibRaw does
+    int matrix = layout.colorMatrixCount[1] == 9 && (layout.illuminant[1] == 21 || layout.illuminant[0] != 21) ? 1 : 0;
+    if (layout.colorMatrixCount[matrix] == 9) {
+        static const double xyzRgb[3][3] = {{0.412453, 0.357580, 0.180423},
+                                            {0.212671, 0.715160, 0.072169},
+                                            {0.019334, 0.119193, 0.950227}};
+        double camRgb[3][3] = {};
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                for (int k = 0; k < 3; ++k) {
+                    camRgb[i][j] += layout.colorMatrix[matrix][i * 3 + k] * xyzRgb[k][j];
+                }
+            }
+        }
+        double preMul[3];
+        for (int i = 0; i < 3; ++i) {
+            double sum = camRgb[i][0] + camRgb[i][1] + camRgb[i][2];
+            preMul[i] = sum != 0.0 ? 1.0 / sum : 1.0;
+            for (int j = 0; j < 3; ++j) camRgb[i][j] *= preMul[i];  // Rows sum to 1 so white stays white
+        }
+
+        const double (&m)[3][3] = camRgb;
+        double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                     m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                     m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        if (std::fabs(det) > 1e-9) {
+            cfa.rgbCam[0][0] = static_cast<float>((m[1][1] * m[2][2] - m[1][2] * m[2][1]) / det);
+            cfa.rgbCam[0][1] = static_cast<float>((m[0][2] * m[2][1] - m[0][1] * m[2][2]) / det);
+            cfa.rgbCam[0][2] = static_cast<float>((m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det);
+            cfa.rgbCam[1][0] = static_cast<float>((m[1][2] * m[2][0] - m[1][0] * m[2][2]) / det);
+            cfa.rgbCam[1][1] = static_cast<float>((m[0][0] * m[2][2] - m[0][2] * m[2][0]) / det);
+            cfa.rgbCam[1][2] = static_cast<float>((m[0][2] * m[1][0] - m[0][0] * m[1][2]) / det);
+            cfa.rgbCam[2][0] = static_cast<float>((m[1][0] * m[2][1] - m[1][1] * m[2][0]) / det);
+            cfa.rgbCam[2][1] = static_cast<float>((m[0][1] * m[2][0] - m[0][0] * m[2][1]) / det);
+            cfa.rgbCam[2][2] = static_cast<float>((m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det);
+        }
+
+        // Daylight balance if the file has no as-shot neutral
+        float minMul = static_cast<float>(std::min({preMul[0], preMul[1], preMul[2]}));
+        for (int c = 0; c < 3 && minMul > 0.0f; ++c) {
+            cfa.wbMul[c] = static_cast<float>(preMul[c]) / minMul;
+        }
+    }
+
+    if (layout.hasAsShotNeutral && layout.asShotNeutral[0] > 0 && layout.asShotNeutral[1] > 0 &&
+        layout.asShotNeutral[2] > 0) {
+        double mul[3];
+        for (int c = 0; c < 3; ++c) mul[c] = 1.0 / layout.asShotNeutral[c];
+        double minMul = std::min({mul[0], mul[1], mul[2]});
+        for (int c = 0; c < 3; ++c) cfa.wbMul[c] = static_cast<float>(mul[c] / minMul);
+    }
+
+    out.orientation = layout.orientation;
+    return cfa.valid();
+}
+
+// Read and decode a DNG from disk. Returns false if it can't be read or isn't supported.
+inline bool decodeDngFile(const std::string& path, DngImage& out, bool allowParallel,
+                          const SDL_FRect* regionUv = nullptr) {
+    uint64_t fileSize;
+    int64_t modifiedTime;
+    std::vector<unsigned char> file;
+    if (!statFile(path, fileSize, modifiedTime) || fileSize > UINT32_MAX ||
+        !readFileRange(path, 0, static_cast<uint32_t>(fileSize), file)) {
+        return false;
+    }
+    return decodeDng(file.data(), file.size(), out, allowParallel, regionUv);
+}
@@ -1,49 +1,108 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <thread>
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <filesystem>
 #include <libraw/libraw.h>
 #include <SDL3/SDL.h>
 #include "concurrent_queue.h"
 #include "texture_types.h"
+#include "raw_develop.h"
+#include "adjustments.h"
+#include "metadata_index.h"
+#include "image_stats.h"
+#include "overlays.h"
+#include "perceptual_hash.h"
+#include "sharpness.h"
+#include "raw_header_parser.h"
+#include "dng_decoder.h"
+#include "preview_lod.h"
 
 namespace fs = std::filesystem;
 
-// Forward declaration from main.cpp
-CpuTexture loadJpegPreview(LibRaw& rawProcessor);
+// Forward declarations from main.cpp
+CpuTexture loadEmbeddedPreview(LibRaw& rawProcessor, int targetSize, bool allowParallel);
+void collectPreviewLocations(LibRaw& rawProcessor, FileMetadata& metadata);
+CpuTexture loadPreviewFromLocations(const std::string& imagePath, const FileMetadata& metadata, int targetSize,
+                                    bool allowParallel);
 
 // Type of load to perform
 enum class LoadType {
     PreviewOnly,  // Only load JPEG preview/thumbnail
     RawOnly,      // Only load full raw image
-    Both          // Load both preview and full raw image
+    Both,         // Load both preview and full raw image
+    FallbackThumbnail, // Develop a thumbnail from the sensor data (file has no usable preview)
+    Region,            // Develop part of the raw at full resolution (zoomed in past the preview)
+    Measure            // Decode a mid-size preview only to score it, nothing is uploaded
+};
+
+// Workers always drain higher priority queues first
+enum class LoadPriority {
+    Interactive, // The image being viewed - large previews are decoded across all cores
+    Normal,      // Something on screen is waiting for it
+    Background,  // Slow work that can wait until nothing else is queued
+    Count
 };
 
 // Task to load an image
 struct LoadTask {
     size_t imageIndex;
     std::string imagePath;
+    std::string sidecarPath;  // JPEG shot alongside the raw, used for previews if set
     LoadType loadType;
+    int previewTargetSize = 0;  // Long edge in pixels the preview should cover (0 = largest)
+    ImageLod lod = ImageLod::Screen;  // Preview LOD a preview result is cut down to and stored as
+    LoadPriority priority = LoadPriority::Normal;
+    DevelopProfile profile = DevelopProfile::Final;
+    bool allowFasterProfile = false;  // Worker may develop with a faster profile if the queue is deep
+    bool keepLinear = false;  // Keep the linear develop so the look can be adjusted interactively
+    SDL_FRect regionUv = {0.0f, 0.0f, 1.0f, 1.0f};  // Part of the image a Region load develops
+    bool computeOverlays = false;  // Build the clipping and focus peaking overlays of the result
+    bool windowed = false;  // Develop for the decode-ahead window, dropped if the image leaves it first
+    uint32_t generation = 0;  // Of the entry when queued, results for an older file are dropped
 };
 
 // Result from loading (either preview or raw)
 enum class ImageType {
     Preview,
-    Raw
+    Raw,
+    Region,
+    Measurement, // Measurements of a preview decoded for a Measure task, its pixels are dropped
+    Dropped,     // A windowed develop skipped because its image left the window before it started
+    Failed       // A raw that couldn't be opened or developed
 };
 
 struct LoadResult {
     size_t imageIndex;
     ImageType type;
-    CpuTexture cpuTexture;
-    libraw_processed_image_t* rawImage;  // Only used for Raw type
+    CpuTexture cpuTexture;               // Preview, or a Raw developed without LibRaw
+    libraw_processed_image_t* rawImage;  // Only used for Raw type developed by LibRaw
     int orientation;
+    DevelopProfile profile;  // Profile that produced a Raw result
+    std::shared_ptr<AdjustableImage> adjustable;  // Linear develop kept for adjusting, if there is one
+    bool adjustableRequested;  // The task asked for a linear develop
+    SDL_FRect regionUv;        // Part of the image a Region result covers
+    ImageStats stats;          // Histogram and exposure statistics of a Preview or Raw result
+    OverlayMasks overlays;     // Culling overlays of a Preview or Raw result, if the task asked
+    PerceptualHash hash;       // Of a Preview result, if hasHash
+    bool hasHash;
+    float sharpness;           // Of a preview of at least kSharpnessSize, if hasSharpness
+    bool hasSharpness;
+    bool windowed;             // Of a Raw result, developed for the decode-ahead window
+    ImageLod lod;              // Of a Preview result
+    CpuTexture placeholder;    // Placeholder LOD made from a Preview result
+    uint32_t generation;       // Of the task, set by pushResult()
 
-    LoadResult() : imageIndex(0), type(ImageType::Preview), rawImage(nullptr), orientation(0) {}
+    LoadResult() : imageIndex(0), type(ImageType::Preview), rawImage(nullptr), orientation(0), profile(DevelopProfile::Final),
+                   adjustableRequested(false), regionUv{0.0f, 0.0f, 1.0f, 1.0f}, hasHash(false),
+                   sharpness(0.0f), hasSharpness(false), windowed(false), lod(ImageLod::Screen), generation(0) {}
 
     ~LoadResult() {
         if (rawImage) {
@@ -59,7 +118,12 @@ struct LoadResult {
     LoadResult(LoadResult&& other) noexcept
         : imageIndex(other.imageIndex), type(other.type),
           cpuTexture(std::move(other.cpuTexture)), rawImage(other.rawImage),
-          orientation(other.orientation) {
+          orientation(other.orientation), profile(other.profile),
+          adjustable(std::move(other.adjustable)), adjustableRequested(other.adjustableRequested),
+          regionUv(other.regionUv), stats(other.stats), overlays(std::move(other.overlays)),
+          hash(other.hash), hasHash(other.hasHash), sharpness(other.sharpness), hasSharpness(other.hasSharpness),
+          windowed(other.windowed), lod(other.lod), placeholder(std::move(other.placeholder)),
+          generation(other.generation) {
         other.rawImage = nullptr;
     }
     LoadResult& operator=(LoadResult&& other) noexcept {
@@ -72,26 +136,96 @@ struct LoadResult {
             cpuTexture = std::move(other.cpuTexture);
             rawImage = other.rawImage;
             orientation = other.orientation;
+            profile = other.profile;
+            adjustable = std::move(other.adjustable);
+            adjustableRequested = other.adjustableRequested;
+            regionUv = other.regionUv;
+            stats = other.stats;
+            overlays = std::move(other.overlays);
+            hash = other.hash;
+            hasHash = other.hasHash;
+            sharpness = other.sharpness;
+            hasSharpness = other.hasSharpness;
+            windowed = other.windowed;
+            lod = other.lod;
+            placeholder = std::move(other.placeholder);
+            generation = other.generation;
             other.rawImage = nullptr;
         }
         return *this;
     }
 };
 
+// Culling overlays uploaded next to the image they were measured from
+struct OverlayTextures {
+    GpuTexture clipping;
+    GpuTexture peaking;
+};
+
+// One preview LOD of an image
+struct PreviewSlot {
+    GpuTexture texture;
+    bool loaded = false;
+    bool requested = false;  // Preview-only load requested
+    int targetSize = 0;      // Target size of the most recent request
+    uint64_t lastUsed = 0;   // Frame it was last asked for, the least recently used are evicted first
+};
+
+// What earlier runs measured of an image, looked up in the metadata index by the scan, which
+// has the file's size and modification time at hand, so the UI thread never has to
+struct ImageMeasurements {
+    ImageStats stats;  // valid() if known
+    PerceptualHash hash;
+    bool hashKnown = false;
+    float sharpness = 0.0f;
+    bool sharpnessKnown = false;
+};
+
+// Header keys a worker has just read for an image, from the file its previews come from (the
+// raw or its sidecar), whose size and modification time are given
+struct LocatedImage {
+    size_t imageIndex = 0;
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    int64_t captureTime = 0;  // 0 if unknown
+    std::string camera;
+    uint32_t generation = 0;  // Of the task that read it
+};
+
 // Entry in the database for a single image
 struct ImageEntry {
-    GpuTexture preview;
+    PreviewSlot previews[kPreviewLods];  // Indexed by ImageLod
     GpuTexture raw;
-    bool previewLoaded = false;
     bool rawLoaded = false;
-    bool previewRequested = false;  // Preview-only load requested
     bool rawRequested = false;       // Raw load requested
+    bool rawFailed = false;          // The raw couldn't be developed, it isn't asked for again
+    uint64_t rawLastUsed = 0;        // Frame the raw was last asked for
+    DevelopProfile rawProfile = DevelopProfile::Culling;  // Profile that produced raw
+    std::string sidecarPath;         // JPEG shot alongside the raw (RAW+JPEG), empty if none
+    bool adjustableUnavailable = false;  // Developed by LibRaw, so no linear develop can be kept
+    bool regionUnavailable = false;      // Sensor layout the native develop can't do a region of
+    ImageStats stats;                    // Best measurement so far (most pixels)
+    OverlayTextures previewOverlays;     // Of the Screen preview, once it has been loaded for viewing
+    OverlayTextures rawOverlays;         // Of the current raw develop
+    PerceptualHash hash;                 // Of the preview, once hashKnown
+    bool hashKnown = false;              // The hash is in the similarity index
+    float sharpness = 0.0f;              // Variance of the Laplacian, once sharpnessKnown
+    bool sharpnessKnown = false;
+    bool measureRequested = false;       // A Measure load is queued for the score
+    bool sharpnessUnavailable = false;   // No preview is large enough to score
+    bool rawWindowed = false;            // The raw was developed for the decode-ahead window
+    GpuTexture region;                   // Last full resolution develop of part of the image
+    bool regionLoaded = false;
+    bool regionRequested = false;        // A region develop is queued or in progress
+    SDL_FRect regionUv = {0.0f, 0.0f, 0.0f, 0.0f};  // Part of the image region covers
+    DevelopProfile regionProfile = DevelopProfile::Culling;
+    uint32_t generation = 0;             // Bumped when the file changes, see invalidate()
 };
 
 class ImageDatabase {
 public:
-    ImageDatabase(SDL_Renderer* renderer)
-        : renderer_(renderer), running_(false) {}
+    ImageDatabase(SDL_Renderer* renderer, MetadataIndex& metadataIndex)
+        : renderer_(renderer), metadataIndex_(metadataIndex), running_(false) {}
 
     ~ImageDatabase() {
         stop();
@@ -125,95 +259,430 @@ public:
     }
 
     // Try to get thumbnail for an image
-    // Returns nullptr if not loaded yet, and queues a preview-only load task
-    GpuTexture* tryGetThumbnail(size_t imageIndex, const std::string& imagePath) {
-        auto it = entries_.find(imageIndex);
-        if (it != entries_.end() && it->second.previewLoaded) {
-            return &it->second.preview;
-        }
+    // targetSize is the long edge in pixels the caller will draw it at (0 = largest available),
+    // which picks the preview LOD: sidebar-sized requests never load or return a screen-sized
+    // preview. Returns nullptr if nothing is loaded yet, and queues a preview-only load task.
+    // Until the LOD asked for is large enough, the best smaller one loaded is returned.
+    GpuTexture* tryGetThumbnail(size_t imageIndex, const std::string& imagePath, int targetSize,
+                                LoadPriority priority = LoadPriority::Normal) {
+        ImageEntry& entry = entries_[imageIndex];
+        const ImageLod lod = lodForSize(targetSize);
+        PreviewSlot& slot = entry.previews[static_cast<int>(lod)];
+        slot.lastUsed = frame_;
 
-        // Not loaded, queue a preview-only task if not already requested
-        if (it == entries_.end() || !it->second.previewRequested) {
-            if (it == entries_.end()) {
-                entries_[imageIndex] = ImageEntry();
-            }
-            entries_[imageIndex].previewRequested = true;
+        bool largeEnough = slot.loaded &&
+            (targetSize == 0 ? slot.targetSize == 0
+                             : std::max(slot.texture.originalWidth, slot.texture.originalHeight) >=
+                                   std::min(targetSize, lodMaxSize(lod) > 0 ? lodMaxSize(lod) : targetSize));
+
+        // Only ask again if this request wants more than the last one did, otherwise a file
+        // whose largest preview is still too small would be reloaded every frame
+        bool wantsMore = slot.targetSize != 0 &&
+            (targetSize == 0 || targetSize > slot.targetSize);
+
+        // Placeholders aren't loaded on their own, every preview brings one along
+        if (lod != ImageLod::Placeholder && !slot.requested && !largeEnough && (!slot.loaded || wantsMore)) {
+            slot.requested = true;
+            slot.targetSize = targetSize;
 
             LoadTask task;
             task.imageIndex = imageIndex;
             task.imagePath = imagePath;
+            task.sidecarPath = entry.sidecarPath;
             task.loadType = LoadType::PreviewOnly;
-            taskQueue_.push(std::move(task));
+            task.previewTargetSize = targetSize;
+            task.lod = lod;
+            task.priority = priority;
+            task.generation = entry.generation;
+            task.computeOverlays = priority == LoadPriority::Interactive;  // Only for the image being viewed
+            enqueue(std::move(task));
         }
 
+        if (slot.loaded) {
+            return &slot.texture;
+        }
+        for (int smaller = static_cast<int>(lod) - 1; smaller >= 0; --smaller) {
+            PreviewSlot& fallback = entry.previews[smaller];
+            if (fallback.loaded && fallback.texture.texture) {
+                fallback.lastUsed = frame_;
+                return &fallback.texture;
+            }
+        }
         return nullptr;
     }
 
-    // Try to get raw image
+    // Try to get raw image developed with at least the given profile
     // Returns nullptr if not loaded yet, and queues a raw load task if needed
-    GpuTexture* tryGetRaw(size_t imageIndex, const std::string& imagePath) {
+    // If it was developed with a faster profile, that is returned while a re-develop is queued
+    // With keepLinear the develop is also kept for getAdjustableImage(), re-developing if needed
+    GpuTexture* tryGetRaw(size_t imageIndex, const std::string& imagePath, DevelopProfile profile,
+                          LoadPriority priority = LoadPriority::Normal, bool keepLinear = false) {
+        ImageEntry& entry = entries_[imageIndex];
+        entry.rawLastUsed = frame_;
+        requestRaw(imageIndex, entry, imagePath, profile, priority, keepLinear, false);
+        return entry.rawLoaded ? &entry.raw : nullptr;
+    }
+
+    // Raw image developed with at least the given profile if it's already loaded, without
+    // queueing anything
+    GpuTexture* getRaw(size_t imageIndex, DevelopProfile profile) {
         auto it = entries_.find(imageIndex);
-        if (it != entries_.end() && it->second.rawLoaded) {
-            return &it->second.raw;
+        if (it == entries_.end() || !it->second.rawLoaded || it->second.rawProfile < profile) {
+            return nullptr;
         }
+        it->second.rawLastUsed = frame_;
+        return &it->second.raw;
+    }
 
-        // Not loaded, queue a load task if not already requested
-        if (it == entries_.end() || !it->second.rawRequested) {
-            if (it == entries_.end()) {
-                entries_[imageIndex] = ImageEntry();
-                it = entries_.find(imageIndex);
+    // Keep raws developed for a window of images around the one being culled, so stepping to any
+    // of them shows its develop at once. window is nearest first and starts with the image being
+    // viewed, which is queued ahead of the rest. Develops of images that leave the window are
+    // freed, and queued ones are dropped before a worker starts them. An empty window stops.
+    void setDevelopWindow(const std::vector<size_t>& window, const std::vector<fs::path>& images,
+                          DevelopProfile profile) {
+        if (window != windowImages_) {
+            {
+                std::lock_guard<std::mutex> lock(windowMutex_);
+                window_.clear();
+                window_.insert(window.begin(), window.end());
             }
-            
-            ImageEntry& entry = it->second;
-            entry.rawRequested = true;
+            for (size_t imageIndex : windowImages_) {
+                auto it = entries_.find(imageIndex);
+                if (it != entries_.end() && it->second.rawWindowed && !isInWindow(imageIndex) &&
+                    !isPinned(imageIndex)) {
+                    freeRaw(it->second);
+                }
+            }
+            windowImages_ = window;
+        }
 
-            // Determine load type based on whether preview is already loaded/requested
-            LoadType loadType;
-            if (entry.previewLoaded || entry.previewRequested) {
-                loadType = LoadType::RawOnly;
-            } else {
-                loadType = LoadType::Both;
-                entry.previewRequested = true;  // Mark preview as requested too
+        for (size_t i = 0; i < window.size(); ++i) {
+            ImageEntry& entry = entries_[window[i]];
+            entry.rawLastUsed = frame_;
+            if (!entry.rawLoaded || entry.rawWindowed) {
+                requestRaw(window[i], entry, images[window[i]].string(), profile,
+                           i == 0 ? LoadPriority::Interactive : LoadPriority::Normal, false, true);
             }
+        }
+    }
+
+    // Use a JPEG shot alongside the raw (RAW+JPEG) for this image's previews
+    // Set once after scanning, before any loads are requested
+    void setSidecarPath(size_t imageIndex, const std::string& sidecarPath) {
+        entries_[imageIndex].sidecarPath = sidecarPath;
+    }
+
+    // Drop everything loaded and measured for an image whose file changed on disk, so it's
+    // loaded and measured again from the new file. Loads already queued for the old file still
+    // run, but their results are dropped by update().
+    void invalidate(size_t imageIndex, const std::string& imagePath) {
+        auto it = entries_.find(imageIndex);
+        if (it == entries_.end()) {
+            return;
+        }
+        ImageEntry& entry = it->second;
+        ++entry.generation;
+        for (int lod = 0; lod < kPreviewLods; ++lod) {
+            setLodTexture(static_cast<ImageLod>(lod), entry.previews[lod].texture, GpuTexture());
+            entry.previews[lod].loaded = false;
+            entry.previews[lod].requested = false;
+            entry.previews[lod].targetSize = 0;
+        }
+        entry.previewOverlays = OverlayTextures();
+        freeRaw(entry);
+        entry.rawRequested = false;
+        entry.rawFailed = false;
+        entry.adjustableUnavailable = false;
+        if (adjustable_ && adjustableIndex_ == imageIndex) {
+            adjustable_.reset();
+        }
+        entry.region = GpuTexture();
+        entry.regionLoaded = false;
+        entry.regionRequested = false;
+        entry.regionUnavailable = false;
+        dropRegionSource(imagePath);
+        entry.stats = ImageStats();
+        if (entry.hashKnown) {
+            similar_.remove(imageIndex);
+            entry.hashKnown = false;
+            ++hashVersion_;
+        }
+        if (entry.sharpnessKnown) {
+            entry.sharpnessKnown = false;
+            --sharpnessCount_;
+            ++sharpnessVersion_;
+        }
+        entry.measureRequested = false;
+        entry.sharpnessUnavailable = false;
+    }
+
+    // Check whether a screen-sized preview load (or upgrade) is queued or in progress for an image
+    bool isPreviewPending(size_t imageIndex) const {
+        auto it = entries_.find(imageIndex);
+        return it != entries_.end() && it->second.previews[static_cast<int>(ImageLod::Screen)].requested;
+    }
+
+    // Check whether a raw develop is queued or in progress for an image
+    bool isRawPending(size_t imageIndex) const {
+        auto it = entries_.find(imageIndex);
+        return it != entries_.end() && it->second.rawRequested;
+    }
+
+    // Check whether the raw couldn't be opened or developed, so it won't be shown
+    bool isRawFailed(size_t imageIndex) const {
+        auto it = entries_.find(imageIndex);
+        return it != entries_.end() && it->second.rawFailed;
+    }
+
+    // Get the profile the loaded raw was developed with. Returns false if no raw is loaded.
+    bool getRawProfile(size_t imageIndex, DevelopProfile& out) const {
+        auto it = entries_.find(imageIndex);
+        if (it == entries_.end() || !it->second.rawLoaded) {
+            return false;
+        }
+        out = it->second.rawProfile;
+        return true;
+    }
 
+    // Linear develop kept for adjusting an image, or nullptr
+    // Only the most recently kept one is held, they are several bytes per pixel
+    std::shared_ptr<const AdjustableImage> getAdjustableImage(size_t imageIndex) const {
+        return adjustableIndex_ == imageIndex ? adjustable_ : nullptr;
+    }
+
+    // Drop the kept linear develop once nothing is adjusting it
+    void releaseAdjustableImage() {
+        adjustable_.reset();
+    }
+
+    // Check whether an image can't be adjusted because its develop can't keep linear data
+    bool isAdjustableUnavailable(size_t imageIndex) const {
+        auto it = entries_.find(imageIndex);
+        return it != entries_.end() && it->second.adjustableUnavailable;
+    }
+
+    // Try to get a full resolution develop of the part of an image on screen, for zooming in
+    // past the preview without developing the whole raw
+    // visibleUv is the part of the (unrotated) image on screen in 0-1 coordinates. Returns the
+    // last region developed for this image and sets regionUv to the part it covers, or nullptr
+    // if there is none yet. A larger region is queued once the view moves outside it.
+    // Regions of the last kKeptRegions images asked for (and of pinned images) are kept, so
+    // images compared side by side each keep theirs.
+    GpuTexture* tryGetRegion(size_t imageIndex, const std::string& imagePath, const SDL_FRect& visibleUv,
+                             DevelopProfile profile, SDL_FRect& regionUv) {
+        ImageEntry& entry = entries_[imageIndex];
+        const float x0 = std::max(0.0f, visibleUv.x), y0 = std::max(0.0f, visibleUv.y);
+        const float x1 = std::min(1.0f, visibleUv.x + visibleUv.w), y1 = std::min(1.0f, visibleUv.y + visibleUv.h);
+        const bool covered = entry.regionLoaded && entry.regionProfile >= profile &&
+            x0 >= entry.regionUv.x && y0 >= entry.regionUv.y &&
+            x1 <= entry.regionUv.x + entry.regionUv.w && y1 <= entry.regionUv.y + entry.regionUv.h;
+
+        // One region per image at a time, grown by a quarter of the view on each side so small
+        // pans stay inside
+        if (!covered && !entry.regionRequested && !entry.regionUnavailable && x1 > x0 && y1 > y0) {
+            entry.regionRequested = true;
+
+            const float marginX = (x1 - x0) * 0.25f, marginY = (y1 - y0) * 0.25f;
             LoadTask task;
             task.imageIndex = imageIndex;
             task.imagePath = imagePath;
-            task.loadType = loadType;
-            taskQueue_.push(std::move(task));
+            task.loadType = LoadType::Region;
+            task.generation = entry.generation;
+            task.profile = profile;
+            task.priority = LoadPriority::Interactive;
+            task.regionUv.x = std::max(0.0f, x0 - marginX);
+            task.regionUv.y = std::max(0.0f, y0 - marginY);
+            task.regionUv.w = std::min(1.0f, x1 + marginX) - task.regionUv.x;
+            task.regionUv.h = std::min(1.0f, y1 + marginY) - task.regionUv.y;
+            enqueue(std::move(task));
         }
 
-        return nullptr;
+        if (!entry.regionLoaded) {
+            return nullptr;
+        }
+        regionUv = entry.regionUv;
+        return &entry.region;
+    }
+
+    // Check whether a region develop is queued or in progress for an image
+    bool isRegionPending(size_t imageIndex) const {
+        auto it = entries_.find(imageIndex);
+        return it != entries_.end() && it->second.regionRequested;
+    }
+
+    // Keep everything loaded for these images (raws, regions) until they are unpinned, for
+    // images compared side by side. Replaces the previous set.
+    void setPinned(const std::vector<size_t>& pinned) {
+        if (pinned != pinned_) {
+            pinned_ = pinned;
+            std::fill(std::begin(stuckBytes_), std::end(stuckBytes_), 0);  // Unpinned textures can go now
+        }
+    }
+
+    // Check whether regions can't be developed for an image, so the whole raw is needed instead
+    bool isRegionUnavailable(size_t imageIndex) const {
+        auto it = entries_.find(imageIndex);
+        return it != entries_.end() && it->second.regionUnavailable;
+    }
+
+    // Histogram and exposure statistics of an image, or nullptr if it hasn't been measured
+    // Measurements from earlier runs are handed in with setMeasurements()
+    const ImageStats* getStats(size_t imageIndex) const {
+        auto it = entries_.find(imageIndex);
+        return it != entries_.end() && it->second.stats.valid() ? &it->second.stats : nullptr;
+    }
+
+    // Take what earlier runs measured of an image, where nothing better is known yet
+    void setMeasurements(size_t imageIndex, const ImageMeasurements& measurements) {
+        if (!measurements.stats.valid() && !measurements.hashKnown && !measurements.sharpnessKnown) {
+            return;
+        }
+        ImageEntry& entry = entries_[imageIndex];
+        if (measurements.stats.pixelCount > entry.stats.pixelCount) {
+            entry.stats = measurements.stats;
+        }
+        if (measurements.hashKnown && !entry.hashKnown) {
+            addHash(imageIndex, entry, measurements.hash);
+        }
+        if (measurements.sharpnessKnown && !entry.sharpnessKnown) {
+            entry.sharpness = measurements.sharpness;
+            entry.sharpnessKnown = true;
+            ++sharpnessCount_;
+            ++sharpnessVersion_;
+        }
+    }
+
+    // Tasks waiting at a priority, to queue background work in bounded batches
+    size_t pendingTasks(LoadPriority priority) const {
+        return taskQueues_[static_cast<int>(priority)].size();
+    }
+
+    // Perceptual hash of an image's preview, or nullptr if it hasn't been hashed yet
+    // Hashes from earlier runs are handed in with setMeasurements()
+    const PerceptualHash* getHash(size_t imageIndex) const {
+        auto it = entries_.find(imageIndex);
+        return it != entries_.end() && it->second.hashKnown ? &it->second.hash : nullptr;
+    }
+
+    // Hashed images within maxDistance of an image as (image index, distance), nearest first,
+    // including the image itself. Empty if the image hasn't been hashed.
+    std::vector<std::pair<size_t, int>> findSimilar(size_t imageIndex, int maxDistance) const {
+        auto it = entries_.find(imageIndex);
+        if (it == entries_.end() || !it->second.hashKnown) {
+            return {};
+        }
+        return similar_.findWithin(it->second.hash, maxDistance);
+    }
+
+    // Number of images with a known hash
+    size_t hashCount() const {
+        return similar_.size();
+    }
+
+    // Changes whenever a hash is added or dropped
+    uint64_t hashVersion() const {
+        return hashVersion_;
+    }
+
+    // Sharpness score of an image, scored from a mid-size preview
+    // Returns false if not known yet. Scores from earlier runs are handed in with setMeasurements().
+    bool getSharpness(size_t imageIndex, float& score) const {
+        auto it = entries_.find(imageIndex);
+        if (it == entries_.end() || !it->second.sharpnessKnown) {
+            return false;
+        }
+        score = it->second.sharpness;
+        return true;
+    }
+
+    // As getSharpness(), queueing a background Measure load if it isn't known
+    bool tryGetSharpness(size_t imageIndex, const std::string& imagePath, float& score) {
+        ImageEntry& entry = entries_[imageIndex];
+        if (!entry.sharpnessKnown && !entry.measureRequested && !entry.sharpnessUnavailable) {
+            entry.measureRequested = true;
+
+            LoadTask task;
+            task.imageIndex = imageIndex;
+            task.imagePath = imagePath;
+            task.sidecarPath = entry.sidecarPath;
+            task.loadType = LoadType::Measure;
+            task.generation = entry.generation;
+            task.previewTargetSize = kSharpnessSize;
+            task.priority = LoadPriority::Background;
+            enqueue(std::move(task));
+        }
+
+        score = entry.sharpness;
+        return entry.sharpnessKnown;
+    }
+
+    // Images whose header has been read into the metadata index since the last call, with the
+    // capture time and camera read, so they needn't be looked up or stat'ed again
+    std::vector<LocatedImage> takeLocatedImages() {
+        std::lock_guard<std::mutex> lock(locatedMutex_);
+        std::vector<LocatedImage> located;
+        located.swap(located_);
+        located.erase(std::remove_if(located.begin(), located.end(),
+                                     [&](const LocatedImage& image) {
+                                         auto it = entries_.find(image.imageIndex);
+                                         return it != entries_.end() && it->second.generation != image.generation;
+                                     }),
+                      located.end());
+        return located;
+    }
+
+    // Number of images with a known sharpness score
+    size_t sharpnessCount() const {
+        return sharpnessCount_;
+    }
+
+    // Changes whenever a sharpness score is added or dropped
+    uint64_t sharpnessVersion() const {
+        return sharpnessVersion_;
+    }
+
+    // Clipping and focus peaking overlays of an image's preview or raw develop, or nullptr if
+    // there are none. They are built once per loaded preview or develop, so showing and hiding
+    // them costs nothing.
+    const OverlayTextures* getOverlays(size_t imageIndex, bool raw) const {
+        auto it = entries_.find(imageIndex);
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+        const OverlayTextures& overlays = raw ? it->second.rawOverlays : it->second.previewOverlays;
+        return overlays.clipping.texture ? &overlays : nullptr;
     }
 
     // Check if both preview and raw are loaded for an image
     bool isFullyLoaded(size_t imageIndex) {
         auto it = entries_.find(imageIndex);
-        return it != entries_.end() && it->second.previewLoaded && it->second.rawLoaded;
+        return it != entries_.end() && it->second.previews[static_cast<int>(ImageLod::Screen)].loaded &&
+               it->second.rawLoaded;
     }
 
     // Request thumbnails for all images in the collection
     // This queues preview-only loads for all images
-    void requestAllThumbnails(const std::vector<fs::path>& images) {
+    void requestAllThumbnails(const std::vector<fs::path>& images, int targetSize) {
+        const ImageLod lod = lodForSize(targetSize);
         for (size_t i = 0; i < images.size(); ++i) {
             // Check if preview already loaded or requested
-            auto it = entries_.find(i);
-            if (it != entries_.end() && (it->second.previewLoaded || it->second.previewRequested)) {
+            PreviewSlot& slot = entries_[i].previews[static_cast<int>(lod)];
+            if (slot.loaded || slot.requested) {
                 continue;  // Already loaded or queued
             }
-
-            // Create entry if needed
-            if (it == entries_.end()) {
-                entries_[i] = ImageEntry();
-            }
-            entries_[i].previewRequested = true;
+            slot.requested = true;
+            slot.targetSize = targetSize;
 
             // Queue preview-only task
             LoadTask task;
             task.imageIndex = i;
             task.imagePath = images[i].string();
+            task.sidecarPath = entries_[i].sidecarPath;
             task.loadType = LoadType::PreviewOnly;
-            taskQueue_.push(std::move(task));
+            task.previewTargetSize = targetSize;
+            task.lod = lod;
+            task.generation = entries_[i].generation;
+            enqueue(std::move(task));
         }
         
         std::cout << "Queued thumbnail loads for " << images.size() << " images" << std::endl;
@@ -222,41 +691,427 @@ public:
     // Update - pull results from queue and create GPU textures
     // Call this from the main thread every frame
     void update() {
+        ++frame_;
         LoadResult result;
         while (resultsQueue_.tryPop(result)) {
             auto& entry = entries_[result.imageIndex];
+            if (result.generation != entry.generation) {
+                continue;  // Loaded from a file that has changed since
+            }
+            if (result.stats.pixelCount > entry.stats.pixelCount) {
+                entry.stats = result.stats;
+            }
+            if (result.hasHash && !entry.hashKnown) {
+                addHash(result.imageIndex, entry, result.hash);
+            }
+            if (result.hasSharpness && !entry.sharpnessKnown) {
+                entry.sharpness = result.sharpness;
+                entry.sharpnessKnown = true;
+                ++sharpnessCount_;
+                ++sharpnessVersion_;
+            }
 
             if (result.type == ImageType::Preview) {
-                entry.preview = GpuTexture(renderer_, result.cpuTexture, result.orientation);
-                entry.previewLoaded = true;
+                PreviewSlot& slot = entry.previews[static_cast<int>(result.lod)];
+                setLodTexture(result.lod, slot.texture, GpuTexture(renderer_, result.cpuTexture, result.orientation));
+                slot.loaded = true;
+                slot.requested = false;
+                slot.lastUsed = frame_;
+                ++previewsLoaded_;
+                PreviewSlot& placeholder = entry.previews[static_cast<int>(ImageLod::Placeholder)];
+                if (result.placeholder.pixels && !placeholder.loaded) {
+                    setLodTexture(ImageLod::Placeholder, placeholder.texture,
+                                  GpuTexture(renderer_, result.placeholder, result.orientation));
+                    placeholder.loaded = true;
+                    placeholder.lastUsed = frame_;
+                }
+                if (result.overlays.clipping.pixels) {
+                    entry.previewOverlays = uploadOverlays(result);
+                }
+            } else if (result.type == ImageType::Dropped) {
+                entry.rawRequested = false;
+            } else if (result.type == ImageType::Failed) {
+                entry.rawRequested = false;
+                entry.rawFailed = true;
+            } else if (result.type == ImageType::Measurement) {
+                entry.measureRequested = false;
+                entry.sharpnessUnavailable = !entry.sharpnessKnown;
+            } else if (result.type == ImageType::Region) {
+                entry.regionRequested = false;
+                if (!result.cpuTexture.pixels) {
+                    entry.regionUnavailable = true;
+                    continue;
+                }
+                entry.region = GpuTexture(renderer_, result.cpuTexture, result.orientation);
+                entry.regionLoaded = true;
+                entry.regionUv = result.regionUv;
+                entry.regionProfile = result.profile;
+                keepRegion(result.imageIndex);
             } else {  // ImageType::Raw
-                entry.raw = GpuTexture(renderer_, result.rawImage, result.orientation);
+                entry.rawRequested = false;
+                if (result.windowed && !isInWindow(result.imageIndex)) {
+                    continue;  // Left the window while it was being developed
+                }
+                setLodTexture(ImageLod::Full, entry.raw,
+                              result.rawImage ? GpuTexture(renderer_, result.rawImage, result.orientation)
+                                              : GpuTexture(renderer_, result.cpuTexture, result.orientation));
                 entry.rawLoaded = true;
+                entry.rawLastUsed = frame_;
+                entry.rawWindowed = result.windowed;
+                entry.rawProfile = result.profile;
+                entry.rawOverlays = uploadOverlays(result);
+                if (result.adjustable) {
+                    adjustable_ = std::move(result.adjustable);
+                    adjustableIndex_ = result.imageIndex;
+                } else if (result.adjustableRequested) {
+                    entry.adjustableUnavailable = true;
+                }
             }
         }
+
+        for (int lod = 0; lod < static_cast<int>(ImageLod::Count); ++lod) {
+            if (lodBytes_[lod] > lodBudgetBytes(static_cast<ImageLod>(lod)) && lodBytes_[lod] != stuckBytes_[lod]) {
+                evictLod(static_cast<ImageLod>(lod));
+            }
+        }
+    }
+
+    // Bytes of textures held for one LOD across every image
+    size_t lodBytes(ImageLod lod) const {
+        return lodBytes_[static_cast<int>(lod)];
+    }
+
+    // Previews of any LOD uploaded since the database was created
+    size_t previewsLoaded() const {
+        return previewsLoaded_;
     }
 
 private:
     SDL_Renderer* renderer_;
+    MetadataIndex& metadataIndex_;
     std::unordered_map<size_t, ImageEntry> entries_;
-    ConcurrentQueue<LoadTask> taskQueue_;
+    uint64_t frame_ = 0;  // Number of update() calls, what lastUsed is measured in
+    size_t lodBytes_[static_cast<int>(ImageLod::Count)] = {};
+    size_t stuckBytes_[static_cast<int>(ImageLod::Count)] = {};  // Over budget with nothing left to evict
+    size_t previewsLoaded_ = 0;
+    ConcurrentQueue<LoadTask> taskQueues_[static_cast<int>(LoadPriority::Count)];
     ConcurrentQueue<LoadResult> resultsQueue_;
     std::vector<std::thread> workerThreads_;
     std::atomic<bool> running_;
+    std::shared_ptr<const AdjustableImage> adjustable_;  // Most recent linear develop kept for adjusting
+    size_t adjustableIndex_ = 0;
+
+    // Images holding a region develop, least recently developed first, and images that keep
+    // theirs whatever else is developed
+    static constexpr size_t kKeptRegions = 4;
+    std::vector<size_t> regionImages_;
+    std::vector<size_t> pinned_;
+
+    // Sensor data of the images regions were last developed from, so each pan only demosaics.
+    // DNGs keep the file and decode just the tiles under a region; anything else keeps LibRaw
+    // with the raw unpacked, since LibRaw can only unpack a whole image. One is kept per image
+    // being compared, and each has its own lock so the panes develop in parallel.
+    struct RegionSource {
+        std::mutex mutex;
+        std::string path;
+        bool opened = false;
+        std::vector<unsigned char> dngFile;
+        std::unique_ptr<LibRaw> rawProcessor;
+        CfaImage cfa;  // Sensor data held by rawProcessor
+    };
+    std::mutex regionSourcesMutex_;
+    std::vector<std::shared_ptr<RegionSource>> regionSources_;  // Most recently used first
+
+    // Preview hashes of every image hashed so far, for near-duplicate and burst queries
+    SimilarityIndex similar_;
+    uint64_t hashVersion_ = 0;
+    size_t sharpnessCount_ = 0;
+    uint64_t sharpnessVersion_ = 0;
+
+    std::mutex locatedMutex_;
+    std::vector<LocatedImage> located_;  // Images whose metadata the workers have stored
+
+    // Decode-ahead window, nearest first, and the same images for the workers to check against
+    std::vector<size_t> windowImages_;
+    std::mutex windowMutex_;
+    std::unordered_set<size_t> window_;
+
+    void noteLocated(const LoadTask& task, const FileMetadata& metadata) {
+        LocatedImage located;
+        located.imageIndex = task.imageIndex;
+        located.generation = task.generation;
+        located.fileSize = metadata.fileSize;
+        located.modifiedTime = metadata.modifiedTime;
+        located.captureTime = metadata.captureTime;
+        located.camera = metadata.camera;
+        std::lock_guard<std::mutex> lock(locatedMutex_);
+        located_.push_back(std::move(located));
+    }
+
+    // Queue a develop of the raw unless one of at least the given profile is loaded or queued
+    void requestRaw(size_t imageIndex, ImageEntry& entry, const std::string& imagePath, DevelopProfile profile,
+                    LoadPriority priority, bool keepLinear, bool windowed) {
+        bool goodEnough = entry.rawLoaded && entry.rawProfile >= profile &&
+            (!keepLinear || entry.adjustableUnavailable || (adjustable_ && adjustableIndex_ == imageIndex));
+
+        // Not loaded (or too low quality), queue a load task if not already requested
+        if (!goodEnough && !entry.rawRequested && !entry.rawFailed) {
+            entry.rawRequested = true;
+
+            // Determine load type based on whether preview is already loaded/requested
+            LoadType loadType;
+            PreviewSlot& preview = entry.previews[static_cast<int>(ImageLod::Screen)];
+            if (preview.loaded || preview.requested) {
+                loadType = LoadType::RawOnly;
+            } else {
+                loadType = LoadType::Both;
+                preview.requested = true;  // Mark preview as requested too
+                preview.targetSize = 0;
+            }
+
+            LoadTask task;
+            task.imageIndex = imageIndex;
+            task.imagePath = imagePath;
+            task.sidecarPath = entry.sidecarPath;
+            task.loadType = loadType;
+            task.generation = entry.generation;
+            task.previewTargetSize = 0;
+            task.profile = profile;
+            task.priority = priority;
+            // A first develop may be downgraded to get something on screen; re-develops may not,
+            // otherwise a busy queue would keep producing the same fast result. The window is
+            // there to have the final develop ready, so it never is.
+            task.allowFasterProfile = !entry.rawLoaded && !windowed;
+            task.keepLinear = keepLinear;
+            // Only for images that are or are about to be viewed
+            task.computeOverlays = priority == LoadPriority::Interactive || windowed;
+            task.windowed = windowed;
+            enqueue(std::move(task));
+        }
+    }
+
+    bool isPinned(size_t imageIndex) const {
+        return std::find(pinned_.begin(), pinned_.end(), imageIndex) != pinned_.end();
+    }
+
+    // Note a newly developed region and free the oldest ones over kKeptRegions, except pinned
+    void keepRegion(size_t imageIndex) {
+        regionImages_.erase(std::remove(regionImages_.begin(), regionImages_.end(), imageIndex), regionImages_.end());
+        regionImages_.push_back(imageIndex);
+        for (size_t i = 0; i < regionImages_.size() && regionImages_.size() > kKeptRegions;) {
+            if (isPinned(regionImages_[i]) || regionImages_[i] == imageIndex) {
+                ++i;
+                continue;
+            }
+            ImageEntry& old = entries_[regionImages_[i]];
+            old.region = GpuTexture();
+            old.regionLoaded = false;
+            regionImages_.erase(regionImages_.begin() + i);
+        }
+    }
+
+    // Forget the kept sensor data of a file that changed on disk
+    void dropRegionSource(const std::string& imagePath) {
+        std::lock_guard<std::mutex> lock(regionSourcesMutex_);
+        regionSources_.erase(std::remove_if(regionSources_.begin(), regionSources_.end(),
+                                            [&](const auto& source) { return source->path == imagePath; }),
+                             regionSources_.end());
+    }
+
+    // Region source of an image, reusing the kept one if there is one. The least recently used
+    // is dropped once more than kKeptRegions are kept, a worker still using it holds its own
+    // reference.
+    std::shared_ptr<RegionSource> regionSourceFor(const std::string& imagePath) {
+        std::lock_guard<std::mutex> lock(regionSourcesMutex_);
+        auto it = std::find_if(regionSources_.begin(), regionSources_.end(),
+                               [&](const auto& source) { return source->path == imagePath; });
+        std::shared_ptr<RegionSource> source;
+        if (it != regionSources_.end()) {
+            source = *it;
+            regionSources_.erase(it);
+        } else {
+            source = std::make_shared<RegionSource>();
+            source->path = imagePath;
+        }
+        regionSources_.insert(regionSources_.begin(), source);
+        if (regionSources_.size() > kKeptRegions) {
+            regionSources_.pop_back();
+        }
+        return source;
+    }
+
+    static size_t textureBytes(const GpuTexture& texture) {
+        return texture.texture ? static_cast<size_t>(texture.originalWidth) * texture.originalHeight * 4 : 0;
+    }
+
+    // Replace a texture held for a LOD, keeping the LOD's byte count
+    void setLodTexture(ImageLod lod, GpuTexture& held, GpuTexture replacement) {
+        size_t& bytes = lodBytes_[static_cast<int>(lod)];
+        bytes -= textureBytes(held);
+        held = std::move(replacement);
+        bytes += textureBytes(held);
+    }
+
+    // Free the least recently used textures of a LOD until it is back under three quarters of
+    // its budget, so the scan this takes runs once in a while rather than every frame. Anything
+    // used since the last update() (drawn last frame, or asked for by the sidebar this frame),
+    // pinned or in the decode-ahead window is kept. If that alone is over budget, the scan
+    // waits until the LOD's byte count changes.
+    void evictLod(ImageLod lod) {
+        const int index = static_cast<int>(lod);
+        std::vector<std::pair<uint64_t, size_t>> candidates;  // Last used and image
+        for (auto& [imageIndex, entry] : entries_) {
+            const bool loaded = lod == ImageLod::Full ? entry.rawLoaded : entry.previews[index].loaded;
+            const uint64_t lastUsed = lod == ImageLod::Full ? entry.rawLastUsed : entry.previews[index].lastUsed;
+            if (loaded && lastUsed + 1 < frame_ && !isPinned(imageIndex) &&
+                !(lod == ImageLod::Full && isInWindow(imageIndex))) {
+                candidates.emplace_back(lastUsed, imageIndex);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        const size_t target = lodBudgetBytes(lod) / 4 * 3;
+        size_t evicted = 0;
+        for (size_t i = 0; i < candidates.size() && lodBytes_[index] > target; ++i) {
+            ImageEntry& entry = entries_[candidates[i].second];
+            if (lod == ImageLod::Full) {
+                freeRaw(entry);
+            } else {
+                PreviewSlot& slot = entry.previews[index];
+                setLodTexture(lod, slot.texture, GpuTexture());
+                slot.loaded = false;
+                slot.targetSize = 0;
+                if (lod == ImageLod::Screen) {
+                    entry.previewOverlays = OverlayTextures();
+                }
+            }
+            ++evicted;
+        }
+        stuckBytes_[index] = lodBytes_[index] > lodBudgetBytes(lod) ? lodBytes_[index] : 0;
+        if (evicted > 0) {
+            std::cout << "Evicted " << evicted << " " << imageLodName(lod) << ", "
+                      << (lodBytes_[index] >> 20) << " MB left" << std::endl;
+        }
+    }
+
+    // Cut a preview result down to the LOD it was asked for and make its placeholder, after it
+    // has been measured at the size it was decoded at
+    void fitPreviewToLod(const LoadTask& task, LoadResult& result) {
+        result.lod = task.lod;
+        if (result.type != ImageType::Preview || !result.cpuTexture.pixels) {
+            return;
+        }
+        result.placeholder = reduceTexture(result.cpuTexture, lodMaxSize(ImageLod::Placeholder));
+        const int maxSize = lodMaxSize(task.lod);
+        if (maxSize > 0 && std::max(result.cpuTexture.width, result.cpuTexture.height) > maxSize) {
+            CpuTexture reduced = reduceTexture(result.cpuTexture, maxSize);
+            if (reduced.pixels) {
+                result.cpuTexture = std::move(reduced);
+            }
+        }
+    }
+
+    bool isInWindow(size_t imageIndex) {
+        std::lock_guard<std::mutex> lock(windowMutex_);
+        return window_.count(imageIndex) != 0;
+    }
+
+    void freeRaw(ImageEntry& entry) {
+        setLodTexture(ImageLod::Full, entry.raw, GpuTexture());
+        entry.rawOverlays = OverlayTextures();
+        entry.rawLoaded = false;
+        entry.rawWindowed = false;
+    }
+
+    void addHash(size_t imageIndex, ImageEntry& entry, const PerceptualHash& hash) {
+        entry.hash = hash;
+        entry.hashKnown = true;
+        similar_.insert(imageIndex, hash);
+        ++hashVersion_;
+    }
+
+    OverlayTextures uploadOverlays(const LoadResult& result) {
+        OverlayTextures textures;
+        textures.clipping = GpuTexture(renderer_, result.overlays.clipping, result.orientation);
+        textures.peaking = GpuTexture(renderer_, result.overlays.peaking, result.orientation);
+        for (GpuTexture* texture : {&textures.clipping, &textures.peaking}) {
+            if (texture->texture) {
+                SDL_SetTextureBlendMode(texture->texture, SDL_BLENDMODE_BLEND);
+            }
+        }
+        return textures;
+    }
+
+    // Number of waiting Normal priority tasks at which raw develops switch to the fastest profile
+    size_t deepQueueThreshold() const {
+        return std::max<size_t>(4, workerThreads_.size() * 2);
+    }
+
+    void enqueue(LoadTask task) {
+        taskQueues_[static_cast<int>(task.priority)].push(std::move(task));
+    }
+
+    // Pop the next task from the highest priority queue that has one
+    bool tryPopTask(LoadTask& out) {
+        for (auto& queue : taskQueues_) {
+            if (queue.tryPop(out)) {
+                return true;
+            }
+        }
+        return false;
+    }
 
     // Worker thread function
     void workerThreadFunc() {
         while (running_) {
             LoadTask task;
-            if (taskQueue_.tryPop(task)) {
+            if (tryPopTask(task)) {
+                // Skip develops for images the user has already stepped away from. The preview
+                // of a Both load is still wanted for the sidebar.
+                if (task.windowed && !isInWindow(task.imageIndex)) {
+                    LoadResult dropped;
+                    dropped.imageIndex = task.imageIndex;
+                    dropped.type = ImageType::Dropped;
+                    pushResult(task, std::move(dropped));
+                    if (task.loadType != LoadType::Both) {
+                        continue;
+                    }
+                    task.loadType = LoadType::PreviewOnly;
+                    task.windowed = false;
+                }
+
+                if (task.loadType == LoadType::Region) {
+                    loadRegion(task);
+                    continue;
+                }
+
+                // Previews we can locate ourselves (or read from a sidecar) don't need LibRaw at all
+                if ((task.loadType == LoadType::PreviewOnly || task.loadType == LoadType::Both ||
+                     task.loadType == LoadType::Measure) &&
+                    loadPreviewWithoutLibRaw(task)) {
+                    if (task.loadType != LoadType::Both) {
+                        continue;
+                    }
+                    task.loadType = LoadType::RawOnly;
+                }
+
+                // Common DNG layouts are decoded natively, in parallel across their tiles
+                if ((task.loadType == LoadType::RawOnly || task.loadType == LoadType::FallbackThumbnail) &&
+                    developWithoutLibRaw(task)) {
+                    continue;
+                }
+
                 // Initialize and open the raw file
                 auto rawProcessor = initializeRawProcessor(task.imagePath);
                 if (!rawProcessor) {
-                    continue;  // Failed to initialize, skip this task
+                    pushFailedLoad(task);
+                    continue;
                 }
                 
-                if (task.loadType == LoadType::PreviewOnly) {
+                if (task.loadType == LoadType::PreviewOnly || task.loadType == LoadType::Measure) {
                     loadPreview(task, *rawProcessor);
+                } else if (task.loadType == LoadType::FallbackThumbnail) {
+                    loadFallbackThumbnail(task, *rawProcessor);
                 } else if (task.loadType == LoadType::RawOnly) {
                     loadRaw(task, *rawProcessor);
                 } else {  // LoadType::Both
@@ -270,7 +1125,36 @@ private:
         }
     }
 
+    // Push empty results for a task that couldn't be done, so its entry stops waiting on it:
+    // an empty preview (or measurement) like one with nothing embedded, and a failed raw
+    void pushFailedLoad(const LoadTask& task) {
+        if (task.loadType != LoadType::RawOnly) {
+            LoadResult previewResult;
+            previewResult.imageIndex = task.imageIndex;
+            previewResult.type = task.loadType == LoadType::Measure ? ImageType::Measurement : ImageType::Preview;
+            previewResult.lod = task.lod;
+            pushResult(task, std::move(previewResult));
+        }
+        if (task.loadType == LoadType::RawOnly || task.loadType == LoadType::Both) {
+            pushRawFailed(task);
+        }
+    }
+
+    // Results carry the generation of their task, so update() can tell they're for an older file
+    void pushResult(const LoadTask& task, LoadResult result) {
+        result.generation = task.generation;
+        resultsQueue_.push(std::move(result));
+    }
+
+    void pushRawFailed(const LoadTask& task) {
+        LoadResult failed;
+        failed.imageIndex = task.imageIndex;
+        failed.type = ImageType::Failed;
+        pushResult(task, std::move(failed));
+    }
+
     // Initialize and open a raw file with LibRaw
+    // Only parses the file structure; raw data is unpacked by loadRaw when it is needed
     // Returns nullptr on failure
     std::unique_ptr<LibRaw> initializeRawProcessor(const std::string& imagePath) {
         auto startTime = std::chrono::high_resolution_clock::now();
@@ -285,13 +1169,6 @@ private:
             return nullptr;
         }
 
-        // Unpack the raw data
-        ret = rawProcessor->unpack();
-        if (ret != LIBRAW_SUCCESS) {
-            std::cerr << "Error unpacking raw data: " << libraw_strerror(ret) << std::endl;
-            return nullptr;
-        }
-
         auto endTime = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
         
@@ -302,6 +1179,59 @@ private:
         return rawProcessor;
     }
 
+    // Load a preview by reading only its byte range, located from an earlier load or, on the
+    // first visit, by parsing the file header. A sidecar JPEG is used in place of the raw.
+    // Returns false if the format isn't understood (or the location was wrong) and LibRaw is needed
+    bool loadPreviewWithoutLibRaw(const LoadTask& task) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        const bool useSidecar = !task.sidecarPath.empty();
+        const std::string& previewPath = useSidecar ? task.sidecarPath : task.imagePath;
+
+        FileMetadata metadata;
+        uint64_t fileSize;
+        int64_t modifiedTime;
+        if (!statFile(previewPath, fileSize, modifiedTime)) {
+            return false;
+        }
+
+        const char* source = useSidecar ? "sidecar, cached location" : "cached location";
+        if (!metadataIndex_.lookup(previewPath, fileSize, modifiedTime, metadata)) {
+            if (!locatePreviewsFromHeader(previewPath, fileSize, metadata)) {
+                return false;
+            }
+            metadata.fileSize = fileSize;
+            metadata.modifiedTime = modifiedTime;
+            metadataIndex_.store(previewPath, metadata);
+            noteLocated(task, metadata);
+            source = useSidecar ? "sidecar, header" : "header";
+        }
+        if (metadata.previews.empty()) {
+            return false;
+        }
+
+        LoadResult previewResult;
+        previewResult.imageIndex = task.imageIndex;
+        previewResult.type = task.loadType == LoadType::Measure ? ImageType::Measurement : ImageType::Preview;
+        previewResult.cpuTexture = loadPreviewFromLocations(previewPath, metadata, task.previewTargetSize,
+                                                            task.priority == LoadPriority::Interactive);
+        previewResult.orientation = metadata.orientation;
+        if (!previewResult.cpuTexture.pixels) {
+            return false;
+        }
+        measureResult(task, previewResult);
+        fitPreviewToLod(task, previewResult);
+        pushResult(task, std::move(previewResult));
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+
+        // Extract just the filename
+        fs::path path(previewPath);
+        std::cout << "Loaded preview (" << source << "): " << path.filename().string() << " in " << duration.count() << " ms" << std::endl;
+        return true;
+    }
+
     // Load the preview/thumbnail for an image
     void loadPreview(const LoadTask& task, LibRaw& rawProcessor) {
         auto startTime = std::chrono::high_resolution_clock::now();
@@ -309,13 +1239,40 @@ private:
         // Get orientation
         int orientation = rawProcessor.imgdata.sizes.flip;
 
-        // Load and push preview
+        // Remember where the previews are so the next load can skip LibRaw
+        FileMetadata metadata;
+        if (statFile(task.imagePath, metadata.fileSize, metadata.modifiedTime)) {
+            collectPreviewLocations(rawProcessor, metadata);
+            noteLocated(task, metadata);
+            metadataIndex_.store(task.imagePath, std::move(metadata));
+        }
+
+        // Load preview
         LoadResult previewResult;
         previewResult.imageIndex = task.imageIndex;
-        previewResult.type = ImageType::Preview;
-        previewResult.cpuTexture = loadJpegPreview(rawProcessor);
+        previewResult.type = task.loadType == LoadType::Measure ? ImageType::Measurement : ImageType::Preview;
+        previewResult.cpuTexture = loadEmbeddedPreview(rawProcessor, task.previewTargetSize,
+                                                       task.priority == LoadPriority::Interactive);
         previewResult.orientation = orientation;
-        resultsQueue_.push(std::move(previewResult));
+
+        // Nothing to score, the empty result tells the entry to stop asking
+        if (!previewResult.cpuTexture.pixels && task.loadType == LoadType::Measure) {
+            pushResult(task, std::move(previewResult));
+            return;
+        }
+
+        // Nothing usable embedded - develop one from the sensor data once the queue is quiet
+        if (!previewResult.cpuTexture.pixels) {
+            LoadTask fallbackTask = task;
+            fallbackTask.loadType = LoadType::FallbackThumbnail;
+            fallbackTask.priority = LoadPriority::Background;
+            enqueue(std::move(fallbackTask));
+            return;
+        }
+
+        measureResult(task, previewResult);
+        fitPreviewToLod(task, previewResult);
+        pushResult(task, std::move(previewResult));
         
         auto endTime = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
@@ -325,45 +1282,308 @@ private:
         std::cout << "Loaded preview: " << path.filename().string() << " in " << duration.count() << " ms" << std::endl;
     }
 
-    // Load the full raw image
-    void loadRaw(const LoadTask& task, LibRaw& rawProcessor) {
+    // Develop a thumbnail from the sensor data for files without a usable embedded preview
+    void loadFallbackThumbnail(const LoadTask& task, LibRaw& rawProcessor) {
         auto startTime = std::chrono::high_resolution_clock::now();
-        
-        // Configure processing parameters for better color accuracy
-        rawProcessor.imgdata.params.use_camera_wb = 1;
-        rawProcessor.imgdata.params.output_color = 1;
-        rawProcessor.imgdata.params.gamm[0] = 1.0/2.4;
-        rawProcessor.imgdata.params.gamm[1] = 12.92;
-        rawProcessor.imgdata.params.user_qual = 3;
-        rawProcessor.imgdata.params.no_auto_bright = 0;
-
-        // Process the image
-        int ret = rawProcessor.dcraw_process();
+
+        int ret = rawProcessor.unpack();
         if (ret != LIBRAW_SUCCESS) {
-            std::cerr << "Error processing raw data: " << libraw_strerror(ret) << std::endl;
-            return;
+            std::cerr << "Error unpacking raw data: " << libraw_strerror(ret) << std::endl;
         }
 
-        // Get processed image
-        libraw_processed_image_t* image = rawProcessor.dcraw_make_mem_image(&ret);
-        if (!image) {
-            std::cerr << "Error creating memory image: " << libraw_strerror(ret) << std::endl;
+        // Always push a result, even an empty one, so the entry stops waiting on this load
+        LoadResult previewResult;
+        previewResult.imageIndex = task.imageIndex;
+        previewResult.type = ImageType::Preview;
+        if (ret == LIBRAW_SUCCESS) {
+            previewResult.cpuTexture = developSuperpixelThumbnail(cfaImageFromLibRaw(rawProcessor), task.previewTargetSize);
+        }
+        previewResult.orientation = rawProcessor.imgdata.sizes.flip;
+        measureResult(task, previewResult);
+        fitPreviewToLod(task, previewResult);
+        pushResult(task, std::move(previewResult));
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+
+        // Extract just the filename
+        fs::path path(task.imagePath);
+        std::cout << "Developed fallback thumbnail: " << path.filename().string() << " in " << duration.count() << " ms" << std::endl;
+    }
+
+    // Measure a result for the histogram and exposure filters, remembering the measurement
+    // from the most pixels in the metadata index (under the raw's path, even for a sidecar),
+    // hash and score previews, and build overlays if the task asked for them
+    void measureResult(const LoadTask& task, LoadResult& result) {
+        if (result.rawImage) {
+            const libraw_processed_image_t* image = result.rawImage;
+            if (image->type == LIBRAW_IMAGE_BITMAP && image->bits == 8) {
+                result.stats = computeImageStats(image->data, image->width, image->height, image->colors);
+            }
+        } else {
+            const CpuTexture& texture = result.cpuTexture;
+            result.stats = computeImageStats(texture.pixels, texture.width, texture.height, texture.channels);
+        }
+
+        uint64_t fileSize;
+        int64_t modifiedTime;
+        if (result.stats.valid() && statFile(task.imagePath, fileSize, modifiedTime)) {
+            metadataIndex_.storeStats(task.imagePath, fileSize, modifiedTime, result.stats);
+
+            // Hash previews only, so every image is hashed from the same kind of source. The
+            // first hash is kept: it's what earlier queries and groupings were made with.
+            if (result.type == ImageType::Preview || result.type == ImageType::Measurement) {
+                const CpuTexture& texture = result.cpuTexture;
+                if (metadataIndex_.lookupHash(task.imagePath, fileSize, modifiedTime, result.hash)) {
+                    result.hasHash = true;
+                } else if (computePerceptualHash(texture.pixels, texture.width, texture.height, texture.channels, result.hash)) {
+                    result.hasHash = true;
+                    metadataIndex_.storeHash(task.imagePath, fileSize, modifiedTime, result.hash);
+                }
+
+                // Any preview large enough is scored, so viewing an image scores it for free
+                if (metadataIndex_.lookupSharpness(task.imagePath, fileSize, modifiedTime, result.sharpness)) {
+                    result.hasSharpness = true;
+                } else if (computeSharpness(texture.pixels, texture.width, texture.height, texture.channels, result.sharpness)) {
+                    result.hasSharpness = true;
+                    metadataIndex_.storeSharpness(task.imagePath, fileSize, modifiedTime, result.sharpness);
+                }
+            }
+        }
+
+        // Overlays from the same pixels, built across the pool as the image is being waited on
+        if (task.computeOverlays) {
+            if (result.rawImage) {
+                const libraw_processed_image_t* image = result.rawImage;
+                if (image->type == LIBRAW_IMAGE_BITMAP && image->bits == 8) {
+                    result.overlays = computeOverlayMasks(image->data, image->width, image->height, image->colors, true);
+                }
+            } else {
+                const CpuTexture& texture = result.cpuTexture;
+                result.overlays = computeOverlayMasks(texture.pixels, texture.width, texture.height, texture.channels, true);
+            }
+        }
+    }
+
+    // Profile to develop a raw task with
+    DevelopProfile chooseDevelopProfile(const LoadTask& task) {
+        // Drop to the fastest profile while the queue is deep so the backlog clears quickly
+        if (task.allowFasterProfile &&
+            taskQueues_[static_cast<int>(LoadPriority::Normal)].size() >= deepQueueThreshold()) {
+            return DevelopProfile::Culling;
+        }
+        return task.profile;
+    }
+
+    // Attach a kept linear develop to a raw result, with the proxy used while adjusting
+    void keepAdjustable(LoadResult& result, std::shared_ptr<AdjustableImage> adjustable, bool requested) {
+        result.adjustableRequested = requested;
+        if (adjustable) {
+            adjustable->orientation = result.orientation;
+            buildAdjustProxy(*adjustable);
+            result.adjustable = std::move(adjustable);
+        }
+    }
+
+    // Decode a DNG without LibRaw and develop it straight from the CFA data
+    // Returns false if the file needs LibRaw.
+    bool developWithoutLibRaw(const LoadTask& task) {
+        const bool isThumbnail = task.loadType == LoadType::FallbackThumbnail;
+        if (!hasDngExtension(task.imagePath)) {
+            return false;
+        }
+        const DevelopProfile profile = chooseDevelopProfile(task);
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        DngImage dng;
+        if (!decodeDngFile(task.imagePath, dng, task.priority == LoadPriority::Interactive)) {
+            return false;
+        }
+        auto decodeTime = std::chrono::high_resolution_clock::now();
+
+        LoadResult result;
+        result.imageIndex = task.imageIndex;
+        result.type = isThumbnail ? ImageType::Preview : ImageType::Raw;
+        result.windowed = task.windowed;
+        std::shared_ptr<AdjustableImage> adjustable;
+        if (isThumbnail) {
+            result.cpuTexture = developSuperpixelThumbnail(dng.cfa, task.previewTargetSize);
+        } else {
+            adjustable = task.keepLinear ? std::make_shared<AdjustableImage>() : nullptr;
+            result.cpuTexture = developCfa(dng.cfa, profile, adjustable ? &adjustable->full : nullptr);
+        }
+        result.orientation = dng.orientation;
+        result.profile = profile;
+        if (!result.cpuTexture.pixels) {
+            return false;
+        }
+        keepAdjustable(result, std::move(adjustable), task.keepLinear);
+        measureResult(task, result);
+        fitPreviewToLod(task, result);
+        pushResult(task, std::move(result));
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto decodeDuration = std::chrono::duration_cast<std::chrono::milliseconds>(decodeTime - startTime);
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+
+        // Extract just the filename
+        fs::path path(task.imagePath);
+        std::cout << (isThumbnail ? "Developed fallback thumbnail" : "Loaded raw (" + std::string(developProfileName(profile)) + ")")
+                  << " natively: "
+                  << path.filename().string() << " in " << duration.count() << " ms (decode "
+                  << decodeDuration.count() << " ms)" << std::endl;
+        return true;
+    }
+
+    // Develop part of a raw at full resolution from the kept sensor data, opening it first if
+    // none is kept for the image. Pushes an empty result if the region can't be developed.
+    void loadRegion(const LoadTask& task) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::shared_ptr<RegionSource> kept = regionSourceFor(task.imagePath);
+        RegionSource& regionSource = *kept;
+        std::lock_guard<std::mutex> lock(regionSource.mutex);
+
+        const char* source = "kept sensor data";
+        if (!regionSource.opened) {
+            regionSource.opened = true;
+            uint64_t fileSize;
+            int64_t modifiedTime;
+            if (hasDngExtension(task.imagePath) && statFile(task.imagePath, fileSize, modifiedTime) &&
+                fileSize <= UINT32_MAX) {
+                readFileRange(task.imagePath, 0, static_cast<uint32_t>(fileSize), regionSource.dngFile);
+            }
+            source = "opened";
+        }
+
+        LoadResult result;
+        result.imageIndex = task.imageIndex;
+        result.type = ImageType::Region;
+        result.profile = task.profile;
+        const DemosaicMethod method = task.profile == DevelopProfile::Final ? DemosaicMethod::GradientCorrected
+                                                                            : DemosaicMethod::Bilinear;
+
+        // DNG: decode only the tiles under the region (with a margin for the demosaic)
+        if (!regionSource.dngFile.empty()) {
+            DngImage dng;
+            if (decodeDng(regionSource.dngFile.data(), regionSource.dngFile.size(), dng, true, &task.regionUv)) {
+                SDL_Rect rect = regionPixels(task.regionUv, dng.activeWidth, dng.activeHeight, 0);
+                result.regionUv = {static_cast<float>(rect.x) / dng.activeWidth, static_cast<float>(rect.y) / dng.activeHeight,
+                                   static_cast<float>(rect.w) / dng.activeWidth, static_cast<float>(rect.h) / dng.activeHeight};
+                rect.x -= dng.regionX;
+                rect.y -= dng.regionY;
+                result.cpuTexture = developRegion(dng.cfa, method, rect);
+                result.orientation = dng.orientation;
+            } else {
+                regionSource.dngFile.clear();  // Not a layout the decoder handles, use LibRaw
+            }
+        }
+
+        // Anything else: unpack the whole raw once, then demosaic regions of it
+        if (regionSource.dngFile.empty()) {
+            if (!regionSource.rawProcessor) {
+                regionSource.rawProcessor = initializeRawProcessor(task.imagePath);
+                if (regionSource.rawProcessor) {
+                    int ret = regionSource.rawProcessor->unpack();
+                    if (ret == LIBRAW_SUCCESS) {
+                        regionSource.cfa = cfaImageFromLibRaw(*regionSource.rawProcessor);
+                    } else {
+                        std::cerr << "Error unpacking raw data: " << libraw_strerror(ret) << std::endl;
+                    }
+                }
+            }
+            const CfaImage& cfa = regionSource.cfa;
+            if (cfa.valid()) {
+                SDL_Rect rect = regionPixels(task.regionUv, cfa.width, cfa.height, 0);
+                result.regionUv = {static_cast<float>(rect.x) / cfa.width, static_cast<float>(rect.y) / cfa.height,
+                                   static_cast<float>(rect.w) / cfa.width, static_cast<float>(rect.h) / cfa.height};
+                result.cpuTexture = developRegion(cfa, method, rect);
+                result.orientation = regionSource.rawProcessor->imgdata.sizes.flip;
+            }
+        }
+
+        const bool developed = result.cpuTexture.pixels != nullptr;
+        const int width = result.cpuTexture.width, height = result.cpuTexture.height;
+        pushResult(task, std::move(result));
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+
+        // Extract just the filename
+        fs::path path(task.imagePath);
+        if (developed) {
+            std::cout << "Developed region " << width << "x" << height << " (" << developProfileName(task.profile)
+                      << ", " << source << "): " << path.filename().string() << " in " << duration.count() << " ms" << std::endl;
+        } else {
+            std::cout << "Can't develop a region of " << path.filename().string() << ", developing the whole raw" << std::endl;
+        }
+    }
+
+    // Load the full raw image
+    void loadRaw(const LoadTask& task, LibRaw& rawProcessor) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        // Unpack the raw data
+        int ret = rawProcessor.unpack();
+        if (ret != LIBRAW_SUCCESS) {
+            std::cerr << "Error unpacking raw data: " << libraw_strerror(ret) << std::endl;
+            pushRawFailed(task);
             return;
         }
 
-        // Push raw result
+        DevelopProfile profile = chooseDevelopProfile(task);
         LoadResult rawResult;
         rawResult.imageIndex = task.imageIndex;
         rawResult.type = ImageType::Raw;
-        rawResult.rawImage = image;  // Transfer ownership
-        rawResult.orientation = 0;  // Orientation is not set for raw images
-        resultsQueue_.push(std::move(rawResult));
+        rawResult.profile = profile;
+        rawResult.windowed = task.windowed;
+
+        // Develop natively across the pool, falling back to dcraw_process() for sensor
+        // layouts the native pipeline doesn't handle
+        const CfaImage cfa = cfaImageFromLibRaw(rawProcessor);
+        const bool native = cfa.valid();
+        if (native) {
+            auto adjustable = task.keepLinear ? std::make_shared<AdjustableImage>() : nullptr;
+            rawResult.cpuTexture = developCfa(cfa, profile, adjustable ? &adjustable->full : nullptr);
+            rawResult.orientation = rawProcessor.imgdata.sizes.flip;
+            if (!rawResult.cpuTexture.pixels) {
+                std::cerr << "Error developing raw data" << std::endl;
+                pushRawFailed(task);
+                return;
+            }
+            keepAdjustable(rawResult, std::move(adjustable), task.keepLinear);
+        } else {
+            applyDevelopProfile(rawProcessor.imgdata.params, profile);
+
+            // Process the image
+            ret = rawProcessor.dcraw_process();
+            if (ret != LIBRAW_SUCCESS) {
+                std::cerr << "Error processing raw data: " << libraw_strerror(ret) << std::endl;
+                pushRawFailed(task);
+                return;
+            }
+
+            // Get processed image
+            libraw_processed_image_t* image = rawProcessor.dcraw_make_mem_image(&ret);
+            if (!image) {
+                std::cerr << "Error creating memory image: " << libraw_strerror(ret) << std::endl;
+                pushRawFailed(task);
+                return;
+            }
+            rawResult.rawImage = image;  // Transfer ownership
+            rawResult.orientation = 0;  // dcraw_process() has already rotated the image
+            rawResult.adjustableRequested = task.keepLinear;  // Reported as unavailable
+        }
+
+        // Push raw result
+        measureResult(task, rawResult);
+        pushResult(task, std::move(rawResult));
         
         auto endTime = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
         
         // Extract just the filename
         fs::path path(task.imagePath);
-        std::cout << "Loaded raw: " << path.filename().string() << " in " << duration.count() << " ms" << std::endl;
+        std::cout << "Loaded raw (" << developProfileName(profile) << (native ? ", native" : ", LibRaw") << "): "
+                  << path.filename().string() << " in " << duration.count() << " ms" << std::endl;
     }
 };
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Histograms and exposure statistics of 8-bit sRGB images, measured by the workers as each
+// preview or develop is produced so the UI never has to walk the pixels
+
+// Summary of one image. Plain data so it can be written to the metadata index as is.
+struct ImageStats {
+    static constexpr int kBins = 64;
+    uint16_t histogram[4][kBins] = {};  // R, G, B, luma; scaled so the fullest bin is 65535
+    float meanLuma = 0.0f;              // 0-1, of the encoded values
+    float clippedFraction = 0.0f;       // Pixels with a channel at the top of the range
+    float crushedFraction = 0.0f;       // Pixels with every channel at the bottom
+    uint32_t pixelCount = 0;            // Pixels measured, 0 if never measured
+
+    bool valid() const { return pixelCount > 0; }
+};
+
+// A pixel is clipped if its brightest channel reaches this, crushed if it doesn't exceed kCrushedLevel
+constexpr uint8_t kClippedLevel = 254;
+constexpr uint8_t kCrushedLevel = 2;
+
+namespace stats_detail {
+
+// Running totals for one image, folded into ImageStats at the end
+// The block path spreads lanes over four sets of counts so runs of the same level (flat sky)
+// don't serialize on one counter
+struct Accumulator {
+    uint32_t counts[4][4][256] = {};  // [set][channel][level]
+    uint64_t lumaSum = 0;
+    uint64_t clipped = 0;
+    uint64_t crushed = 0;
+};
+
+// Rec. 709 weights in 1/256ths, summing to 256 so white stays 255
+inline uint8_t luma(uint8_t r, uint8_t g, uint8_t b) {
+    return static_cast<uint8_t>((54 * r + 183 * g + 19 * b + 128) >> 8);
+}
+
+inline void addScalar(const uint8_t* pixels, size_t count, int channels, Accumulator& acc) {
+    for (size_t i = 0; i < count; ++i, pixels += channels) {
+        const uint8_t r = pixels[0], g = pixels[1], b = pixels[2];
+        const uint8_t y = luma(r, g, b);
+        const uint8_t brightest = std::max({r, g, b});
+        acc.counts[0][0][r]++;
+        acc.counts[0][1][g]++;
+        acc.counts[0][2][b]++;
+        acc.counts[0][3][y]++;
+        acc.lumaSum += y;
+        acc.clipped += brightest >= kClippedLevel;
+        acc.crushed += brightest <= kCrushedLevel;
+    }
+}
+
+// Count a block of 16 deinterleaved pixels into the histograms
+inline void countBlock(const uint8_t (&planes)[4][16], Accumulator& acc) {
+    for (int c = 0; c < 4; ++c) {
+        for (int i = 0; i < 16; i += 4) {
+            acc.counts[0][c][planes[c][i]]++;
+            acc.counts[1][c][planes[c][i + 1]]++;
+            acc.counts[2][c][planes[c][i + 2]]++;
+            acc.counts[3][c][planes[c][i + 3]]++;
+        }
+    }
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+// 16 RGB pixels per iteration: deinterleave, then luma and the clip tests on whole vectors
+inline size_t addNeon(const uint8_t* pixels, size_t count, Accumulator& acc) {
+    const uint8x16_t clippedLevel = vdupq_n_u8(kClippedLevel);
+    const uint8x16_t crushedLevel = vdupq_n_u8(kCrushedLevel);
+    uint8_t planes[4][16];
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(pixels + i * 3);
+        uint16x8_t yLow = vmull_u8(vget_low_u8(rgb.val[0]), vdup_n_u8(54));
+        uint16x8_t yHigh = vmull_u8(vget_high_u8(rgb.val[0]), vdup_n_u8(54));
+        yLow = vmlal_u8(yLow, vget_low_u8(rgb.val[1]), vdup_n_u8(183));
+        yHigh = vmlal_u8(yHigh, vget_high_u8(rgb.val[1]), vdup_n_u8(183));
+        yLow = vmlal_u8(yLow, vget_low_u8(rgb.val[2]), vdup_n_u8(19));
+        yHigh = vmlal_u8(yHigh, vget_high_u8(rgb.val[2]), vdup_n_u8(19));
+        uint8x16_t y = vcombine_u8(vrshrn_n_u16(yLow, 8), vrshrn_n_u16(yHigh, 8));
+
+        uint8x16_t brightest = vmaxq_u8(rgb.val[0], vmaxq_u8(rgb.val[1], rgb.val[2]));
+        // Comparison lanes are 0xFF, so shifting down to 1 and summing counts them
+        acc.clipped += vaddvq_u8(vshrq_n_u8(vcgeq_u8(brightest, clippedLevel), 7));
+        acc.crushed += vaddvq_u8(vshrq_n_u8(vcleq_u8(brightest, crushedLevel), 7));
+        acc.lumaSum += vaddlvq_u8(y);
+
+        vst1q_u8(planes[0], rgb.val[0]);
+        vst1q_u8(planes[1], rgb.val[1]);
+        vst1q_u8(planes[2], rgb.val[2]);
+        vst1q_u8(planes[3], y);
+        countBlock(planes, acc);
+    }
+    return i;
+}
+#elif (defined(__SSE2__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+// Shuffles that pull one channel of 16 RGB pixels out of each of the three 16-byte loads
+struct DeinterleaveMasks {
+    alignas(16) int8_t masks[3][3][16];  // [channel][load][lane], -1 leaves the lane zero
+
+    DeinterleaveMasks() {
+        for (int c = 0; c < 3; ++c) {
+            for (int load = 0; load < 3; ++load) {
+                for (int lane = 0; lane < 16; ++lane) {
+                    const int source = lane * 3 + c;
+                    masks[c][load][lane] = source / 16 == load ? static_cast<int8_t>(source % 16) : -1;
+                }
+            }
+        }
+    }
+};
+
+// 16 RGB pixels per iteration: deinterleave, then luma and the clip tests on whole vectors
+__attribute__((target("ssse3,popcnt"))) inline size_t addSsse3(const uint8_t* pixels, size_t count, Accumulator& acc) {
+    static const DeinterleaveMasks shuffles;
+    __m128i masks[3][3];
+    for (int c = 0; c < 3; ++c) {
+        for (int load = 0; load < 3; ++load) {
+            masks[c][load] = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffles.masks[c][load]));
+        }
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i clippedLevel = _mm_set1_epi8(static_cast<char>(kClippedLevel));
+    const __m128i crushedLevel = _mm_set1_epi8(static_cast<char>(kCrushedLevel));
+    const __m128i weightR = _mm_set1_epi16(54), weightG = _mm_set1_epi16(183), weightB = _mm_set1_epi16(19);
+    const __m128i rounding = _mm_set1_epi16(128);
+    alignas(16) uint8_t planes[4][16];
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i loads[3] = {_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3 + 16)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3 + 32))};
+        __m128i rgb[3];
+        for (int c = 0; c < 3; ++c) {
+            rgb[c] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(loads[0], masks[c][0]),
+                                               _mm_shuffle_epi8(loads[1], masks[c][1])),
+                                  _mm_shuffle_epi8(loads[2], masks[c][2]));
+        }
+
+        auto weighted = [&](bool high) {
+            auto widen = [&](__m128i v) { return high ? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero); };
+            __m128i sum = _mm_add_epi16(_mm_mullo_epi16(widen(rgb[0]), weightR), rounding);
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(widen(rgb[1]), weightG));
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(widen(rgb[2]), weightB));
+            return _mm_srli_epi16(sum, 8);
+        };
+        const __m128i y = _mm_packus_epi16(weighted(false), weighted(true));
+
+        const __m128i brightest = _mm_max_epu8(rgb[0], _mm_max_epu8(rgb[1], rgb[2]));
+        const __m128i clipped = _mm_cmpeq_epi8(_mm_max_epu8(brightest, clippedLevel), brightest);
+        const __m128i crushed = _mm_cmpeq_epi8(_mm_min_epu8(brightest, crushedLevel), brightest);
+        acc.clipped += _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(clipped)));
+        acc.crushed += _mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(crushed)));
+        const __m128i sums = _mm_sad_epu8(y, zero);
+        acc.lumaSum += static_cast<uint64_t>(_mm_cvtsi128_si32(sums)) + _mm_extract_epi16(sums, 4);
+
+        _mm_store_si128(reinterpret_cast<__m128i*>(planes[0]), rgb[0]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(planes[1]), rgb[1]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(planes[2]), rgb[2]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(planes[3]), y);
+        countBlock(planes, acc);
+    }
+    return i;
+}
+
+inline bool cpuHasSsse3Popcnt() {
+    static const bool supported = __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt");
+    return supported;
+}
+#endif
+
+} // namespace stats_detail
+
+// Measure an 8-bit image with 3 or 4 interleaved channels (R, G, B first)
+// RGB rows go through NEON or SSSE3 when available, with results identical to the scalar path.
+inline ImageStats computeImageStats(const uint8_t* pixels, int width, int height, int channels) {
+    ImageStats stats;
+    if (!pixels || width <= 0 || height <= 0 || channels < 3) {
+        return stats;
+    }
+    const size_t count = static_cast<size_t>(width) * height;
+    stats_detail::Accumulator acc;
+
+    size_t done = 0;
+    if (channels == 3) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        done = stats_detail::addNeon(pixels, count, acc);
+#elif (defined(__SSE2__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+        if (stats_detail::cpuHasSsse3Popcnt()) {
+            done = stats_detail::addSsse3(pixels, count, acc);
+        }
+#endif
+    }
+    stats_detail::addScalar(pixels + done * channels, count - done, channels, acc);
+
+    // Fold the 256 levels into the stored bins, scaled to the fullest one
+    uint32_t bins[4][ImageStats::kBins] = {};
+    uint32_t fullest = 1;
+    for (int c = 0; c < 4; ++c) {
+        for (int level = 0; level < 256; ++level) {
+            for (int set = 0; set < 4; ++set) {
+                bins[c][level * ImageStats::kBins / 256] += acc.counts[set][c][level];
+            }
+        }
+        for (int bin = 0; bin < ImageStats::kBins; ++bin) {
+            fullest = std::max(fullest, bins[c][bin]);
+        }
+    }
+    for (int c = 0; c < 4; ++c) {
+        for (int bin = 0; bin < ImageStats::kBins; ++bin) {
+            stats.histogram[c][bin] = static_cast<uint16_t>((static_cast<uint64_t>(bins[c][bin]) * 65535 + fullest / 2) / fullest);
+        }
+    }
+
+    stats.meanLuma = static_cast<float>(static_cast<double>(acc.lumaSum) / (255.0 * count));
+    stats.clippedFraction = static_cast<float>(static_cast<double>(acc.clipped) / count);
+    stats.crushedFraction = static_cast<float>(static_cast<double>(acc.crushed) / count);
+    stats.pixelCount = static_cast<uint32_t>(std::min<size_t>(count, UINT32_MAX));
+    return stats;
+}
+
+// Exposure classes the image list can be filtered on
+enum class ExposureFilter {
+    All,
+    Underexposed,  // Dark on average, or a lot of crushed shadows
+    Clipped,       // Noticeable blown highlights
+    Count
+};
+
+inline const char* exposureFilterName(ExposureFilter filter) {
+    switch (filter) {
+        case ExposureFilter::All: return "All";
+        case ExposureFilter::Underexposed: return "Underexposed";
+        case ExposureFilter::Clipped: return "Clipped";
+        default: return "Unknown";
+    }
+}
+
+inline bool matchesExposureFilter(const ImageStats& stats, ExposureFilter filter) {
+    switch (filter) {
+        case ExposureFilter::Underexposed: return stats.meanLuma < 0.2f || stats.crushedFraction > 0.05f;
+        case ExposureFilter::Clipped: return stats.clippedFraction > 0.01f;
+        default: return true;
+    }
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <vector>
+#include "parallel_for.h"
+#include "raw_header_parser.h"
+#include "texture_types.h"
+
+// DCF limits EXIF thumbnails to 160x120, so only targets up to this size can use them
+constexpr int kExifThumbnailMaxSize = 160;
+
+// Find the thumbnail JPEG nested in the EXIF block of a JPEG
+// offset/length are relative to the start of jpeg; returns false if there is none
+// or it isn't entirely within the buffer
+inline bool findExifThumbnail(const uint8_t* jpeg, size_t size, uint64_t& offset, uint32_t& length) {
+    ByteReader reader(jpeg, size);
+    FileMetadata exif;
+    bool foundOrientation = false;
+    raw_header_detail::scanJpegExif(reader, 0, size, exif, foundOrientation);
+    for (const PreviewLocation& thumbnail : exif.previews) {
+        if (reader.has(thumbnail.offset, thumbnail.length)) {
+            offset = thumbnail.offset;
+            length = thumbnail.length;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Decode a JPEG to RGB using stb_image (thread-safe)
+inline CpuTexture decodeJpeg(const uint8_t* data, size_t size) {
+    int width, height, channels;
+    unsigned char* pixels = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &channels, 3);
+    if (!pixels) {
+        return CpuTexture();
+    }
+    return CpuTexture(pixels, width, height, 3);
+}
+
+// Decode the EXIF thumbnail nested in a JPEG if it covers targetSize (long edge in pixels)
+// Returns an empty texture if there's no suitable thumbnail
+inline CpuTexture decodeExifThumbnail(const uint8_t* data, size_t size, int targetSize) {
+    uint64_t offset;
+    uint32_t length;
+    if (targetSize <= 0 || targetSize > kExifThumbnailMaxSize || !findExifThumbnail(data, size, offset, length)) {
+        return CpuTexture();
+    }
+
+    uint16_t width, height;
+    ByteReader reader(data, size);
+    if (!jpegDimensions(reader, offset, width, height) || std::max(width, height) < targetSize) {
+        return CpuTexture();
+    }
+    return decodeJpeg(data + offset, length);
+}
+
+// Decode a baseline JPEG across the shared pool by splitting it at restart markers
+// Each group of restart intervals that covers whole MCU rows is turned into a standalone JPEG
+// (same headers, SOF height patched) and decoded independently, then the bands are stitched.
+// Returns an empty texture if the JPEG can't be split (progressive, no restart markers,
+// intervals that never line up with rows, ...) so the caller can decode it normally.
+// Chroma upsampling at band seams uses the band's own edge rows, which is invisible in practice.
+inline CpuTexture decodeJpegParallel(const uint8_t* data, size_t size) {
+    const size_t concurrency = ParallelPool::instance().concurrency();
+    if (concurrency < 2) {
+        return CpuTexture();  // Splitting only adds overhead on a single core
+    }
+
+    ByteReader r(data, size, true);
+    uint16_t marker;
+    if (!r.u16(0, marker) || marker != 0xFFD8) return CpuTexture();
+
+    // Walk the header segments up to the start of scan
+    uint64_t position = 2;
+    uint64_t sofPosition = 0;
+    uint64_t scanDataPosition = 0;
+    uint16_t restartInterval = 0;
+    uint16_t width = 0, height = 0;
+    int maxH = 1, maxV = 1;
+    uint8_t frameComponents = 0;
+    while (scanDataPosition == 0) {
+        uint16_t segmentLength;
+        if (!r.u16(position, marker) || !r.u16(position + 2, segmentLength) || (marker & 0xFF00) != 0xFF00) {
+            return CpuTexture();
+        }
+        if (marker == 0xFFC0 || marker == 0xFFC1) {
+            // Baseline/extended Huffman: precision, height, width, components
+            sofPosition = position;
+            uint8_t componentCount;
+            if (!r.u16(position + 5, height) || !r.u16(position + 7, width) || !r.u8(position + 9, componentCount)) {
+                return CpuTexture();
+            }
+            frameComponents = componentCount;
+            for (uint8_t c = 0; c < componentCount; ++c) {
+                uint8_t sampling;
+                if (!r.u8(position + 11 + c * 3ull, sampling)) return CpuTexture();
+                maxH = std::max(maxH, sampling >> 4);
+                maxV = std::max(maxV, sampling & 15);
+            }
+        } else if (marker >= 0xFFC2 && marker <= 0xFFCF && marker != 0xFFC4 && marker != 0xFFC8 && marker != 0xFFCC) {
+            return CpuTexture();  // Progressive, lossless or arithmetic coded
+        } else if (marker == 0xFFDD) {
+            if (!r.u16(position + 4, restartInterval)) return CpuTexture();
+        } else if (marker == 0xFFDA) {
+            // A single interleaved scan must contain every component
+            uint8_t scanComponents;
+            if (!r.u8(position + 4, scanComponents) || scanComponents != frameComponents) return CpuTexture();
+            scanDataPosition = position + 2 + segmentLength;
+        }
+        position += 2 + segmentLength;
+    }
+    if (sofPosition == 0 || restartInterval == 0 || width == 0 || height == 0 || frameComponents == 0) {
+        return CpuTexture();
+    }
+
+    // Bands must start at the start of a restart interval and of an MCU row
+    const int mcuWidth = 8 * maxH;
+    const int mcuHeight = 8 * maxV;
+    const uint64_t mcusPerRow = (width + mcuWidth - 1) / mcuWidth;
+    const uint64_t mcuRows = (height + mcuHeight - 1) / mcuHeight;
+    const uint64_t alignMcus = std::lcm<uint64_t>(restartInterval, mcusPerRow);
+    const uint64_t alignRows = alignMcus / mcusPerRow;
+    const uint64_t maxBands = mcuRows / alignRows;
+    const uint64_t bandCount = std::min<uint64_t>(maxBands, concurrency * 2);
+    if (bandCount < 2) {
+        return CpuTexture();
+    }
+
+    // Find where every restart interval starts in the entropy coded data
+    std::vector<uint64_t> intervalStarts = {scanDataPosition};
+    uint64_t scanEnd = size;
+    for (uint64_t i = scanDataPosition; i + 1 < size; ++i) {
+        if (data[i] != 0xFF) continue;
+        uint8_t next = data[i + 1];
+        if (next >= 0xD0 && next <= 0xD7) {
+            intervalStarts.push_back(i + 2);
+            i++;
+        } else if (next != 0x00 && next != 0xFF) {
+            scanEnd = i;  // EOI or another marker ends the scan
+            break;
+        }
+    }
+    const uint64_t totalIntervals = (mcusPerRow * mcuRows + restartInterval - 1) / restartInterval;
+    if (intervalStarts.size() != totalIntervals) {
+        return CpuTexture();
+    }
+
+    // Split the aligned row groups evenly between the bands
+    const uint64_t rowGroups = (mcuRows + alignRows - 1) / alignRows;
+    std::vector<uint64_t> bandRows(bandCount + 1);
+    for (uint64_t b = 0; b <= bandCount; ++b) {
+        bandRows[b] = std::min(mcuRows, (rowGroups * b / bandCount) * alignRows);
+    }
+
+    unsigned char* pixels = static_cast<unsigned char*>(malloc(static_cast<size_t>(width) * height * 3));
+    if (!pixels) {
+        return CpuTexture();
+    }
+
+    std::atomic<bool> failed{false};
+    parallelFor(bandCount, [&](size_t band) {
+        const uint64_t firstRow = bandRows[band];
+        const uint64_t lastRow = bandRows[band + 1];
+        const int bandTop = static_cast<int>(firstRow * mcuHeight);
+        const int bandHeight = std::min<int>(height, static_cast<int>(lastRow * mcuHeight)) - bandTop;
+        const uint64_t firstInterval = firstRow * mcusPerRow / restartInterval;
+
+        // Entropy data runs to just before the RST marker that starts the next band
+        const uint64_t dataBegin = intervalStarts[firstInterval];
+        const uint64_t dataEnd = lastRow < mcuRows ? intervalStarts[lastRow * mcusPerRow / restartInterval] - 2 : scanEnd;
+
+        // Standalone JPEG: the original headers with this band's height, its data, then EOI
+        std::vector<uint8_t> bandJpeg;
+        bandJpeg.reserve(scanDataPosition + (dataEnd - dataBegin) + 2);
+        bandJpeg.insert(bandJpeg.end(), data, data + scanDataPosition);
+        bandJpeg[sofPosition + 5] = static_cast<uint8_t>(bandHeight >> 8);
+        bandJpeg[sofPosition + 6] = static_cast<uint8_t>(bandHeight & 0xFF);
+        bandJpeg.insert(bandJpeg.end(), data + dataBegin, data + dataEnd);
+        bandJpeg.push_back(0xFF);
+        bandJpeg.push_back(0xD9);
+
+        CpuTexture decoded = decodeJpeg(bandJpeg.data(), bandJpeg.size());
+        if (decoded.width != width || decoded.height != bandHeight) {
+            failed = true;
+            return;
+        }
+        memcpy(pixels + static_cast<size_t>(bandTop) * width * 3, decoded.pixels,
+               static_cast<size_t>(width) * bandHeight * 3);
+    });
+
+    if (failed) {
+        free(pixels);
+        return CpuTexture();
+    }
+    return CpuTexture(pixels, width, height, 3);
+}
+
+// Decode a JPEG preview for display at targetSize (long edge in pixels, 0 = full size)
+// Small targets use the preview's own EXIF thumbnail when it's big enough, which is
+// hundreds of times cheaper than decoding a full size preview. With allowParallel, large
+// previews that have restart markers are decoded across the shared pool.
+inline CpuTexture decodeJpegPreview(const uint8_t* data, size_t size, int targetSize, bool allowParallel) {
+    CpuTexture thumbnail = decodeExifThumbnail(data, size, targetSize);
+    if (thumbnail.pixels) {
+        return thumbnail;
+    }
+    if (allowParallel) {
+        CpuTexture texture = decodeJpegParallel(data, size);
+        if (texture.pixels) {
+            return texture;
+        }
+    }
+    return decodeJpeg(data, size);
+}
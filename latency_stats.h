@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Distribution of recent latencies in milliseconds, for showing percentiles in the UI
+// Only the last kMaxSamples are kept so the numbers follow what the user is doing now.
+class LatencyStats {
+public:
+    static constexpr size_t kMaxSamples = 1024;
+
+    void add(double milliseconds) {
+        if (samples_.size() < kMaxSamples) {
+            samples_.push_back(milliseconds);
+        } else {
+            samples_[next_] = milliseconds;
+        }
+        next_ = (next_ + 1) % kMaxSamples;
+        ++total_;
+        sortedValid_ = false;
+    }
+
+    void clear() {
+        samples_.clear();
+        sorted_.clear();
+        next_ = 0;
+        total_ = 0;
+        sortedValid_ = false;
+    }
+
+    // Samples ever added, including those that have since been dropped
+    size_t total() const {
+        return total_;
+    }
+
+    bool empty() const {
+        return samples_.empty();
+    }
+
+    // Latency below which the given fraction (0-1) of the kept samples fall, 0 if there are none
+    double percentile(double fraction) {
+        if (samples_.empty()) {
+            return 0.0;
+        }
+        if (!sortedValid_) {
+            sorted_ = samples_;
+            std::sort(sorted_.begin(), sorted_.end());
+            sortedValid_ = true;
+        }
+        const double rank = std::clamp(fraction, 0.0, 1.0) * static_cast<double>(sorted_.size() - 1);
+        return sorted_[static_cast<size_t>(rank + 0.5)];
+    }
+
+private:
+    std::vector<double> samples_;
+    std::vector<double> sorted_;  // Copy of samples_ sorted, rebuilt when a percentile is asked for
+    size_t next_ = 0;             // Slot the next sample overwrites once full
+    size_t total_ = 0;
+    bool sortedValid_ = false;
+};
@@ -2,7 +2,13 @@
 #include <filesystem>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <chrono>
+#include <ctime>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <libraw/libraw.h>
 #include <SDL3/SDL.h>
 
@@ -13,31 +19,155 @@
 #include "imgui_impl_sdl3.h"
 #include "imgui_impl_sdlrenderer3.h"
 #include "image_database.h"
+#include "metadata_index.h"
+#include "catalog_view.h"
+#include "catalog_snapshot.h"
+#include "latency_stats.h"
+#include "jpeg_decode.h"
 
 namespace fs = std::filesystem;
 
 struct Vec2 { float x, y; };
 
+// An image found by the background scan, stat'ed there so the catalog needn't touch the disk
+struct ScannedImage {
+    fs::path path;
+    fs::path sidecar;  // Empty if none
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    uint64_t sidecarSize = 0;  // To look up the sidecar's header keys in the metadata index
+    int64_t sidecarModifiedTime = 0;
+    ImageMeasurements measurements;  // From the metadata index, looked up on the scan thread
+};
+
+// A folder as the catalog snapshot has it, so the scan can skip listing it while it's unchanged
+struct KnownFolder {
+    int64_t modifiedTime = 0;
+    uint64_t inode = 0;
+    std::vector<fs::path> subfolders;
+    std::vector<ScannedImage> images;
+};
+
 struct App
 {
-    std::vector<fs::path> images;
-    size_t currentImageIndex = 0;
+    std::vector<fs::path> images;    // Indexed by image ID, never reordered
+    std::vector<fs::path> sidecars;  // JPEG shot alongside each image (RAW+JPEG), empty if none
+    std::vector<std::string> filterNames;  // Per image, its label lowercased for the filter box
+    std::unordered_map<std::string, size_t> imageIds;  // ID of each image's path
+    size_t currentImageIndex = 0;    // ID of the image being viewed
+
+    // Order the sidebar lists images in
+    CatalogView catalog;
+    SortKey sortPrimary = SortKey::CaptureTime;
+    SortKey sortSecondary = SortKey::FileName;
+    bool sortDescending = false;
 
     ImageDatabase* database = nullptr;  // Will be initialized after renderer is created
+    MetadataIndex metadataIndex;        // Outlives the database so it survives folder changes
+    std::string metadataIndexPath;
+    std::shared_future<void> metadataIndexLoaded;  // Loaded off the main thread at startup
+
+    // Folder being scanned on its own thread. Images are handed over a folder at a time and
+    // join the catalog a few times a second, so the window is up and drawing from the start.
+    std::thread scanThread;
+    std::atomic<bool> scanning{false};
+    std::atomic<bool> cancelScan{false};
+    std::atomic<size_t> scanFolders{0};  // Folders listed so far
+    std::atomic<size_t> scanFound{0};    // Images found so far
+    std::mutex scanMutex;
+    std::vector<ScannedImage> scanned;   // Found but not yet in the catalog, under scanMutex
+    uint64_t lastScanDrainNs = 0;
+    std::vector<LocatedImage> locatedImages;  // Header keys read by the workers, not yet in the catalog
+    uint64_t lastRekeyNs = 0;
+    std::atomic<bool> scanComplete{false};  // The scan listed everything, it wasn't cancelled
+    std::vector<CatalogFolder> scannedFolders;  // Every folder the scan went through, once complete
+    bool scanPending = false;                   // Started scan not yet reconciled with the catalog
+
+    // Snapshot of the catalog, saved when a folder is left and listed from when it's opened
+    // again while the scan checks it against the disk
+    std::string catalogRoot;          // Folder or file open, as an absolute path
+    std::vector<CatalogFolder> folders;  // As last completely scanned, saved with the snapshot
+    bool revalidating = false;        // Listed from a snapshot the scan hasn't finished checking
+    std::vector<char> imageSeen;      // Per image, found by the scan
+    std::vector<char> imageMissing;   // Per image, in the snapshot but no longer on disk
+    size_t revalidatedChanged = 0;    // Images the scan found changed since the snapshot
+    float listScrollY = 0.0f;         // Of the sidebar's list, saved with the snapshot
+    float restoreScrollY = -1.0f;     // To scroll the list to once it's laid out, -1 if none
 
     // Zoom and pan state
     float zoom = 1.0f;
     Vec2 pan = {0.0f, 0.0f};
     bool isPanning = false;
     Vec2 lastMouse = {0.0f, 0.0f};
-    bool showPreview = false;
+    bool showPreview = false;  // Never develop the raw, always show the embedded preview
+    bool alwaysRaw = false;    // Develop the raw even when the preview has enough pixels
+    DevelopProfile developProfile = DevelopProfile::Final;
+    bool adjusting = false;     // Keep the linear develop and show it with the adjustment sliders
+    Adjustments adjustments;
+    AdjustedView* adjustedView = nullptr;  // Created once the renderer exists
+    bool showHistogram = false;  // Histogram and exposure statistics over the image
+    bool showClipping = false;   // Blink clipped highlights and crushed shadows
+    bool showPeaking = false;    // Mark in-focus edges
     float sidebarWidth = 250.0f;  // Current sidebar width
     float currentImageAspect = 1.0f;  // Aspect ratio of current image
     
     // Filter state
     char filterText[256] = "";  // ImGui text input buffer
+    ExposureFilter exposureFilter = ExposureFilter::All;
+
+    // Similarity state, from the preview hashes. Both views are rebuilt as hashes arrive.
+    bool groupBursts = false;         // Collapse runs of near-identical frames behind the first
+    size_t similarTo = SIZE_MAX;      // Image whose near duplicates the sidebar lists, if any
+    std::vector<size_t> burstFirst;   // Per image, the first frame of its burst
+    std::vector<int> burstLength;     // Per first frame, the number of frames in its burst
+    std::vector<int> similarDistance; // Per image, distance to similarTo or -1 if not similar
+    uint64_t groupedHashVersion = UINT64_MAX;  // hashVersion() the views were built at
+    size_t groupedSimilarTo = SIZE_MAX;
+    uint64_t groupedCatalogVersion = UINT64_MAX;
+
+    // Culling by sharpness, within the bursts above
+    bool sharpestFirst = false;  // List the frames of each burst sharpest first
+    bool hideSoft = false;       // Hide frames well below the sharpest of their burst
+    std::vector<float> sharpness;           // Per image, score or -1 if not scored yet
+    std::vector<float> burstBestSharpness;  // Per first frame, the best score in its burst
+    std::vector<size_t> listOrder;          // Images in sidebar order
+    uint64_t groupedSharpnessVersion = UINT64_MAX;  // sharpnessVersion() the order was built at
+    bool groupedSharpestFirst = false;
+    uint64_t lastGroupedNs = 0;
+    size_t measureCursor = 0;  // Catalog position the background hashing and scoring has reached
+    uint64_t measureCatalogVersion = UINT64_MAX;
+    uint64_t measureScanDrainNs = 0;
+    bool measureScores = false;
+
+    // Keyboard culling: arrow keys step through the list as filtered, with the raws around the
+    // current image kept developed
+    bool culling = false;
+    std::vector<size_t> visibleList;    // Images the sidebar listed last frame, in order
+    size_t currentListPosition = 0;     // Of the current image in visibleList, if it's there
+    int pendingSteps = 0;               // Arrow presses since the last frame, applied together
+    uint64_t lastStepPressNs = 0;       // SDL timestamp of the last of them
+    bool stepKeyHeld = false;           // An arrow key is auto-repeating
+    bool scrollToCurrent = false;       // Bring the current image into view in the sidebar
+    uint64_t stepStartNs = 0;           // When the step to the current image was pressed, 0 once shown
+    LatencyStats stepLatency;           // Step to the developed image on screen
+    size_t stepsSkipped = 0;            // Steps passed before their image was shown
+
+    // Compare view: images side by side sharing one zoom and pan. The current image is the one
+    // in the active pane, which the sidebar and arrow keys change.
+    std::vector<size_t> compareImages;  // One per pane, empty when not comparing
+    std::vector<float> compareAspects;  // Of what each pane last drew
+    size_t comparePane = 0;             // Active pane
 };
 
+// Decode-ahead window while culling, in list positions around the current image
+constexpr int kCullBehind = 3;
+constexpr int kCullAhead = 5;
+
+constexpr size_t kMaxComparePanes = 4;
+
+// Background loads queued at once for measuring, hashing and scoring, topped up as they finish
+constexpr size_t kBackgroundBatch = 64;
+
 namespace
 {
     App app;
@@ -84,6 +214,19 @@ bool initializeSDL(int width, int height) {
     return true;
 }
 
+// Get the path of a file in the per-user app data directory
+// Returns an empty string if SDL can't provide one
+std::string getPrefFilePath(const char* fileName) {
+    char* prefPath = SDL_GetPrefPath("thomashope", "PhotoBrowser");
+    if (!prefPath) {
+        std::cerr << "SDL_GetPrefPath failed: " << SDL_GetError() << std::endl;
+        return std::string();
+    }
+    std::string path = std::string(prefPath) + fileName;
+    SDL_free(prefPath);
+    return path;
+}
+
 // Calculate destination rectangle thats fits within window while maintaining aspect ratio
 SDL_FRect calculateFitRect(int windowWidth, int windowHeight, float imageAspect) {
     float windowAspect = static_cast<float>(windowWidth) / static_cast<float>(windowHeight);
@@ -149,36 +292,635 @@ Vec2 uvToPixel(Vec2 uv, float viewportWidth, float viewportHeight,
     return pixel;
 }
 
-// Extract JPEG preview from raw file
-CpuTexture loadJpegPreview(LibRaw& rawProcessor) {
-    CpuTexture previewTexture;
-    int ret = rawProcessor.unpack_thumb();
-    if (ret == LIBRAW_SUCCESS) {
-        libraw_processed_image_t* thumb = rawProcessor.dcraw_make_mem_thumb(&ret);
-        if (thumb && thumb->type == LIBRAW_IMAGE_JPEG) {
-            // Decode JPEG using stb_image (thread-safe)
-            int width, height, channels;
-            unsigned char* pixels = stbi_load_from_memory(
-                thumb->data,
-                thumb->data_size,
-                &width,
-                &height,
-                &channels,
-                3  // Force RGB output (3 channels)
-            );
-
-            if (pixels) {
-                previewTexture = CpuTexture(pixels, width, height, 3);
-            } else {
-                std::cerr << "Warning: Failed to decode JPEG preview with stb_image" << std::endl;
-            }
+// Part of a texture drawn at destRect that is inside the viewport, in the texture's own
+// (unrotated) 0-1 coordinates
+SDL_FRect visibleTextureUv(const SDL_FRect& destRect, const SDL_FRect& viewport, int orientation) {
+    // Visible range in display coordinates
+    float u0 = std::clamp((viewport.x - destRect.x) / destRect.w, 0.0f, 1.0f);
+    float u1 = std::clamp((viewport.x + viewport.w - destRect.x) / destRect.w, 0.0f, 1.0f);
+    float v0 = std::clamp((viewport.y - destRect.y) / destRect.h, 0.0f, 1.0f);
+    float v1 = std::clamp((viewport.y + viewport.h - destRect.y) / destRect.h, 0.0f, 1.0f);
+
+    // Undo the rotation GpuTexture::render applies
+    SDL_FRect uv;
+    switch (orientation) {
+        case 3: uv = {1.0f - u1, 1.0f - v1, u1 - u0, v1 - v0}; break;
+        case 5: uv = {1.0f - v1, u0, v1 - v0, u1 - u0}; break;
+        case 6: uv = {v0, 1.0f - u1, v1 - v0, u1 - u0}; break;
+        default: uv = {u0, v0, u1 - u0, v1 - v0}; break;
+    }
+    return uv;
+}
+
+// Rectangle on screen of part of a texture drawn at destRect, given in the texture's own
+// (unrotated) 0-1 coordinates - the inverse of visibleTextureUv()
+SDL_FRect textureUvToDisplayRect(const SDL_FRect& uv, const SDL_FRect& destRect, int orientation) {
+    // Apply the rotation GpuTexture::render applies
+    SDL_FRect display;
+    switch (orientation) {
+        case 3: display = {1.0f - uv.x - uv.w, 1.0f - uv.y - uv.h, uv.w, uv.h}; break;
+        case 5: display = {uv.y, 1.0f - uv.x - uv.w, uv.h, uv.w}; break;
+        case 6: display = {1.0f - uv.y - uv.h, uv.x, uv.h, uv.w}; break;
+        default: display = uv; break;
+    }
+    return SDL_FRect{destRect.x + display.x * destRect.w, destRect.y + display.y * destRect.h,
+                     display.w * destRect.w, display.h * destRect.h};
+}
+
+// Check whether a preview has enough pixels to be drawn at the current zoom without upscaling
+bool previewCoversDisplay(const GpuTexture& preview, float viewportWidth, float viewportHeight, float zoom) {
+    float aspect = static_cast<float>(preview.getWidth()) / static_cast<float>(preview.getHeight());
+    SDL_FRect fitRect = calculateFitRect(viewportWidth, viewportHeight, aspect);
+    return fitRect.w * zoom <= preview.getWidth() && fitRect.h * zoom <= preview.getHeight();
+}
 
-            LibRaw::dcraw_clear_mem(thumb);
+// Draw the RGB and luma histograms of an image with its exposure statistics underneath
+void drawHistogram(const ImageStats& stats, ImVec2 origin, ImVec2 size) {
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    drawList->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(0, 0, 0, 160));
+
+    const float binWidth = size.x / ImageStats::kBins;
+    auto binHeight = [&](int channel, int bin) {
+        return stats.histogram[channel][bin] / 65535.0f * size.y;
+    };
+
+    // Luma as filled bars, the color channels as outlines over it
+    for (int bin = 0; bin < ImageStats::kBins; ++bin) {
+        float x = origin.x + bin * binWidth;
+        drawList->AddRectFilled(ImVec2(x, origin.y + size.y - binHeight(3, bin)),
+                                ImVec2(x + binWidth, origin.y + size.y), IM_COL32(200, 200, 200, 110));
+    }
+    const ImU32 colors[3] = {IM_COL32(255, 70, 70, 220), IM_COL32(70, 255, 70, 220), IM_COL32(90, 130, 255, 220)};
+    for (int channel = 0; channel < 3; ++channel) {
+        ImVec2 points[ImageStats::kBins];
+        for (int bin = 0; bin < ImageStats::kBins; ++bin) {
+            points[bin] = ImVec2(origin.x + (bin + 0.5f) * binWidth, origin.y + size.y - binHeight(channel, bin));
+        }
+        drawList->AddPolyline(points, ImageStats::kBins, colors[channel], ImDrawFlags_None, 1.0f);
+    }
+
+    ImGui::Dummy(size);
+    ImGui::Text("Mean %.0f%%  Clipped %.1f%%  Crushed %.1f%%", stats.meanLuma * 100.0f,
+                stats.clippedFraction * 100.0f, stats.crushedFraction * 100.0f);
+}
+
+// Queue background loads for images not hashed yet, and with needScores not scored yet, a
+// budget at a time. A cursor walks the catalog order so each frame only looks at what it queues,
+// starting over when images join, move or are seen by the scan.
+void queueSimilarityMeasurements(int thumbnailTargetSize, bool needScores, size_t& budget) {
+    const std::vector<uint32_t>& order = app.catalog.order();
+    if (app.measureCatalogVersion != app.catalog.version() || app.measureScanDrainNs != app.lastScanDrainNs ||
+        app.measureScores != needScores) {
+        app.measureCatalogVersion = app.catalog.version();
+        app.measureScanDrainNs = app.lastScanDrainNs;
+        app.measureScores = needScores;
+        app.measureCursor = 0;
+    }
+    for (; app.measureCursor < order.size() && budget > 0; ++app.measureCursor) {
+        const size_t i = order[app.measureCursor];
+        if (!app.imageSeen[i]) {
+            continue;  // The scan hasn't handed over its earlier measurements yet
+        }
+        if (!app.database->getHash(i)) {
+            app.database->tryGetThumbnail(i, app.images[i].string(), thumbnailTargetSize, LoadPriority::Background);
+            budget--;
+        }
+        float score;
+        if (needScores && budget > 0 && !app.database->getSharpness(i, score)) {
+            app.database->tryGetSharpness(i, app.images[i].string(), score);
+            budget--;
+        }
+    }
+}
+
+// Rebuild the burst groups, the similar image list and the sidebar order from the hashes and
+// sharpness scores known so far
+// Frames next to each other in the catalog order within kBurstDistance of the one before them
+// form a burst, so a burst can drift (a pan) as long as each frame is close to the last. Changes
+// to the catalog or the options rebuild at once, hashes and scores arriving a few times a second.
+void updateSimilarityGroups(int thumbnailTargetSize, size_t& backgroundBudget) {
+    const bool needScores = app.sharpestFirst || app.hideSoft;
+    queueSimilarityMeasurements(thumbnailTargetSize, needScores, backgroundBudget);
+
+    const bool layoutChanged = app.groupedSimilarTo != app.similarTo ||
+        app.groupedCatalogVersion != app.catalog.version() || app.groupedSharpestFirst != app.sharpestFirst ||
+        app.burstFirst.size() != app.images.size() ||
+        (app.groupedSharpnessVersion == UINT64_MAX) != !needScores;
+    const bool measurementsChanged = app.groupedHashVersion != app.database->hashVersion() ||
+        app.groupedSharpnessVersion != (needScores ? app.database->sharpnessVersion() : UINT64_MAX);
+    const uint64_t now = SDL_GetTicksNS();
+    if (!layoutChanged && (!measurementsChanged || now - app.lastGroupedNs < 250000000)) {
+        return;
+    }
+    app.lastGroupedNs = now;
+
+    const size_t count = app.images.size();
+    const std::vector<uint32_t>& order = app.catalog.order();
+    app.burstFirst.assign(count, 0);
+    app.burstLength.assign(count, 1);
+    const PerceptualHash* previous = nullptr;
+    for (size_t position = 0; position < count; ++position) {
+        const size_t i = order[position];
+        const PerceptualHash* hash = app.database->getHash(i);
+        if (hash && previous && hashDistance(*hash, *previous) <= kBurstDistance) {
+            app.burstFirst[i] = app.burstFirst[order[position - 1]];
+            app.burstLength[app.burstFirst[i]]++;
         } else {
-            std::cout << "No JPEG preview found in raw file" << std::endl;
+            app.burstFirst[i] = i;
+        }
+        previous = hash;
+    }
+
+    app.similarDistance.assign(count, -1);
+    if (app.similarTo < count) {
+        for (const auto& [index, distance] : app.database->findSimilar(app.similarTo, kSimilarDistance)) {
+            app.similarDistance[index] = distance;
+        }
+    }
+
+    // Scores, and the best one of each burst for hiding soft frames
+    app.sharpness.assign(count, -1.0f);
+    app.burstBestSharpness.assign(count, -1.0f);
+    if (needScores) {
+        for (size_t i = 0; i < count; ++i) {
+            float score;
+            if (app.database->getSharpness(i, score)) {
+                app.sharpness[i] = score;
+                float& best = app.burstBestSharpness[app.burstFirst[i]];
+                best = std::max(best, score);
+            }
+        }
+    }
+
+    // Bursts stay in catalog order, with their frames sharpest first and unscored ones last
+    app.listOrder.assign(order.begin(), order.end());
+    if (app.sharpestFirst) {
+        for (size_t position = 0; position < count; position += app.burstLength[order[position]]) {
+            const size_t length = app.burstLength[order[position]];
+            std::stable_sort(app.listOrder.begin() + position, app.listOrder.begin() + position + length,
+                             [](size_t a, size_t b) { return app.sharpness[a] > app.sharpness[b]; });
+        }
+    }
+
+    app.groupedHashVersion = app.database->hashVersion();
+    app.groupedSimilarTo = app.similarTo;
+    app.groupedSharpnessVersion = needScores ? app.database->sharpnessVersion() : UINT64_MAX;
+    app.groupedSharpestFirst = app.sharpestFirst;
+    app.groupedCatalogVersion = app.catalog.version();
+}
+
+// Whether the current image is at currentListPosition of the list the sidebar last showed
+bool currentListPositionValid() {
+    return app.currentListPosition < app.visibleList.size() &&
+           app.visibleList[app.currentListPosition] == app.currentImageIndex;
+}
+
+// Move the selection by steps through the list the sidebar last showed. Steps pressed within
+// one frame land on one image, so a held key only loads what it passes over once per frame.
+void stepSelection(int steps, uint64_t pressedNs) {
+    if (app.visibleList.empty() || steps == 0) {
+        return;
+    }
+    const ptrdiff_t count = static_cast<ptrdiff_t>(app.visibleList.size());
+    ptrdiff_t position = currentListPositionValid() ? static_cast<ptrdiff_t>(app.currentListPosition)
+                                                    : (steps > 0 ? -1 : count);
+    position = std::clamp<ptrdiff_t>(position + steps, 0, count - 1);
+    const size_t next = app.visibleList[position];
+    app.currentListPosition = static_cast<size_t>(position);
+    if (next == app.currentImageIndex) {
+        return;
+    }
+    if (app.stepStartNs != 0) {
+        ++app.stepsSkipped;
+    }
+    app.currentImageIndex = next;
+    if (!app.compareImages.empty()) {
+        app.compareImages[app.comparePane] = next;  // Keep the zoom to compare the same spot
+    } else {
+        app.zoom = 1.0f;
+        app.pan = {0.0f, 0.0f};
+    }
+    app.scrollToCurrent = true;
+    app.stepStartNs = pressedNs;
+}
+
+// Images to keep developed while culling: the current one, then outwards through the list
+// leaning ahead, since that's the way the user is usually going. Empty when not culling.
+std::vector<size_t> cullingWindow() {
+    std::vector<size_t> window;
+    if (!app.culling || app.images.empty()) {
+        return window;
+    }
+    window.push_back(app.currentImageIndex);
+    if (!currentListPositionValid()) {
+        return window;
+    }
+    const size_t position = app.currentListPosition;
+    for (int distance = 1; distance <= std::max(kCullAhead, kCullBehind); ++distance) {
+        if (distance <= kCullAhead && position + distance < app.visibleList.size()) {
+            window.push_back(app.visibleList[position + distance]);
+        }
+        if (distance <= kCullBehind && position >= static_cast<size_t>(distance)) {
+            window.push_back(app.visibleList[position - distance]);
+        }
+    }
+    return window;
+}
+
+// Culling takes the arrow keys over from ImGui's keyboard navigation
+void setCulling(bool culling) {
+    app.culling = culling;
+    if (culling) {
+        ImGui::GetIO().ConfigFlags &= ~ImGuiConfigFlags_NavEnableKeyboard;
+    } else {
+        ImGui::GetIO().ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
+    }
+    app.stepKeyHeld = false;
+    app.stepStartNs = 0;
+}
+
+// Compare the current image with the ones after it in the list, count images in all, or stop
+// comparing with a count of 0
+void setCompare(size_t count) {
+    app.compareImages.clear();
+    app.comparePane = 0;
+    if (count < 2 || app.images.empty()) {
+        return;
+    }
+    count = std::min(count, kMaxComparePanes);
+    app.compareImages.push_back(app.currentImageIndex);
+    for (size_t position = app.currentListPosition + 1;
+         currentListPositionValid() && position < app.visibleList.size() && app.compareImages.size() < count;
+         ++position) {
+        app.compareImages.push_back(app.visibleList[position]);
+    }
+    if (app.compareImages.size() < 2) {
+        app.compareImages.clear();  // Nothing after it to compare with
+        return;
+    }
+    app.compareAspects.assign(app.compareImages.size(), 1.0f);
+    app.zoom = 1.0f;
+    app.pan = {0.0f, 0.0f};
+}
+
+// Screen rectangle of a compare pane: side by side for 2 or 3 panes, 2x2 for 4
+SDL_FRect comparePaneRect(size_t pane, size_t count, const SDL_FRect& viewport) {
+    const size_t columns = count == 4 ? 2 : count;
+    const size_t rows = (count + columns - 1) / columns;
+    const float width = viewport.w / columns, height = viewport.h / rows;
+    return SDL_FRect{viewport.x + (pane % columns) * width, viewport.y + (pane / columns) * height, width, height};
+}
+
+// Pane of the compare view under a point, or the number of panes if it's outside them all
+size_t comparePaneAt(Vec2 point, const SDL_FRect& viewport) {
+    for (size_t pane = 0; pane < app.compareImages.size(); ++pane) {
+        SDL_FRect rect = comparePaneRect(pane, app.compareImages.size(), viewport);
+        if (point.x >= rect.x && point.x < rect.x + rect.w && point.y >= rect.y && point.y < rect.y + rect.h) {
+            return pane;
+        }
+    }
+    return app.compareImages.size();
+}
+
+// Draw one image of the compare view into its pane with the shared zoom and pan, asking only
+// for what the pane shows: a preview big enough for it, or once zoomed past that, a full
+// resolution region of the part inside it. Returns true once nothing more is being loaded.
+bool drawComparePane(size_t pane, const SDL_FRect& rect) {
+    const size_t imageIndex = app.compareImages[pane];
+    const std::string imagePath = app.images[imageIndex].string();
+
+    int displayLongEdge = static_cast<int>(std::max(rect.w, rect.h) * std::max(1.0f, app.zoom));
+    int previewTargetSize = 512;
+    while (previewTargetSize < displayLongEdge) {
+        previewTargetSize *= 2;
+    }
+    GpuTexture* preview = app.database->tryGetThumbnail(imageIndex, imagePath, previewTargetSize,
+                                                        LoadPriority::Interactive);
+    const bool previewReady = preview && preview->texture;
+
+    bool needRaw;
+    if (app.showPreview) {
+        needRaw = false;
+    } else if (app.alwaysRaw) {
+        needRaw = true;
+    } else if (app.database->isPreviewPending(imageIndex)) {
+        needRaw = false;
+    } else {
+        needRaw = !previewReady || !previewCoversDisplay(*preview, rect.w, rect.h, app.zoom);
+    }
+    DevelopProfile loadedProfile;
+    const bool useRegion = needRaw && previewReady && !app.alwaysRaw &&
+        !app.database->isRegionUnavailable(imageIndex) &&
+        !(app.database->getRawProfile(imageIndex, loadedProfile) && loadedProfile >= app.developProfile);
+    GpuTexture* raw = needRaw && !useRegion
+        ? app.database->tryGetRaw(imageIndex, imagePath, app.developProfile, LoadPriority::Interactive)
+        : nullptr;
+
+    GpuTexture* image = raw && raw->texture ? raw : (previewReady ? preview : nullptr);
+    bool done = image && (!needRaw || useRegion || image == raw) && !app.database->isRawPending(imageIndex);
+    if (image) {
+        app.compareAspects[pane] = static_cast<float>(image->getWidth()) / static_cast<float>(image->getHeight());
+        SDL_FRect destRect = calculateFitRect(static_cast<int>(rect.w), static_cast<int>(rect.h), app.compareAspects[pane]);
+        destRect.w *= app.zoom;
+        destRect.h *= app.zoom;
+        destRect.x = rect.x + (rect.w - destRect.w) / 2.0f + app.pan.x;
+        destRect.y = rect.y + (rect.h - destRect.h) / 2.0f + app.pan.y;
+
+        const SDL_Rect clip = {static_cast<int>(rect.x), static_cast<int>(rect.y),
+                               static_cast<int>(rect.w), static_cast<int>(rect.h)};
+        SDL_SetRenderClipRect(renderer, &clip);
+        image->render(renderer, &destRect);
+
+        const OverlayTextures* overlays = (app.showClipping || app.showPeaking)
+            ? app.database->getOverlays(imageIndex, image == raw)
+            : nullptr;
+        if (overlays && app.showClipping && overlays->clipping.texture) {
+            SDL_SetTextureAlphaMod(overlays->clipping.texture, (SDL_GetTicks() / 500) % 2 ? 255 : 60);
+            overlays->clipping.render(renderer, &destRect);
+        }
+        if (overlays && app.showPeaking && overlays->peaking.texture) {
+            overlays->peaking.render(renderer, &destRect);
+        }
+
+        if (useRegion) {
+            SDL_FRect regionUv;
+            GpuTexture* region = app.database->tryGetRegion(imageIndex, imagePath,
+                visibleTextureUv(destRect, rect, image->orientation), app.developProfile, regionUv);
+            if (region && region->texture) {
+                SDL_FRect regionRect = textureUvToDisplayRect(regionUv, destRect, region->orientation);
+                region->render(renderer, &regionRect);
+            }
+            done = done && !app.database->isRegionPending(imageIndex);
+        }
+        SDL_SetRenderClipRect(renderer, nullptr);
+    }
+
+    // File name in the corner, and a frame around the active pane
+    ImDrawList* drawList = ImGui::GetForegroundDrawList();
+    std::string label = app.images[imageIndex].filename().string();
+    if (!done) {
+        label += " (loading)";
+    }
+    drawList->AddText(ImVec2(rect.x + 8.0f, rect.y + 6.0f), IM_COL32(255, 255, 255, 255), label.c_str());
+    if (pane == app.comparePane) {
+        drawList->AddRect(ImVec2(rect.x + 1.0f, rect.y + 1.0f), ImVec2(rect.x + rect.w - 1.0f, rect.y + rect.h - 1.0f),
+                          IM_COL32(255, 200, 60, 255), 0.0f, 0, 2.0f);
+    }
+    return done;
+}
+
+// Seconds since 1970 of a modification time as the metadata index stores it
+int64_t fileTimeToSeconds(int64_t modifiedTime) {
+    const fs::file_time_type fileTime{fs::file_time_type::duration(modifiedTime)};
+    const auto systemTime = fileTime - fs::file_time_type::clock::now() + std::chrono::system_clock::now();
+    return std::chrono::duration_cast<std::chrono::seconds>(systemTime.time_since_epoch()).count();
+}
+
+// Sort keys of an image: its path, size and modification time, and once its header has been
+// read, the capture time and camera from the metadata index (the raw's, or the sidecar's that
+// its previews come from). Both files were stat'ed by the scan, so nothing touches the disk.
+CatalogKeys catalogKeysFor(size_t id, const ScannedImage& image) {
+    const uint64_t fileSize = image.fileSize;
+    const int64_t modifiedTime = image.modifiedTime;
+    CatalogKeys keys;
+    keys.path = app.images[id].string();
+    keys.name = app.images[id].filename().string();
+    keys.fileSize = fileSize;
+    keys.modifiedTime = modifiedTime;
+    keys.captureTime = fileTimeToSeconds(modifiedTime);
+
+    FileMetadata metadata;
+    bool found = app.metadataIndex.lookup(keys.path, fileSize, modifiedTime, metadata);
+    if (!found && !app.sidecars[id].empty()) {
+        found = app.metadataIndex.lookup(app.sidecars[id].string(), image.sidecarSize, image.sidecarModifiedTime, metadata);
+    }
+    if (found) {
+        keys.camera = metadata.camera;
+        if (metadata.captureTime != 0) {
+            keys.captureTime = metadata.captureTime;
+        }
+    }
+    return keys;
+}
+
+// Pick up capture times and cameras of images whose headers the workers have just read, and
+// re-sort if they or the chosen order changed. Like the scan's images they're applied a few
+// times a second, as each merge into the sorted catalog is a pass over all of it.
+void refreshCatalogKeys() {
+    std::vector<LocatedImage> located = app.database->takeLocatedImages();
+    app.locatedImages.insert(app.locatedImages.end(), std::make_move_iterator(located.begin()),
+                             std::make_move_iterator(located.end()));
+    const uint64_t now = SDL_GetTicksNS();
+    if (!app.locatedImages.empty() && now - app.lastRekeyNs >= 250000000) {
+        app.lastRekeyNs = now;
+        for (LocatedImage& image : app.locatedImages) {
+            const uint32_t id = static_cast<uint32_t>(image.imageIndex);
+            if (id >= app.catalog.size()) {
+                continue;
+            }
+            const CatalogKeys& current = app.catalog.keys(id);
+            const int64_t captureTime = image.captureTime != 0 ? image.captureTime : fileTimeToSeconds(current.modifiedTime);
+            if (captureTime != current.captureTime || image.camera != current.camera) {
+                CatalogKeys keys = current;
+                keys.captureTime = captureTime;
+                keys.camera = std::move(image.camera);
+                app.catalog.setKeys(id, std::move(keys));
+            }
+        }
+        app.locatedImages.clear();
+    }
+    app.catalog.setOrder(app.sortPrimary, app.sortSecondary, app.sortDescending);
+    app.catalog.update();
+}
+
+// Convert a thumbnail unpacked by LibRaw (JPEG or bitmap) into an RGB CpuTexture
+CpuTexture decodeLibRawThumbnail(const libraw_processed_image_t* thumb, int targetSize, bool allowParallel) {
+    if (thumb->type == LIBRAW_IMAGE_JPEG) {
+        CpuTexture texture = decodeJpegPreview(thumb->data, thumb->data_size, targetSize, allowParallel);
+        if (!texture.pixels) {
+            std::cerr << "Warning: Failed to decode JPEG preview with stb_image" << std::endl;
         }
+        return texture;
     }
-    return previewTexture;
+
+    if (thumb->type == LIBRAW_IMAGE_BITMAP) {
+        // Uncompressed preview: 1 or 3 colors, 8 or 16 bits per sample
+        const int width = thumb->width;
+        const int height = thumb->height;
+        const int colors = thumb->colors;
+        const int bytesPerSample = thumb->bits == 16 ? 2 : 1;
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+        if ((colors != 1 && colors != 3) || pixelCount == 0 ||
+            thumb->data_size < pixelCount * colors * bytesPerSample) {
+            std::cerr << "Warning: Unsupported bitmap preview layout" << std::endl;
+            return CpuTexture();
+        }
+
+        // Allocate with malloc so CpuTexture can release it with stbi_image_free
+        unsigned char* pixels = static_cast<unsigned char*>(malloc(pixelCount * 3));
+        if (!pixels) {
+            return CpuTexture();
+        }
+
+        const unsigned char* src8 = thumb->data;
+        const unsigned short* src16 = reinterpret_cast<const unsigned short*>(thumb->data);
+        for (size_t i = 0; i < pixelCount; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                size_t srcIndex = i * colors + (colors == 3 ? c : 0);
+                pixels[i * 3 + c] = bytesPerSample == 2
+                    ? static_cast<unsigned char>(src16[srcIndex] >> 8)
+                    : src8[srcIndex];
+            }
+        }
+        return CpuTexture(pixels, width, height, 3);
+    }
+
+    return CpuTexture();
+}
+
+// Unpack and decode a single thumbnail. Index -1 uses LibRaw's default thumbnail.
+CpuTexture unpackAndDecodeThumbnail(LibRaw& rawProcessor, int thumbIndex, int targetSize, bool allowParallel) {
+    int ret = thumbIndex < 0 ? rawProcessor.unpack_thumb() : rawProcessor.unpack_thumb_ex(thumbIndex);
+    if (ret != LIBRAW_SUCCESS) {
+        return CpuTexture();
+    }
+
+    libraw_processed_image_t* thumb = rawProcessor.dcraw_make_mem_thumb(&ret);
+    if (!thumb) {
+        return CpuTexture();
+    }
+
+    CpuTexture texture = decodeLibRawThumbnail(thumb, targetSize, allowParallel);
+    LibRaw::dcraw_clear_mem(thumb);
+    return texture;
+}
+
+// Order preview candidates by how well they fit targetSize (long edge in pixels, 0 = largest)
+// Candidates that cover targetSize come first smallest first, then those of unknown size (0),
+// then the undersized ones largest first. Returns indices into longEdges.
+std::vector<int> orderPreviewCandidates(const std::vector<int>& longEdges, int targetSize) {
+    auto rank = [targetSize](int longEdge) {
+        if (longEdge == 0) return 1;
+        if (targetSize == 0) return 0;
+        return longEdge >= targetSize ? 0 : 2;
+    };
+
+    std::vector<int> order(longEdges.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<int>(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        int rankA = rank(longEdges[a]);
+        int rankB = rank(longEdges[b]);
+        if (rankA != rankB) return rankA < rankB;
+        bool smallestFirst = rankA == 0 && targetSize != 0;
+        return smallestFirst ? longEdges[a] < longEdges[b] : longEdges[a] > longEdges[b];
+    });
+    return order;
+}
+
+// Extract the embedded preview that best fits targetSize (long edge in pixels, 0 = largest)
+// allowParallel splits a large JPEG decode across all cores, for the image being viewed
+CpuTexture loadEmbeddedPreview(LibRaw& rawProcessor, int targetSize, bool allowParallel) {
+    const libraw_thumbnail_list_t& thumbs = rawProcessor.imgdata.thumbs_list;
+
+    std::vector<int> longEdges;
+    for (int i = 0; i < thumbs.thumbcount && i < LIBRAW_THUMBNAIL_MAXCOUNT; ++i) {
+        const libraw_thumbnail_item_t& item = thumbs.thumblist[i];
+        longEdges.push_back(std::max<int>(item.twidth, item.theight));
+    }
+
+    for (int index : orderPreviewCandidates(longEdges, targetSize)) {
+        CpuTexture texture = unpackAndDecodeThumbnail(rawProcessor, index, targetSize, allowParallel);
+        if (texture.pixels) {
+            return texture;
+        }
+    }
+
+    // Older files or formats without a thumbnail list
+    if (longEdges.empty()) {
+        CpuTexture texture = unpackAndDecodeThumbnail(rawProcessor, -1, targetSize, allowParallel);
+        if (texture.pixels) {
+            return texture;
+        }
+    }
+
+    std::cout << "No usable preview found in raw file" << std::endl;
+    return CpuTexture();
+}
+
+// Record where LibRaw found JPEG previews so later loads can read them without LibRaw
+void collectPreviewLocations(LibRaw& rawProcessor, FileMetadata& metadata) {
+    const libraw_thumbnail_list_t& thumbs = rawProcessor.imgdata.thumbs_list;
+    metadata.orientation = rawProcessor.imgdata.sizes.flip;
+    metadata.previews.clear();
+    for (int i = 0; i < thumbs.thumbcount && i < LIBRAW_THUMBNAIL_MAXCOUNT; ++i) {
+        const libraw_thumbnail_item_t& item = thumbs.thumblist[i];
+        if (item.tformat == LIBRAW_INTERNAL_THUMBNAIL_JPEG && item.toffset > 0 && item.tlength > 0) {
+            PreviewLocation location;
+            location.offset = static_cast<uint64_t>(item.toffset);
+            location.length = item.tlength;
+            location.width = item.twidth;
+            location.height = item.theight;
+            metadata.previews.push_back(location);
+        }
+    }
+
+    // LibRaw gives the capture time through mktime, so turn it back into the camera's clock
+    // to match what the header parser reads
+    metadata.camera = cameraName(rawProcessor.imgdata.idata.make, rawProcessor.imgdata.idata.model);
+    metadata.captureTime = 0;
+    time_t timestamp = rawProcessor.imgdata.other.timestamp;
+    std::tm local = {};
+#ifdef _WIN32
+    bool converted = timestamp > 0 && localtime_s(&local, &timestamp) == 0;
+#else
+    bool converted = timestamp > 0 && localtime_r(&timestamp, &local) != nullptr;
+#endif
+    if (converted) {
+        metadata.captureTime = civilToSeconds(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+                                              local.tm_hour, local.tm_min, local.tm_sec);
+    }
+}
+
+// Decode the best fitting known JPEG preview, reading only its bytes from the file
+// Returns an empty texture if none could be read, e.g. the file changed underneath us
+CpuTexture loadPreviewFromLocations(const std::string& imagePath, const FileMetadata& metadata, int targetSize,
+                                    bool allowParallel) {
+    std::vector<int> longEdges;
+    for (const PreviewLocation& location : metadata.previews) {
+        longEdges.push_back(std::max<int>(location.width, location.height));
+    }
+
+    std::vector<unsigned char> bytes;
+    for (int index : orderPreviewCandidates(longEdges, targetSize)) {
+        const PreviewLocation& location = metadata.previews[index];
+
+        // For small targets the preview's EXIF thumbnail may do, and it sits near the start
+        if (targetSize > 0 && targetSize <= kExifThumbnailMaxSize) {
+            uint32_t prefixLength = std::min<uint32_t>(location.length, kRawHeaderReadSize);
+            if (readFileRange(imagePath, location.offset, prefixLength, bytes)) {
+                CpuTexture thumbnail = decodeExifThumbnail(bytes.data(), bytes.size(), targetSize);
+                if (thumbnail.pixels) {
+                    return thumbnail;
+                }
+            }
+        }
+
+        if (!readFileRange(imagePath, location.offset, location.length, bytes) ||
+            bytes.size() < 2 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+            continue;
+        }
+
+        CpuTexture texture = allowParallel ? decodeJpegParallel(bytes.data(), bytes.size()) : CpuTexture();
+        if (!texture.pixels) {
+            texture = decodeJpeg(bytes.data(), bytes.size());
+        }
+        if (texture.pixels) {
+            return texture;
+        }
+    }
+    return CpuTexture();
 }
 
 // Function to check if a file has a raw image extension
@@ -221,43 +963,429 @@ bool isRawFileExtension(const fs::path& filePath) {
     return std::find(rawExtensions.begin(), rawExtensions.end(), ext) != rawExtensions.end();
 }
 
-int addImagesInDirectory(const std::string& folderPath) {
+// Function to check if a file is a JPEG, which may be the sidecar of a raw shot as RAW+JPEG
+bool isJpegFileExtension(const fs::path& filePath) {
+    if (!fs::is_regular_file(filePath)) {
+        return false;
+    }
+
+    std::string ext = filePath.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    return ext == ".jpg" || ext == ".jpeg";
+}
+
+// Key that matches a raw with its sidecar: same folder and same stem, ignoring case
+std::string sidecarKey(const fs::path& filePath) {
+    std::string stem = filePath.stem().string();
+    std::transform(stem.begin(), stem.end(), stem.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    return (filePath.parent_path() / stem).string();
+}
+
+// List one folder's images, each raw paired with the JPEG that shares its stem (RAW+JPEG
+// shots become one entry that takes its previews from the JPEG) and stat'ed for the catalog.
+// Subfolders are added to folders to be listed after it.
+void scanFolder(const fs::path& folder, std::vector<fs::path>& folders, std::vector<ScannedImage>& found, size_t& paired) {
     std::error_code ec;
+    std::vector<fs::path> raws;
+    std::unordered_map<std::string, fs::path> jpegsByKey;
+    for (fs::directory_iterator it(folder, fs::directory_options::skip_permission_denied, ec), end;
+         !ec && it != end; it.increment(ec)) {
+        std::error_code typeError;
+        if (it->is_directory(typeError) && !it->is_symlink(typeError)) {
+            folders.push_back(it->path());
+        } else if (isRawFileExtension(it->path())) {
+            raws.push_back(it->path());
+        } else if (isJpegFileExtension(it->path())) {
+            jpegsByKey.emplace(sidecarKey(it->path()), it->path());
+        }
+    }
+    if (ec) {
+        std::cerr << "Warning: Error accessing some entries in " << folder << ": " << ec.message() << std::endl;
+    }
+
+    for (fs::path& raw : raws) {
+        ScannedImage image;
+        auto it = jpegsByKey.find(sidecarKey(raw));
+        if (it != jpegsByKey.end()) {
+            image.sidecar = it->second;
+            statFile(image.sidecar.string(), image.sidecarSize, image.sidecarModifiedTime);
+            paired++;
+        }
+        statFile(raw.string(), image.fileSize, image.modifiedTime);
+        image.path = std::move(raw);
+        found.push_back(std::move(image));
+    }
+}
+
+// Hand images to the main thread, once the metadata index their keys are looked up in is loaded
+void publishScanned(std::vector<ScannedImage>& found) {
+    if (found.empty()) {
+        return;
+    }
+    app.scanFound += found.size();
+    if (app.metadataIndexLoaded.valid()) {
+        app.metadataIndexLoaded.wait();
+    }
+    for (ScannedImage& image : found) {
+        const std::string path = image.path.string();
+        ImageMeasurements& measurements = image.measurements;
+        app.metadataIndex.lookupStats(path, image.fileSize, image.modifiedTime, measurements.stats);
+        measurements.hashKnown = app.metadataIndex.lookupHash(path, image.fileSize, image.modifiedTime, measurements.hash);
+        measurements.sharpnessKnown =
+            app.metadataIndex.lookupSharpness(path, image.fileSize, image.modifiedTime, measurements.sharpness);
+    }
+    std::lock_guard<std::mutex> lock(app.scanMutex);
+    app.scanned.insert(app.scanned.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+    found.clear();
+}
+
+// Find the images at path, a folder searched recursively or a single raw. Runs on the scan thread.
+// Folders known from a snapshot whose modification time and inode haven't changed aren't listed
+// again, their images and subfolders are taken from the snapshot.
+void scanPath(const std::string& path, std::unordered_map<std::string, KnownFolder> known) {
+    std::error_code ec;
+    std::vector<ScannedImage> found;
+    std::vector<CatalogFolder> records;
 
     // Start timer
     auto start = std::chrono::high_resolution_clock::now();
 
-    for (const auto& entry : fs::recursive_directory_iterator(folderPath, fs::directory_options::skip_permission_denied, ec)) {
-        if (ec) {
-            std::cerr << "Warning: Error accessing some entries: " << ec.message() << std::endl;
-            ec.clear();
+    if (fs::is_directory(path, ec)) {
+        size_t paired = 0;
+        size_t unchanged = 0;
+        std::vector<fs::path> folders = {path};
+        while (!folders.empty() && !app.cancelScan) {
+            fs::path folder = std::move(folders.back());
+            folders.pop_back();
+
+            // Stat'ed before listing, so a change while it's listed is seen next time
+            CatalogFolder record;
+            record.path = folder.string();
+            const bool stated = statFolder(record.path, record.modifiedTime, record.inode);
+            auto it = known.find(record.path);
+            if (stated && it != known.end() && it->second.modifiedTime == record.modifiedTime &&
+                it->second.inode == record.inode) {
+                KnownFolder& same = it->second;
+                folders.insert(folders.end(), same.subfolders.begin(), same.subfolders.end());
+                found.insert(found.end(), std::make_move_iterator(same.images.begin()),
+                             std::make_move_iterator(same.images.end()));
+                unchanged++;
+            } else {
+                scanFolder(folder, folders, found, paired);
+            }
+            if (stated) {
+                records.push_back(std::move(record));
+            }
+            app.scanFolders++;
+            publishScanned(found);
+        }
+
+        // Stop timer
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+        std::cout << "Contents of: " << path << (app.cancelScan ? " (scan cancelled)" : "") << std::endl;
+        std::cout << "Found " << app.scanFound << " item(s) in " << app.scanFolders << " folder(s) in "
+                  << duration.count() << " ms" << std::endl;
+        std::cout << "Paired " << paired << " item(s) with JPEG sidecars" << std::endl;
+        if (unchanged > 0) {
+            std::cout << "Skipped listing " << unchanged << " unchanged folder(s)" << std::endl;
+        }
+    } else if (fs::is_regular_file(path, ec)) {
+        if (isRawFileExtension(path)) {
+            ScannedImage image;
+            image.path = path;
+            statFile(path, image.fileSize, image.modifiedTime);
+            std::cout << "Loaded single file: " << path << std::endl;
+
+            // Look for a sidecar next to it
+            for (const char* ext : {".jpg", ".JPG", ".jpeg", ".JPEG"}) {
+                fs::path candidate = fs::path(path).replace_extension(ext);
+                if (fs::is_regular_file(candidate, ec)) {
+                    image.sidecar = candidate;
+                    statFile(candidate.string(), image.sidecarSize, image.sidecarModifiedTime);
+                    std::cout << "Paired with JPEG sidecar: " << candidate << std::endl;
+                    break;
+                }
+            }
+            found.push_back(std::move(image));
+            publishScanned(found);
+        } else {
+            std::cerr << "Error: File is not a supported raw image format" << std::endl;
+        }
+    } else {
+        std::cerr << "Error: Path is neither a file nor a directory: " << path << std::endl;
+    }
+    if (!app.cancelScan) {
+        std::lock_guard<std::mutex> lock(app.scanMutex);
+        app.scannedFolders = std::move(records);
+    }
+    app.scanComplete = !app.cancelScan;
+    app.scanning = false;
+}
+
+// Stop the scan if one is running and forget what it found
+void stopScan() {
+    app.cancelScan = true;
+    if (app.scanThread.joinable()) {
+        app.scanThread.join();
+    }
+    app.cancelScan = false;
+    app.scanning = false;
+    app.scanComplete = false;
+    app.scanPending = false;
+    app.scanned.clear();
+    app.scannedFolders.clear();
+    app.scanFolders = 0;
+    app.scanFound = 0;
+}
+
+// Label the sidebar lists an image by, noting a RAW+JPEG pair
+std::string imageLabel(const fs::path& image, const fs::path& sidecar) {
+    std::string label = image.filename().string();
+    if (!sidecar.empty()) {
+        label += " + " + sidecar.extension().string().substr(1);
+    }
+    return label;
+}
+
+std::string filterNameFor(const fs::path& image, const fs::path& sidecar) {
+    std::string name = imageLabel(image, sidecar);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return std::tolower(c); });
+    return name;
+}
+
+// Give an image the next ID. Its catalog keys are added by the caller.
+size_t addImage(fs::path path, fs::path sidecar, std::string filterName) {
+    const size_t id = app.images.size();
+    app.imageIds.emplace(path.string(), id);
+    app.images.push_back(std::move(path));
+    app.sidecars.push_back(std::move(sidecar));
+    app.filterNames.push_back(std::move(filterName));
+    app.imageSeen.push_back(0);
+    app.imageMissing.push_back(0);
+    if (!app.sidecars[id].empty()) {
+        app.database->setSidecarPath(id, app.sidecars[id].string());
+    }
+    return id;
+}
+
+// Add what the scan has found to the catalog. While it runs this happens a few times a second,
+// as each merge into the sorted catalog is a pass over all of it.
+// Images already listed from a snapshot are only updated if they changed on disk.
+void takeScannedImages() {
+    const uint64_t now = SDL_GetTicksNS();
+    if (app.scanning && !app.images.empty() && now - app.lastScanDrainNs < 250000000) {
+        return;
+    }
+    std::vector<ScannedImage> found;
+    {
+        std::lock_guard<std::mutex> lock(app.scanMutex);
+        found.swap(app.scanned);
+    }
+    if (found.empty()) {
+        return;
+    }
+    app.lastScanDrainNs = now;
+    for (ScannedImage& image : found) {
+        auto known = app.imageIds.find(image.path.string());
+        if (known != app.imageIds.end()) {
+            const size_t id = known->second;
+            const CatalogKeys& keys = app.catalog.keys(static_cast<uint32_t>(id));
+            app.imageSeen[id] = 1;
+            const bool fileChanged = keys.fileSize != image.fileSize || keys.modifiedTime != image.modifiedTime;
+            if (fileChanged || app.sidecars[id] != image.sidecar) {
+                // Only what was loaded from a file that changed is thrown away
+                if (fileChanged) {
+                    app.database->invalidate(id, app.images[id].string());
+                }
+                app.sidecars[id] = std::move(image.sidecar);
+                app.filterNames[id] = filterNameFor(app.images[id], app.sidecars[id]);
+                app.database->setSidecarPath(id, app.sidecars[id].string());
+                app.catalog.setKeys(static_cast<uint32_t>(id), catalogKeysFor(id, image));
+                app.revalidatedChanged++;
+            }
+            app.database->setMeasurements(id, image.measurements);
             continue;
         }
+        std::string filterName = filterNameFor(image.path, image.sidecar);
+        const size_t id = addImage(image.path, image.sidecar, std::move(filterName));
+        app.imageSeen[id] = 1;
+        app.database->setMeasurements(id, image.measurements);
+        app.catalog.add(catalogKeysFor(id, image));
+    }
+}
 
-        if(isRawFileExtension(entry.path()))
-            app.images.push_back(entry.path());
+// Once the scan is done and everything it found is in the catalog, keep the folders it went
+// through for the next snapshot and hide what the snapshot listed that it didn't find
+void finishScan() {
+    if (!app.scanPending || app.scanning) {
+        return;
     }
+    std::lock_guard<std::mutex> lock(app.scanMutex);
+    if (!app.scanned.empty()) {
+        return;
+    }
+    app.scanPending = false;
+    const bool revalidating = app.revalidating;
+    app.revalidating = false;
 
-    // Stop timer
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    // An incomplete scan leaves the folders as they were, so what it didn't reach is listed
+    // again next time
+    if (!app.scanComplete) {
+        return;
+    }
+    app.folders = std::move(app.scannedFolders);
+    app.scannedFolders.clear();
+    if (!revalidating) {
+        return;
+    }
+    size_t missing = 0;
+    for (size_t id = 0; id < app.images.size(); ++id) {
+        if (!app.imageSeen[id]) {
+            app.imageMissing[id] = 1;
+            missing++;
+        }
+    }
+    std::cout << "Checked catalog snapshot: " << app.revalidatedChanged << " image(s) changed, "
+              << missing << " missing" << std::endl;
+}
 
-    if (ec) {
-        std::cerr << "Error during directory iteration: " << ec.message() << std::endl;
-        return 1;
+// Path of the snapshot for a root, empty if there's nowhere to keep it
+std::string catalogSnapshotPath(const std::string& root) {
+    return getPrefFilePath(catalogSnapshotFileName(root).c_str());
+}
+
+// List the catalog from a snapshot, with the order, selection and scroll it was saved with
+// Fills known with its folders for the scan that checks it.
+void restoreCatalogSnapshot(const CatalogSnapshot& snapshot, std::unordered_map<std::string, KnownFolder>& known) {
+    auto start = std::chrono::high_resolution_clock::now();
+    const CatalogSnapshotHeader& header = snapshot.header();
+    const size_t count = snapshot.size();
+    std::vector<CatalogKeys> keys(count);
+    app.images.reserve(count);
+    app.sidecars.reserve(count);
+    app.filterNames.reserve(count);
+    app.imageIds.reserve(count);
+    for (size_t id = 0; id < count; ++id) {
+        const CatalogSnapshotImage& image = snapshot.image(id);
+        addImage(fs::path(snapshot.text(image.path)), fs::path(snapshot.text(image.sidecar)),
+                 std::string(snapshot.text(image.filterName)));
+        keys[id].path = app.images[id].string();
+        keys[id].name = app.images[id].filename().string();
+        keys[id].camera = std::string(snapshot.text(image.camera));
+        keys[id].fileSize = image.fileSize;
+        keys[id].captureTime = image.captureTime;
+        keys[id].modifiedTime = image.modifiedTime;
     }
 
-    std::cout << "Contents of: " << folderPath << std::endl;
-    std::cout << "Found " << app.images.size() << " item(s) recursively in " << duration.count() << " ms" << std::endl;
+    const uint32_t* sorted[CatalogSnapshot::kKeyCount];
+    const char* tied[CatalogSnapshot::kKeyCount];
+    for (int key = 0; key < CatalogSnapshot::kKeyCount; ++key) {
+        sorted[key] = snapshot.sorted(key);
+        tied[key] = snapshot.tied(key);
+    }
+    if (!app.catalog.restore(std::move(keys), sorted, tied)) {
+        std::cerr << "Warning: Catalog snapshot's sort orders are damaged, sorting again" << std::endl;
+    }
+    app.sortPrimary = static_cast<SortKey>(header.sortPrimary);
+    app.sortSecondary = static_cast<SortKey>(header.sortSecondary);
+    app.sortDescending = header.sortDescending != 0;
+    app.catalog.setOrder(app.sortPrimary, app.sortSecondary, app.sortDescending);
+    app.catalog.update();
+    if (header.currentImage < count) {
+        app.currentImageIndex = header.currentImage;
+    }
+    app.restoreScrollY = header.scrollY;
+    app.revalidating = true;
+
+    // Each folder with what was in it. Images in folders it doesn't have are found by listing.
+    app.folders.resize(snapshot.folderCount());
+    for (size_t index = 0; index < app.folders.size(); ++index) {
+        const CatalogSnapshotFolder& record = snapshot.folder(index);
+        CatalogFolder& folder = app.folders[index];
+        folder.path = std::string(snapshot.text(record.path));
+        folder.modifiedTime = record.modifiedTime;
+        folder.inode = record.inode;
+        KnownFolder& entry = known[folder.path];
+        entry.modifiedTime = folder.modifiedTime;
+        entry.inode = folder.inode;
+    }
+    for (const CatalogFolder& folder : app.folders) {
+        fs::path path(folder.path);
+        auto parent = known.find(path.parent_path().string());
+        if (parent != known.end() && folder.path != app.catalogRoot) {
+            parent->second.subfolders.push_back(std::move(path));
+        }
+    }
+    for (size_t id = 0; id < count; ++id) {
+        auto folder = known.find(app.images[id].parent_path().string());
+        if (folder != known.end()) {
+            const CatalogKeys& imageKeys = app.catalog.keys(static_cast<uint32_t>(id));
+            ScannedImage image;
+            image.path = app.images[id];
+            image.sidecar = app.sidecars[id];
+            image.fileSize = imageKeys.fileSize;
+            image.modifiedTime = imageKeys.modifiedTime;
+            folder->second.images.push_back(std::move(image));
+        }
+    }
 
-    return 0;
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start);
+    std::cout << "Listed " << count << " image(s) from the catalog snapshot in " << duration.count() << " ms" << std::endl;
+}
+
+// Save the catalog of what's open, leaving out images found missing
+void saveCatalogSnapshot() {
+    if (app.catalogRoot.empty() || app.images.empty()) {
+        return;
+    }
+    const std::string snapshotPath = catalogSnapshotPath(app.catalogRoot);
+    if (snapshotPath.empty()) {
+        return;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    app.catalog.update();
+
+    CatalogSnapshotState state;
+    state.root = app.catalogRoot;
+    state.sortPrimary = app.sortPrimary;
+    state.sortSecondary = app.sortSecondary;
+    state.sortDescending = app.sortDescending;
+    state.currentImage = app.currentImageIndex;
+    state.scrollY = app.listScrollY;
+    std::vector<char> keep(app.images.size());
+    for (size_t id = 0; id < keep.size(); ++id) {
+        keep[id] = !app.imageMissing[id];
+    }
+    if (CatalogSnapshot::write(snapshotPath, state, app.catalog, app.sidecars, app.filterNames, keep, app.folders)) {
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start);
+        std::cout << "Saved catalog snapshot of " << app.images.size() << " image(s) in " << duration.count() << " ms" << std::endl;
+    }
 }
 
 void clearAndRebuildDatabase(const std::string& path) {
     std::error_code ec;
 
+    // A snapshot of the folder lists it before any of its directories are read, the scan
+    // then checks it against the disk
+    saveCatalogSnapshot();
+    fs::path root = fs::absolute(path, ec).lexically_normal();
+    if (ec) {
+        root = path;
+    }
+    if (root.filename().empty() && root.has_parent_path() && root != root.root_path()) {
+        root = root.parent_path();  // Without a trailing separator
+    }
+    CatalogSnapshot snapshot;
+    const std::string snapshotPath = catalogSnapshotPath(root.string());
+    const bool haveSnapshot = !snapshotPath.empty() && snapshot.open(snapshotPath) &&
+                              snapshot.text(snapshot.header().root) == root.string();
+
     // Validate path exists
-    if (!fs::exists(path, ec)) {
+    if (!haveSnapshot && !fs::exists(path, ec)) {
         std::cerr << "Error: Path does not exist: " << path << std::endl;
         if (ec) {
             std::cerr << "Error code: " << ec.message() << std::endl;
@@ -266,40 +1394,71 @@ void clearAndRebuildDatabase(const std::string& path) {
     }
 
     // Clear existing data
+    stopScan();
     app.images.clear();
+    app.sidecars.clear();
+    app.filterNames.clear();
+    app.imageIds.clear();
+    app.imageSeen.clear();
+    app.imageMissing.clear();
+    app.catalog.clear();
+    app.locatedImages.clear();
+    app.catalogRoot = root.string();
+    app.folders.clear();
+    app.revalidating = false;
+    app.revalidatedChanged = 0;
+    app.restoreScrollY = -1.0f;
+    app.visibleList.clear();
+    app.stepStartNs = 0;
+    app.compareImages.clear();
     app.currentImageIndex = 0;
     app.zoom = 1.0f;
     app.pan = {0.0f, 0.0f};
+    app.similarTo = SIZE_MAX;
+    app.groupedHashVersion = UINT64_MAX;
+    app.measureCatalogVersion = UINT64_MAX;
 
     // Recreate the database (this clears all cached data)
     // If database doesn't exist yet (startup), create it
     if (app.database) {
         delete app.database;
     }
-    app.database = new ImageDatabase(renderer);
+    app.database = new ImageDatabase(renderer, app.metadataIndex);
     app.database->start();
 
-    // Rebuild image list
-    if (fs::is_directory(path, ec)) {
-        addImagesInDirectory(path);
-    } else if (fs::is_regular_file(path, ec)) {
-        if (isRawFileExtension(path)) {
-            app.images.push_back(path);
-            std::cout << "Loaded single file: " << path << std::endl;
-        } else {
-            std::cerr << "Error: File is not a supported raw image format" << std::endl;
-        }
-    } else {
-        std::cerr << "Error: Path is neither a file nor a directory: " << path << std::endl;
+    std::unordered_map<std::string, KnownFolder> known;
+    if (haveSnapshot) {
+        restoreCatalogSnapshot(snapshot, known);
     }
+
+    // Rebuild image list in the background, the images join the catalog as they're found. It's
+    // scanned by its absolute path, as the paths the snapshot keeps must not depend on where
+    // the app was started.
+    app.scanning = true;
+    app.scanPending = true;
+    app.scanThread = std::thread(scanPath, app.catalogRoot, std::move(known));
 }
 
 int main(int argc, char* argv[]) {
+    // Startup is timed from here to the first frame and the first thumbnail on screen
+    const auto launchTime = std::chrono::high_resolution_clock::now();
+    bool firstFramePresented = false;
+    bool firstThumbnailPresented = argc < 2;  // Nothing to wait for without a path
+
     const int initialWidth = 1280;
     const int initialHeight = 800;
     if (!initializeSDL(initialWidth, initialHeight)) {
         return 1;
     }
+    app.adjustedView = new AdjustedView(renderer);
+
+    // Load remembered per-file metadata (preview locations etc.) without holding up the first frame
+    app.metadataIndexPath = getPrefFilePath("metadata_index.bin");
+    app.metadataIndexLoaded = std::async(std::launch::async, [] {
+        if (!app.metadataIndexPath.empty()) {
+            app.metadataIndex.load(app.metadataIndexPath);
+        }
+    }).share();
 
     // Load initial images from command line argument if provided
     if (argc >= 2) {
@@ -307,7 +1466,7 @@ int main(int argc, char* argv[]) {
         clearAndRebuildDatabase(path);
     } else {
         // No arguments - start with empty database
-        app.database = new ImageDatabase(renderer);
+        app.database = new ImageDatabase(renderer, app.metadataIndex);
         app.database->start();
         std::cout << "No path provided - drag and drop images or folders to browse" << std::endl;
     }
@@ -316,9 +1475,10 @@ int main(int argc, char* argv[]) {
     bool running = true;
     SDL_Event event;
 
-    if (!app.images.empty()) {
+    if (argc >= 2) {
         std::cout << "\nControls:" << std::endl;
         std::cout << "  Click filename in list to view image" << std::endl;
+        std::cout << "  C - Culling mode, arrow keys step through the list" << std::endl;
         std::cout << "  ESC/Q - Quit" << std::endl;
     }
 
@@ -336,6 +1496,9 @@ int main(int argc, char* argv[]) {
 
         static bool showImGuiDemoWindow = false;
 
+        // Thumbnails uploaded by the last update() are drawn from this frame on
+        const bool thumbnailDrawn = app.database->previewsLoaded() > 0;
+
         while (SDL_PollEvent(&event)) {
             ImGui_ImplSDL3_ProcessEvent(&event);
 
@@ -356,18 +1519,39 @@ int main(int argc, char* argv[]) {
                     running = false;
                 } else if (event.key.key == SDLK_F12) {
                     showImGuiDemoWindow = !showImGuiDemoWindow;
+                } else if (event.key.key == SDLK_C && !ImGui::GetIO().WantTextInput) {
+                    setCulling(!app.culling);
+                } else if (app.culling && !ImGui::GetIO().WantTextInput &&
+                           (event.key.key == SDLK_RIGHT || event.key.key == SDLK_DOWN ||
+                            event.key.key == SDLK_LEFT || event.key.key == SDLK_UP)) {
+                    app.pendingSteps += event.key.key == SDLK_RIGHT || event.key.key == SDLK_DOWN ? 1 : -1;
+                    app.stepKeyHeld = event.key.repeat;
+                    app.lastStepPressNs = event.key.timestamp;
+                }
+            } else if (event.type == SDL_EVENT_KEY_UP) {
+                if (event.key.key == SDLK_RIGHT || event.key.key == SDLK_DOWN ||
+                    event.key.key == SDLK_LEFT || event.key.key == SDLK_UP) {
+                    app.stepKeyHeld = false;
                 }
             } else if (!imgui_wants_mouse && event.type == SDL_EVENT_MOUSE_WHEEL) {
                 // Zoom with scroll wheel, centered on mouse position
                 float mouseX, mouseY;
                 SDL_GetMouseState(&mouseX, &mouseY);
 
+                // Comparing, the zoom centres on the pane under the mouse and applies to them all
+                SDL_FRect pane = {app.sidebarWidth, 0.0f, viewportWidth, viewportHeight};
+                float imageAspect = app.currentImageAspect;
+                const size_t paneIndex = comparePaneAt({mouseX, mouseY}, pane);
+                if (paneIndex < app.compareImages.size()) {
+                    imageAspect = app.compareAspects[paneIndex];
+                    pane = comparePaneRect(paneIndex, app.compareImages.size(), pane);
+                }
+
                 // Convert mouse to viewport coordinates (relative to image area)
-                Vec2 mouseViewport = {mouseX - app.sidebarWidth, mouseY};
+                Vec2 mouseViewport = {mouseX - pane.x, mouseY - pane.y};
 
                 // Get UV coordinates at mouse position with old zoom
-                Vec2 uv = pixelToUv(mouseViewport, viewportWidth, viewportHeight,
-                                   app.currentImageAspect, app.zoom, app.pan);
+                Vec2 uv = pixelToUv(mouseViewport, pane.w, pane.h, imageAspect, app.zoom, app.pan);
 
                 // Apply zoom
                 float oldZoom = app.zoom;
@@ -384,8 +1568,7 @@ int main(int argc, char* argv[]) {
 
                 if (app.zoom != oldZoom) {
                     // Get pixel position where that UV coordinate would be with new zoom
-                    Vec2 newPixel = uvToPixel(uv, viewportWidth, viewportHeight,
-                                             app.currentImageAspect, app.zoom, app.pan);
+                    Vec2 newPixel = uvToPixel(uv, pane.w, pane.h, imageAspect, app.zoom, app.pan);
 
                     // Adjust pan by the difference to keep mouse over same UV point
                     app.pan.x += mouseViewport.x - newPixel.x;
@@ -395,6 +1578,15 @@ int main(int argc, char* argv[]) {
                 if (event.button.button == SDL_BUTTON_LEFT) {
                     app.isPanning = true;
                     app.lastMouse = {event.button.x, event.button.y};
+
+                    // Clicking a compare pane makes it the active one
+                    const size_t pane = comparePaneAt({event.button.x, event.button.y},
+                                                      SDL_FRect{app.sidebarWidth, 0.0f, viewportWidth, viewportHeight});
+                    if (pane < app.compareImages.size()) {
+                        app.comparePane = pane;
+                        app.currentImageIndex = app.compareImages[pane];
+                        app.scrollToCurrent = true;
+                    }
                 }
             } else if (event.type == SDL_EVENT_MOUSE_BUTTON_UP) {
                 if (event.button.button == SDL_BUTTON_LEFT) {
@@ -409,6 +1601,15 @@ int main(int argc, char* argv[]) {
             }
         }
 
+        // Arrow presses this frame take one step, then the develop window follows the new image.
+        // While a key repeats the window stays put, so images flicked past don't queue develops.
+        stepSelection(app.pendingSteps, app.lastStepPressNs);
+        app.pendingSteps = 0;
+        if (!app.stepKeyHeld) {
+            app.database->setDevelopWindow(cullingWindow(), app.images, app.developProfile);
+        }
+        app.database->setPinned(app.compareImages);
+
         if (showImGuiDemoWindow)
             ImGui::ShowDemoWindow(&showImGuiDemoWindow);
 
@@ -426,34 +1627,139 @@ int main(int argc, char* argv[]) {
         // Filter text box at the top (always visible)
         ImGui::SetNextItemWidth(-1);  // Full width
         ImGui::InputTextWithHint("##filter", "Filter...", app.filterText, sizeof(app.filterText));
+
+        // Progress of the startup work still running in the background
+        if (app.metadataIndexLoaded.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ImGui::TextDisabled("Loading metadata index...");
+        }
+        if (app.scanning) {
+            ImGui::TextDisabled("Scanning... %zu found in %zu folders", app.scanFound.load(), app.scanFolders.load());
+        }
         
         // Convert filter text to lowercase for case-insensitive comparison
         std::string filterLower = app.filterText;
         std::transform(filterLower.begin(), filterLower.end(), filterLower.begin(),
                       [](unsigned char c){ return std::tolower(c); });
 
-        // Begin scrollable child window for the image list
-        ImGui::BeginChild("##ImageList", ImVec2(0, 0), false);
+        // Exposure filter, from the statistics measured as each image is loaded
+        ImGui::SetNextItemWidth(-1);
+        if (ImGui::BeginCombo("##ExposureFilter", exposureFilterName(app.exposureFilter))) {
+            for (int i = 0; i < static_cast<int>(ExposureFilter::Count); ++i) {
+                ExposureFilter filter = static_cast<ExposureFilter>(i);
+                if (ImGui::Selectable(exposureFilterName(filter), filter == app.exposureFilter)) {
+                    app.exposureFilter = filter;
+                }
+            }
+            ImGui::EndCombo();
+        }
 
         const float thumbnailHeight = 64.0f;  // Fixed thumbnail height
+        const int thumbnailTargetSize = static_cast<int>(thumbnailHeight * 2.0f);  // Long edge, with headroom for wide images
         const float textHeight = ImGui::GetTextLineHeight();
         const float itemHeight = thumbnailHeight + textHeight + 4.0f;  // Thumbnail + text + padding
 
-        for (size_t i = 0; i < app.images.size(); i++)
+        // Sort order, applied with the catalog's next update
+        auto sortCombo = [](const char* label, SortKey& key) {
+            if (ImGui::BeginCombo(label, sortKeyName(key))) {
+                for (int k = 0; k < static_cast<int>(SortKey::Count); ++k) {
+                    if (ImGui::Selectable(sortKeyName(static_cast<SortKey>(k)), static_cast<SortKey>(k) == key)) {
+                        key = static_cast<SortKey>(k);
+                    }
+                }
+                ImGui::EndCombo();
+            }
+        };
+        sortCombo("Sort by", app.sortPrimary);
+        sortCombo("Then by", app.sortSecondary);
+        ImGui::Checkbox("Descending", &app.sortDescending);
+
+        // Burst grouping and near duplicates of one image, from the hashes of the previews
+        ImGui::Checkbox("Group bursts", &app.groupBursts);
+        if (app.similarTo < app.images.size()) {
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Clear similar")) {
+                app.similarTo = SIZE_MAX;
+            } else {
+                ImGui::TextDisabled("Similar to %s", app.images[app.similarTo].filename().string().c_str());
+            }
+        }
+        ImGui::Checkbox("Sharpest first", &app.sharpestFirst);
+        ImGui::SameLine();
+        ImGui::Checkbox("Hide soft", &app.hideSoft);
+        const bool showingSimilar = app.similarTo < app.images.size();
+        const bool useGroups = app.groupBursts || showingSimilar || app.sharpestFirst || app.hideSoft;
+        size_t backgroundBudget = kBackgroundBatch - std::min(kBackgroundBatch, app.database->pendingTasks(LoadPriority::Background));
+        if (useGroups) {
+            updateSimilarityGroups(thumbnailTargetSize, backgroundBudget);
+        }
+
+        // Begin scrollable child window for the image list
+        ImGui::BeginChild("##ImageList", ImVec2(0, 0), false);
+
+        app.visibleList.clear();
+        for (size_t position = 0; position < app.images.size(); position++)
         {
-            // Get just the filename from the full path
-            std::string filename = app.images[i].filename().string();
+            const size_t i = useGroups ? app.listOrder[position] : app.catalog.order()[position];
+
+            // Images a snapshot listed that the scan found gone
+            if (app.imageMissing[i]) {
+                continue;
+            }
 
             // Filter by filename (case-insensitive)
-            if (!filterLower.empty()) {
-                std::string filenameLower = filename;
-                std::transform(filenameLower.begin(), filenameLower.end(), filenameLower.begin(),
-                              [](unsigned char c){ return std::tolower(c); });
-                if (filenameLower.find(filterLower) == std::string::npos) {
-                    continue;  // Skip this image if it doesn't match the filter
+            if (!filterLower.empty() && app.filterNames[i].find(filterLower) == std::string::npos) {
+                continue;  // Skip this image if it doesn't match the filter
+            }
+
+            // Get just the filename from the full path, noting a RAW+JPEG pair
+            std::string filename = imageLabel(app.images[i], app.sidecars[i]);
+
+            // Later frames of a burst are hidden behind the first listed, which is labelled with
+            // its length. Listing sharpest first puts the best frame up front.
+            if (app.hideSoft && app.sharpness[i] >= 0.0f &&
+                app.sharpness[i] < kSoftFraction * app.burstBestSharpness[app.burstFirst[i]]) {
+                continue;
+            }
+            if (showingSimilar) {
+                if (app.similarDistance[i] < 0) {
+                    continue;
+                }
+                if (i != app.similarTo) {
+                    filename += app.similarDistance[i] <= kDuplicateDistance
+                        ? " (duplicate)" : " (" + std::to_string(app.similarDistance[i]) + ")";
+                }
+            } else if (app.groupBursts) {
+                if (app.listOrder[app.catalog.positionOf(static_cast<uint32_t>(app.burstFirst[i]))] != i) {
+                    continue;
+                }
+                if (app.burstLength[app.burstFirst[i]] > 1) {
+                    filename += (app.sharpestFirst ? " [best of " : " [burst of ") +
+                                std::to_string(app.burstLength[app.burstFirst[i]]) + "]";
                 }
             }
 
+            // Images not measured yet are hidden while their thumbnail is loaded to measure them,
+            // once the scan has looked for earlier measurements, a batch at a time
+            if (app.exposureFilter != ExposureFilter::All) {
+                const ImageStats* stats = app.database->getStats(i);
+                if (!stats) {
+                    if (app.imageSeen[i] && backgroundBudget > 0) {
+                        app.database->tryGetThumbnail(i, app.images[i].string(), thumbnailTargetSize, LoadPriority::Background);
+                        backgroundBudget--;
+                    }
+                    continue;
+                }
+                if (!matchesExposureFilter(*stats, app.exposureFilter)) {
+                    continue;
+                }
+            }
+
+            // What survived the filters is what the arrow keys step through
+            if (i == app.currentImageIndex) {
+                app.currentListPosition = app.visibleList.size();
+            }
+            app.visibleList.push_back(i);
+
             ImGui::PushID(static_cast<int>(i));
 
             // Selectable with thumbnail
@@ -463,10 +1769,18 @@ int main(int argc, char* argv[]) {
             if (ImGui::Selectable("##select", is_selected, 0, ImVec2(0, itemHeight)))
             {
                 app.currentImageIndex = i;
+                app.stepStartNs = 0;  // Not a step, so not timed
+                if (!app.compareImages.empty()) {
+                    app.compareImages[app.comparePane] = i;
+                }
                 // Reset zoom and pan when changing images
                 app.zoom = 1.0f;
                 app.pan = {0.0f, 0.0f};
             }
+            if (is_selected && app.scrollToCurrent) {
+                ImGui::SetScrollHereY();
+                app.scrollToCurrent = false;
+            }
 
             // Check if this item is visible in the scroll region
             bool isVisible = ImGui::IsItemVisible();
@@ -474,7 +1788,7 @@ int main(int argc, char* argv[]) {
             // Only request thumbnail if the item is visible
             GpuTexture* thumbnail = nullptr;
             if (isVisible) {
-                thumbnail = app.database->tryGetThumbnail(i, app.images[i].string());
+                thumbnail = app.database->tryGetThumbnail(i, app.images[i].string(), thumbnailTargetSize);
             }
 
             float thumbnailWidth = thumbnailHeight;  // Default to square
@@ -558,38 +1872,117 @@ int main(int argc, char* argv[]) {
 
             ImGui::PopID();
         }
+        // Back to where the list was scrolled when its snapshot was saved
+        if (app.restoreScrollY >= 0.0f && !app.images.empty()) {
+            ImGui::SetScrollY(app.restoreScrollY);
+            app.restoreScrollY = -1.0f;
+        }
+        app.listScrollY = ImGui::GetScrollY();
         ImGui::EndChild();  // End scrollable image list
         ImGui::End();
 
         // Update database - processes completed loads on main thread
         app.database->update();
+        takeScannedImages();
+        finishScan();
+        refreshCatalogKeys();
 
         // Clear and render
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_RenderClear(renderer);
 
-        if (!app.images.empty()) {
+        bool stepLanded = false;  // The image the last step went to is fully on screen this frame
+        if (!app.images.empty() && !app.compareImages.empty()) {
+            // Compare view, the adjusted view only works on a single image
+            app.adjustedView->setImage(nullptr);
+            app.database->releaseAdjustableImage();
+            const SDL_FRect viewport = {app.sidebarWidth, 0.0f, viewportWidth, viewportHeight};
+            for (size_t pane = 0; pane < app.compareImages.size(); ++pane) {
+                const bool done = drawComparePane(pane, comparePaneRect(pane, app.compareImages.size(), viewport));
+                if (pane == app.comparePane) {
+                    stepLanded = app.stepStartNs != 0 && done;
+                }
+            }
+        } else if (!app.images.empty()) {
             // Request images for the selected image
-            GpuTexture* currentPreview = app.database->tryGetThumbnail(app.currentImageIndex, app.images[app.currentImageIndex].string());
-            GpuTexture* currentRaw = app.database->tryGetRaw(app.currentImageIndex, app.images[app.currentImageIndex].string());
+            // The preview only needs to cover the image on screen, rounded up to a power of two so
+            // resizing the window or zooming doesn't queue a new preview load every frame
+            int displayLongEdge = static_cast<int>(std::max(viewportWidth, viewportHeight) * std::max(1.0f, app.zoom));
+            int previewTargetSize = 512;
+            while (previewTargetSize < displayLongEdge) {
+                previewTargetSize *= 2;
+            }
+            GpuTexture* currentPreview = app.database->tryGetThumbnail(app.currentImageIndex, app.images[app.currentImageIndex].string(), previewTargetSize,
+                                                                       LoadPriority::Interactive);
+            bool previewReady = currentPreview && currentPreview->texture;
+
+            // Adjustments work on the raw's linear develop, so adjusting always needs the raw
+            const bool adjust = app.adjusting && !app.showPreview;
+
+            // Only develop the raw once zoomed past the preview's resolution, unless overridden.
+            // Wait for a preview upgrade in flight, it may turn out to be big enough.
+            bool needRaw;
+            if (app.showPreview) {
+                needRaw = false;
+            } else if (app.alwaysRaw || adjust || app.culling) {
+                needRaw = true;
+            } else if (app.database->isPreviewPending(app.currentImageIndex)) {
+                needRaw = false;
+            } else {
+                needRaw = !previewReady || !previewCoversDisplay(*currentPreview, viewportWidth, viewportHeight, app.zoom);
+            }
+
+            // Zoomed in past the preview: develop only the part on screen at full resolution and
+            // draw it over the preview, unless a full develop is already loaded
+            DevelopProfile loadedProfile;
+            const bool useRegion = needRaw && previewReady && !app.alwaysRaw && !app.culling && !adjust &&
+                !app.database->isRegionUnavailable(app.currentImageIndex) &&
+                !(app.database->getRawProfile(app.currentImageIndex, loadedProfile) && loadedProfile >= app.developProfile);
+
+            // A held arrow key shows develops already in the window but doesn't queue new ones
+            GpuTexture* currentRaw = nullptr;
+            if (needRaw && !useRegion && app.culling && app.stepKeyHeld) {
+                currentRaw = app.database->getRaw(app.currentImageIndex, app.developProfile);
+            } else if (needRaw && !useRegion) {
+                currentRaw = app.database->tryGetRaw(app.currentImageIndex, app.images[app.currentImageIndex].string(),
+                                                   app.developProfile, LoadPriority::Interactive, adjust);
+            }
+
+            // Release the linear develop (and its textures) as soon as it isn't being adjusted
+            if (adjust) {
+                app.adjustedView->setImage(app.database->getAdjustableImage(app.currentImageIndex));
+                app.adjustedView->setAdjustments(app.adjustments);
+            } else {
+                app.adjustedView->setImage(nullptr);
+                app.database->releaseAdjustableImage();
+            }
+            bool showAdjusted = app.adjustedView->image() && app.adjustedView->texture()->texture;
 
-            // Determine what to display based on loading state and showPreview checkbox
+            // Determine what to display based on loading state and the raw policy
             GpuTexture* imageToDisplay = nullptr;
             const char* loadingText = nullptr;
 
-            if (!app.showPreview && currentRaw && currentRaw->texture) {
+            if (showAdjusted) {
+                imageToDisplay = app.adjustedView->texture();
+            } else if (currentRaw && currentRaw->texture) {
                 imageToDisplay = currentRaw;
-            } else if (currentPreview && currentPreview->texture) {
+                if (app.database->isRawPending(app.currentImageIndex)) {
+                    // Showing a faster develop while the selected profile is processed
+                    loadingText = "Developing full quality image...";
+                }
+            } else if (previewReady) {
                 // Preview is ready but not raw, show preview with loading text
                 imageToDisplay = currentPreview;
-                if(!app.showPreview)
-                {
-                    loadingText = "Loading full image...";
+                if (needRaw && !useRegion) {
+                    loadingText = app.database->isRawFailed(app.currentImageIndex)
+                        ? "Can't develop this raw, showing its preview" : "Loading full image...";
                 }
             } else {
                 // Nothing ready yet
-                loadingText = "Loading preview...";
+                loadingText = app.database->isRawFailed(app.currentImageIndex) ? "Can't open this image"
+                                                                                : "Loading preview...";
             }
+            stepLanded = app.stepStartNs != 0 && imageToDisplay && !loadingText;
 
             // Render the image if available
             if (imageToDisplay) {
@@ -614,7 +2007,64 @@ int main(int argc, char* argv[]) {
                 destRect.w = zoomedWidth;
                 destRect.h = zoomedHeight;
 
+                SDL_FRect viewport = {app.sidebarWidth, 0.0f, static_cast<float>(availableWidth),
+                                      static_cast<float>(availableHeight)};
+
+                // Refine the adjusted image for this frame, then draw whichever texture is current
+                if (showAdjusted) {
+                    app.adjustedView->update(visibleTextureUv(destRect, viewport, imageToDisplay->orientation), 12.0);
+                    imageToDisplay = app.adjustedView->texture();
+                }
+
                 imageToDisplay->render(renderer, &destRect);
+
+                // Overlays of whichever image is drawn; the adjusted view shares the raw's geometry
+                const bool showingRaw = showAdjusted || imageToDisplay == currentRaw;
+                const OverlayTextures* overlays = (app.showClipping || app.showPeaking)
+                    ? app.database->getOverlays(app.currentImageIndex, showingRaw)
+                    : nullptr;
+                if (overlays && app.showClipping && overlays->clipping.texture) {
+                    // Blink by fading the texture, nothing is rebuilt
+                    SDL_SetTextureAlphaMod(overlays->clipping.texture, (SDL_GetTicks() / 500) % 2 ? 255 : 60);
+                    overlays->clipping.render(renderer, &destRect);
+                }
+                if (overlays && app.showPeaking && overlays->peaking.texture) {
+                    overlays->peaking.render(renderer, &destRect);
+                }
+
+                // Full resolution region over the preview, once one has been developed
+                if (useRegion) {
+                    SDL_FRect regionUv;
+                    GpuTexture* region = app.database->tryGetRegion(
+                        app.currentImageIndex, app.images[app.currentImageIndex].string(),
+                        visibleTextureUv(destRect, viewport, imageToDisplay->orientation), app.developProfile, regionUv);
+                    if (region && region->texture) {
+                        SDL_FRect regionRect = textureUvToDisplayRect(regionUv, destRect, region->orientation);
+                        region->render(renderer, &regionRect);
+                    }
+                    if (app.database->isRegionPending(app.currentImageIndex)) {
+                        loadingText = "Developing visible region...";
+                    }
+                }
+            }
+
+            // Histogram of the image being viewed, in the top right corner of the viewport
+            const ImageStats* stats = app.showHistogram
+                ? app.database->getStats(app.currentImageIndex)
+                : nullptr;
+            if (stats) {
+                const ImVec2 histogramSize(256.0f, 100.0f);
+                ImGui::SetNextWindowPos(ImVec2(static_cast<float>(windowWidth) - 10.0f, 10.0f), ImGuiCond_Always,
+                                        ImVec2(1.0f, 0.0f));
+                ImGui::Begin("##Histogram", nullptr,
+                    ImGuiWindowFlags_NoTitleBar |
+                    ImGuiWindowFlags_NoResize |
+                    ImGuiWindowFlags_NoMove |
+                    ImGuiWindowFlags_AlwaysAutoResize |
+                    ImGuiWindowFlags_NoBackground |
+                    ImGuiWindowFlags_NoInputs);
+                drawHistogram(*stats, ImGui::GetCursorScreenPos(), histogramSize);
+                ImGui::End();
             }
 
             // Display loading text if needed
@@ -654,7 +2104,82 @@ int main(int argc, char* argv[]) {
             ImGuiWindowFlags_NoMove |
             ImGuiWindowFlags_NoCollapse);
 
-        ImGui::Checkbox("Show Preview", &app.showPreview);
+        // Overrides for when the raw is developed, the preview is used while it has enough pixels
+        if (ImGui::Checkbox("Show Preview", &app.showPreview) && app.showPreview) {
+            app.alwaysRaw = false;
+            app.adjusting = false;
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Always Raw", &app.alwaysRaw) && app.alwaysRaw) {
+            app.showPreview = false;
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(100.0f);
+        if (ImGui::BeginCombo("Develop", developProfileName(app.developProfile))) {
+            for (int i = 0; i < static_cast<int>(DevelopProfile::Count); ++i) {
+                DevelopProfile profile = static_cast<DevelopProfile>(i);
+                if (ImGui::Selectable(developProfileName(profile), profile == app.developProfile)) {
+                    app.developProfile = profile;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Adjust", &app.adjusting) && app.adjusting) {
+            app.showPreview = false;
+        }
+        if (app.adjusting) {
+            // Applied to the kept linear develop every frame they change, no re-develop needed
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(90.0f);
+            ImGui::SliderFloat("##Exposure", &app.adjustments.exposure, -3.0f, 3.0f, "EV %+.2f");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(90.0f);
+            ImGui::SliderFloat("##Temperature", &app.adjustments.temperature, -1.0f, 1.0f, "Temp %+.2f");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(90.0f);
+            ImGui::SliderFloat("##Tint", &app.adjustments.tint, -1.0f, 1.0f, "Tint %+.2f");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(90.0f);
+            ImGui::SliderFloat("##Contrast", &app.adjustments.contrast, -1.0f, 1.0f, "Contrast %+.2f");
+            ImGui::SameLine();
+            if (ImGui::Button("Reset##Adjustments")) {
+                app.adjustments = Adjustments();
+            }
+            if (!app.images.empty() && app.database->isAdjustableUnavailable(app.currentImageIndex)) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("(needs a native develop)");
+            } else if (app.adjustedView->image()) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("%.0f ms", app.adjustedView->lastProxyMs());
+            }
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Histogram", &app.showHistogram);
+        ImGui::SameLine();
+        ImGui::Checkbox("Clipping", &app.showClipping);
+        ImGui::SameLine();
+        ImGui::Checkbox("Peaking", &app.showPeaking);
+        ImGui::SameLine();
+        bool culling = app.culling;
+        if (ImGui::Checkbox("Culling (C)", &culling)) {
+            setCulling(culling);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(70.0f);
+        const char* compareNames[kMaxComparePanes + 1] = {"Single", "", "2-up", "3-up", "4-up"};
+        if (ImGui::BeginCombo("##Compare", compareNames[app.compareImages.size()])) {
+            for (size_t count : {size_t(0), size_t(2), size_t(3), size_t(4)}) {
+                if (ImGui::Selectable(compareNames[count], count == app.compareImages.size())) {
+                    setCompare(count);
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine();
+        if (!app.images.empty() && ImGui::Button("Similar")) {
+            app.similarTo = app.currentImageIndex;
+        }
         ImGui::SameLine();
         if (ImGui::Button("Reset Zoom")) {
             app.zoom = 1.0f;
@@ -663,6 +2188,31 @@ int main(int argc, char* argv[]) {
         ImGui::SameLine();
         ImGui::Text("Zoom: %.1fx", app.zoom);
 
+        DevelopProfile loadedProfile;
+        if (!app.images.empty() && app.database->getRawProfile(app.currentImageIndex, loadedProfile)) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(raw: %s)", developProfileName(loadedProfile));
+        }
+        if (!app.images.empty() && !app.sidecars[app.currentImageIndex].empty()) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(preview: %s)", app.sidecars[app.currentImageIndex].filename().string().c_str());
+        }
+        if (!app.images.empty()) {
+            // Memory held by each level of detail, against the budgets they are evicted at
+            ImGui::SameLine();
+            ImGui::TextDisabled("%zu / %zu / %zu / %zu MB", app.database->lodBytes(ImageLod::Placeholder) >> 20,
+                                app.database->lodBytes(ImageLod::Thumbnail) >> 20,
+                                app.database->lodBytes(ImageLod::Screen) >> 20,
+                                app.database->lodBytes(ImageLod::Full) >> 20);
+            ImGui::SetItemTooltip("Placeholders / thumbnails / previews / raws in memory");
+        }
+        if (app.culling && !app.stepLatency.empty()) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("step to display p50 %.0f / p90 %.0f / p99 %.0f ms (%zu steps, %zu passed)",
+                                app.stepLatency.percentile(0.5), app.stepLatency.percentile(0.9),
+                                app.stepLatency.percentile(0.99), app.stepLatency.total(), app.stepsSkipped);
+        }
+
         ImGui::End();
 
         // Render ImGui
@@ -670,10 +2220,35 @@ int main(int argc, char* argv[]) {
         ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
 
         SDL_RenderPresent(renderer);
+
+        if (!firstFramePresented || !firstThumbnailPresented) {
+            auto sinceLaunch = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - launchTime);
+            if (!firstFramePresented) {
+                firstFramePresented = true;
+                std::cout << "Time to first frame: " << sinceLaunch.count() << " ms" << std::endl;
+            }
+            if (!firstThumbnailPresented && thumbnailDrawn) {
+                firstThumbnailPresented = true;
+                std::cout << "Time to first thumbnail: " << sinceLaunch.count() << " ms" << std::endl;
+            }
+        }
+
+        if (stepLanded) {
+            app.stepLatency.add(static_cast<double>(SDL_GetTicksNS() - app.stepStartNs) / 1e6);
+            app.stepStartNs = 0;
+        }
     }
 
     // Cleanup
+    stopScan();
+    saveCatalogSnapshot();
+    delete app.adjustedView;
     delete app.database;  // Stops worker thread and frees resources
+    app.metadataIndexLoaded.wait();  // Saving before it's loaded would write it out empty
+    if (!app.metadataIndexPath.empty()) {
+        app.metadataIndex.save(app.metadataIndexPath);
+    }
 
     ImGui_ImplSDLRenderer3_Shutdown();
     ImGui_ImplSDL3_Shutdown();
@@ -0,0 +1,478 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <filesystem>
+#include "image_stats.h"
+#include "perceptual_hash.h"
+
+namespace fs = std::filesystem;
+
+// Byte range of an embedded JPEG preview inside a raw file
+struct PreviewLocation {
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    uint16_t width = 0;   // 0 if unknown
+    uint16_t height = 0;
+};
+
+// Everything remembered about a file, valid while its size and modification time are unchanged
+struct FileMetadata {
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    int orientation = 0;  // LibRaw flip value
+    std::vector<PreviewLocation> previews;
+    int64_t captureTime = 0;  // Seconds since 1970 of the camera's clock, 0 if unknown
+    std::string camera;       // Make and model, empty if unknown
+};
+
+// Seconds since 1970 of a civil date and time, without going through the local time zone
+inline int64_t civilToSeconds(int year, int month, int day, int hour, int minute, int second) {
+    // Days from civil, counting years from March so the leap day is last
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t yearOfEra = year - era * 400;
+    const int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    const int64_t days = era * 146097 + dayOfEra - 719468;
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+// Parse an EXIF "YYYY:MM:DD HH:MM:SS" date. Returns 0 if it isn't one (cameras write blanks).
+inline int64_t parseExifDateTime(const char* text, size_t length) {
+    int fields[6];
+    static const int kStarts[6] = {0, 5, 8, 11, 14, 17};
+    static const int kLengths[6] = {4, 2, 2, 2, 2, 2};
+    if (length < 19) {
+        return 0;
+    }
+    for (int i = 0; i < 6; ++i) {
+        fields[i] = 0;
+        for (int c = kStarts[i]; c < kStarts[i] + kLengths[i]; ++c) {
+            if (!std::isdigit(static_cast<unsigned char>(text[c]))) {
+                return 0;
+            }
+            fields[i] = fields[i] * 10 + (text[c] - '0');
+        }
+    }
+    if (fields[0] < 1900 || fields[1] < 1 || fields[1] > 12 || fields[2] < 1 || fields[2] > 31) {
+        return 0;
+    }
+    return civilToSeconds(fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+}
+
+// Camera name from EXIF or LibRaw make and model. Models often repeat the make ("Canon" and
+// "Canon EOS R5"), so it's only prepended when the model doesn't start with it.
+inline std::string cameraName(std::string make, std::string model) {
+    auto trim = [](std::string& text) {
+        text.erase(std::find(text.begin(), text.end(), '\0'), text.end());
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+            text.pop_back();
+        }
+    };
+    trim(make);
+    trim(model);
+    std::string makeWord = make.substr(0, make.find(' '));
+    bool modelHasMake = !makeWord.empty() && model.size() >= makeWord.size() &&
+        std::equal(makeWord.begin(), makeWord.end(), model.begin(), [](char a, char b) {
+            return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+        });
+    if (model.empty() || modelHasMake) {
+        return model.empty() ? make : model;
+    }
+    return make.empty() ? model : makeWord + " " + model;
+}
+
+// Get the size and modification time used to validate cached metadata
+// Returns false if the file can't be stat'ed
+inline bool statFile(const std::string& path, uint64_t& size, int64_t& modifiedTime) {
+    std::error_code ec;
+    size = fs::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    auto time = fs::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    modifiedTime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+// Read exactly length bytes at offset from a file
+inline bool readFileRange(const std::string& path, uint64_t offset, uint32_t length, std::vector<unsigned char>& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    out.resize(length);
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(reinterpret_cast<char*>(out.data()), length);
+    return file.gcount() == static_cast<std::streamsize>(length);
+}
+
+// Thread-safe per-file metadata cache keyed by path, persisted between runs
+// Shared by all worker threads and kept across database rebuilds
+class MetadataIndex {
+public:
+    // Look up metadata for a file. Returns false if missing or stale (size/mtime changed).
+    bool lookup(const std::string& path, uint64_t fileSize, int64_t modifiedTime, FileMetadata& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it == entries_.end() || it->second.fileSize != fileSize || it->second.modifiedTime != modifiedTime) {
+            return false;
+        }
+        out = it->second;
+        return true;
+    }
+
+    void store(const std::string& path, FileMetadata metadata) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[path] = std::move(metadata);
+        dirty_ = true;
+    }
+
+    // Look up the statistics measured for a file. Returns false if missing or stale.
+    bool lookupStats(const std::string& path, uint64_t fileSize, int64_t modifiedTime, ImageStats& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = stats_.find(path);
+        if (it == stats_.end() || it->second.fileSize != fileSize || it->second.modifiedTime != modifiedTime) {
+            return false;
+        }
+        out = it->second.stats;
+        return true;
+    }
+
+    // Remember statistics measured for a file, unless ones from more pixels are already known
+    void storeStats(const std::string& path, uint64_t fileSize, int64_t modifiedTime, const ImageStats& stats) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StatsRecord& record = stats_[path];
+        if (record.fileSize == fileSize && record.modifiedTime == modifiedTime &&
+            record.stats.pixelCount > stats.pixelCount) {
+            return;
+        }
+        record.fileSize = fileSize;
+        record.modifiedTime = modifiedTime;
+        record.stats = stats;
+        dirty_ = true;
+    }
+
+    // Look up the perceptual hash of a file. Returns false if missing or stale.
+    bool lookupHash(const std::string& path, uint64_t fileSize, int64_t modifiedTime, PerceptualHash& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = hashes_.find(path);
+        if (it == hashes_.end() || it->second.fileSize != fileSize || it->second.modifiedTime != modifiedTime) {
+            return false;
+        }
+        out = it->second.hash;
+        return true;
+    }
+
+    void storeHash(const std::string& path, uint64_t fileSize, int64_t modifiedTime, const PerceptualHash& hash) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hashes_[path] = HashRecord{fileSize, modifiedTime, hash};
+        dirty_ = true;
+    }
+
+    // Look up the sharpness score of a file. Returns false if missing or stale.
+    bool lookupSharpness(const std::string& path, uint64_t fileSize, int64_t modifiedTime, float& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sharpness_.find(path);
+        if (it == sharpness_.end() || it->second.fileSize != fileSize || it->second.modifiedTime != modifiedTime) {
+            return false;
+        }
+        out = it->second.score;
+        return true;
+    }
+
+    void storeSharpness(const std::string& path, uint64_t fileSize, int64_t modifiedTime, float score) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sharpness_[path] = SharpnessRecord{fileSize, modifiedTime, score};
+        dirty_ = true;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    // Load from disk, keeping anything already recorded over what the file has. Missing or
+    // outdated files leave it as it is.
+    bool load(const std::string& indexPath) {
+        std::ifstream file(indexPath, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        uint32_t magic = 0, version = 0, count = 0;
+        readPod(file, magic);
+        readPod(file, version);
+        readPod(file, count);
+        if (!file || magic != kMagic || version < kMinVersion || version > kVersion) {
+            std::cerr << "Ignoring outdated metadata index: " << indexPath << std::endl;
+            return false;
+        }
+
+        std::unordered_map<std::string, FileMetadata> entries;
+        entries.reserve(count);
+        for (uint32_t i = 0; i < count && file; ++i) {
+            std::string path;
+            FileMetadata metadata;
+            uint32_t pathLength = 0, previewCount = 0;
+            int32_t orientation = 0;
+            readPod(file, pathLength);
+            if (!file || pathLength > 4096) {
+                break;
+            }
+            path.resize(pathLength);
+            file.read(&path[0], pathLength);
+            readPod(file, metadata.fileSize);
+            readPod(file, metadata.modifiedTime);
+            readPod(file, orientation);
+            readPod(file, previewCount);
+            if (!file || previewCount > 64) {
+                break;
+            }
+            metadata.orientation = orientation;
+            metadata.previews.resize(previewCount);
+            for (PreviewLocation& preview : metadata.previews) {
+                readPod(file, preview.offset);
+                readPod(file, preview.length);
+                readPod(file, preview.width);
+                readPod(file, preview.height);
+            }
+            if (version >= 5) {
+                uint32_t cameraLength = 0;
+                readPod(file, metadata.captureTime);
+                readPod(file, cameraLength);
+                if (!file || cameraLength > 256) {
+                    break;
+                }
+                metadata.camera.resize(cameraLength);
+                file.read(&metadata.camera[0], cameraLength);
+            }
+            // Entries from before version 5 lack the capture time and camera. They are dropped
+            // and located again, which only reads the file's header.
+            if (file && version >= 5) {
+                entries[path] = std::move(metadata);
+            }
+        }
+
+        // Version 2 added the measured statistics after the entries
+        std::unordered_map<std::string, StatsRecord> stats;
+        uint32_t statsCount = 0;
+        if (version >= 2) {
+            readPod(file, statsCount);
+        }
+        for (uint32_t i = 0; i < statsCount && file; ++i) {
+            std::string path;
+            StatsRecord record;
+            uint32_t pathLength = 0;
+            readPod(file, pathLength);
+            if (!file || pathLength > 4096) {
+                break;
+            }
+            path.resize(pathLength);
+            file.read(&path[0], pathLength);
+            readPod(file, record.fileSize);
+            readPod(file, record.modifiedTime);
+            readPod(file, record.stats);
+            if (file) {
+                stats[path] = record;
+            }
+        }
+
+        // Version 3 added the perceptual hashes after the statistics
+        std::unordered_map<std::string, HashRecord> hashes;
+        uint32_t hashCount = 0;
+        if (version >= 3 && file) {
+            readPod(file, hashCount);
+        }
+        for (uint32_t i = 0; i < hashCount && file; ++i) {
+            std::string path;
+            HashRecord record;
+            uint32_t pathLength = 0;
+            readPod(file, pathLength);
+            if (!file || pathLength > 4096) {
+                break;
+            }
+            path.resize(pathLength);
+            file.read(&path[0], pathLength);
+            readPod(file, record.fileSize);
+            readPod(file, record.modifiedTime);
+            readPod(file, record.hash);
+            if (file) {
+                hashes[path] = record;
+            }
+        }
+
+        // Version 4 added the sharpness scores after the hashes
+        std::unordered_map<std::string, SharpnessRecord> sharpness;
+        uint32_t sharpnessCount = 0;
+        if (version >= 4 && file) {
+            readPod(file, sharpnessCount);
+        }
+        for (uint32_t i = 0; i < sharpnessCount && file; ++i) {
+            std::string path;
+            SharpnessRecord record;
+            uint32_t pathLength = 0;
+            readPod(file, pathLength);
+            if (!file || pathLength > 4096) {
+                break;
+            }
+            path.resize(pathLength);
+            file.read(&path[0], pathLength);
+            readPod(file, record.fileSize);
+            readPod(file, record.modifiedTime);
+            readPod(file, record.score);
+            if (file) {
+                sharpness[path] = record;
+            }
+        }
+
+        // Loading runs alongside the workers, and anything they recorded meanwhile is newer
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& [path, metadata] : entries_) {
+            entries[path] = std::move(metadata);
+        }
+        for (auto& [path, record] : stats_) {
+            stats[path] = record;
+        }
+        for (auto& [path, record] : hashes_) {
+            hashes[path] = record;
+        }
+        for (auto& [path, record] : sharpness_) {
+            sharpness[path] = record;
+        }
+        entries_ = std::move(entries);
+        stats_ = std::move(stats);
+        hashes_ = std::move(hashes);
+        sharpness_ = std::move(sharpness);
+        std::cout << "Loaded metadata for " << entries_.size() << " files" << std::endl;
+        return true;
+    }
+
+    // Write to disk if anything changed since the last load/save
+    bool save(const std::string& indexPath) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!dirty_) {
+            return true;
+        }
+
+        // Write to a temporary file first so a crash can't leave a truncated index
+        std::string tempPath = indexPath + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Error writing metadata index: " << tempPath << std::endl;
+            return false;
+        }
+
+        writePod(file, kMagic);
+        writePod(file, kVersion);
+        writePod(file, static_cast<uint32_t>(entries_.size()));
+        for (const auto& [path, metadata] : entries_) {
+            writePod(file, static_cast<uint32_t>(path.size()));
+            file.write(path.data(), path.size());
+            writePod(file, metadata.fileSize);
+            writePod(file, metadata.modifiedTime);
+            writePod(file, static_cast<int32_t>(metadata.orientation));
+            writePod(file, static_cast<uint32_t>(metadata.previews.size()));
+            for (const PreviewLocation& preview : metadata.previews) {
+                writePod(file, preview.offset);
+                writePod(file, preview.length);
+                writePod(file, preview.width);
+                writePod(file, preview.height);
+            }
+            writePod(file, metadata.captureTime);
+            writePod(file, static_cast<uint32_t>(metadata.camera.size()));
+            file.write(metadata.camera.data(), metadata.camera.size());
+        }
+        writePod(file, static_cast<uint32_t>(stats_.size()));
+        for (const auto& [path, record] : stats_) {
+            writePod(file, static_cast<uint32_t>(path.size()));
+            file.write(path.data(), path.size());
+            writePod(file, record.fileSize);
+            writePod(file, record.modifiedTime);
+            writePod(file, record.stats);
+        }
+        writePod(file, static_cast<uint32_t>(hashes_.size()));
+        for (const auto& [path, record] : hashes_) {
+            writePod(file, static_cast<uint32_t>(path.size()));
+            file.write(path.data(), path.size());
+            writePod(file, record.fileSize);
+            writePod(file, record.modifiedTime);
+            writePod(file, record.hash);
+        }
+        writePod(file, static_cast<uint32_t>(sharpness_.size()));
+        for (const auto& [path, record] : sharpness_) {
+            writePod(file, static_cast<uint32_t>(path.size()));
+            file.write(path.data(), path.size());
+            writePod(file, record.fileSize);
+            writePod(file, record.modifiedTime);
+            writePod(file, record.score);
+        }
+        file.close();
+        if (!file) {
+            std::cerr << "Error writing metadata index: " << tempPath << std::endl;
+            return false;
+        }
+
+        std::error_code ec;
+        fs::rename(tempPath, indexPath, ec);
+        if (ec) {
+            std::cerr << "Error replacing metadata index: " << ec.message() << std::endl;
+            return false;
+        }
+        dirty_ = false;
+        return true;
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x494D4250;  // "PBMI"
+    static constexpr uint32_t kVersion = 5;
+    static constexpr uint32_t kMinVersion = 1;  // Older versions that can still be read
+
+    // Statistics are kept apart from the preview locations, they are measured later and for
+    // the raw's path even when its previews come from a sidecar
+    struct StatsRecord {
+        uint64_t fileSize = 0;
+        int64_t modifiedTime = 0;
+        ImageStats stats;
+    };
+
+    struct HashRecord {
+        uint64_t fileSize = 0;
+        int64_t modifiedTime = 0;
+        PerceptualHash hash;
+    };
+
+    struct SharpnessRecord {
+        uint64_t fileSize = 0;
+        int64_t modifiedTime = 0;
+        float score = 0.0f;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, FileMetadata> entries_;
+    std::unordered_map<std::string, StatsRecord> stats_;
+    std::unordered_map<std::string, HashRecord> hashes_;
+    std::unordered_map<std::string, SharpnessRecord> sharpness_;
+    bool dirty_ = false;
+
+    template <typename T>
+    static void writePod(std::ofstream& file, const T& value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    static void readPod(std::ifstream& file, T& value) {
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    }
+};
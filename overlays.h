@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include "image_stats.h"
+#include "parallel_for.h"
+#include "srgb_output.h"
+#include "texture_types.h"
+
+// Culling overlays for the image being viewed: clipped highlights and crushed shadows
+// ("blinkies") and focus peaking. Workers build them as RGBA masks, transparent where nothing
+// is marked, at the size of the image they were measured from so they draw over it directly.
+
+// Sobel |gx| + |gy| of the 8-bit luma at which an edge counts as in focus
+constexpr int kPeakingThreshold = 160;
+
+struct OverlayMasks {
+    CpuTexture clipping;  // Red where highlights clip, blue where shadows crush
+    CpuTexture peaking;   // Green on sharp edges
+};
+
+namespace overlay_detail {
+
+// Luma and brightest channel of a row of pixels with 3 or more channels
+inline void measureRowScalar(const uint8_t* pixels, int count, int channels, uint8_t* luma, uint8_t* brightest) {
+    for (int i = 0; i < count; ++i, pixels += channels) {
+        luma[i] = stats_detail::luma(pixels[0], pixels[1], pixels[2]);
+        brightest[i] = std::max({pixels[0], pixels[1], pixels[2]});
+    }
+}
+
+inline void clippingRowScalar(const uint8_t* brightest, int count, uint8_t* out) {
+    for (int i = 0; i < count; ++i, out += 4) {
+        const uint8_t clipped = brightest[i] >= kClippedLevel ? 255 : 0;
+        const uint8_t crushed = brightest[i] <= kCrushedLevel ? 255 : 0;
+        out[0] = clipped;
+        out[1] = 0;
+        out[2] = crushed;
+        out[3] = clipped | crushed;
+    }
+}
+
+// Sobel magnitude at column x of the middle row, columns outside the row reflected
+inline int sobelMagnitude(const uint8_t* above, const uint8_t* row, const uint8_t* below, int width, int x) {
+    const int left = x > 0 ? x - 1 : std::min(1, width - 1);
+    const int right = x < width - 1 ? x + 1 : std::max(0, width - 2);
+    const int gx = (above[right] + 2 * row[right] + below[right]) - (above[left] + 2 * row[left] + below[left]);
+    const int gy = (below[left] + 2 * below[x] + below[right]) - (above[left] + 2 * above[x] + above[right]);
+    return std::abs(gx) + std::abs(gy);
+}
+
+inline void peakingPixel(bool sharp, uint8_t* out) {
+    const uint8_t mask = sharp ? 255 : 0;
+    out[0] = 0;
+    out[1] = mask;
+    out[2] = 0;
+    out[3] = mask;
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+inline int measureRowSimd(const uint8_t* pixels, int count, uint8_t* luma, uint8_t* brightest) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(pixels + i * 3);
+        uint16x8_t yLow = vmull_u8(vget_low_u8(rgb.val[0]), vdup_n_u8(54));
+        uint16x8_t yHigh = vmull_u8(vget_high_u8(rgb.val[0]), vdup_n_u8(54));
+        yLow = vmlal_u8(yLow, vget_low_u8(rgb.val[1]), vdup_n_u8(183));
+        yHigh = vmlal_u8(yHigh, vget_high_u8(rgb.val[1]), vdup_n_u8(183));
+        yLow = vmlal_u8(yLow, vget_low_u8(rgb.val[2]), vdup_n_u8(19));
+        yHigh = vmlal_u8(yHigh, vget_high_u8(rgb.val[2]), vdup_n_u8(19));
+        vst1q_u8(luma + i, vcombine_u8(vrshrn_n_u16(yLow, 8), vrshrn_n_u16(yHigh, 8)));
+        vst1q_u8(brightest + i, vmaxq_u8(rgb.val[0], vmaxq_u8(rgb.val[1], rgb.val[2])));
+    }
+    return i;
+}
+
+inline int clippingRowSimd(const uint8_t* brightest, int count, uint8_t* out) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t value = vld1q_u8(brightest + i);
+        uint8x16_t clipped = vcgeq_u8(value, vdupq_n_u8(kClippedLevel));
+        uint8x16_t crushed = vcleq_u8(value, vdupq_n_u8(kCrushedLevel));
+        uint8x16x4_t rgba = {{clipped, vdupq_n_u8(0), crushed, vorrq_u8(clipped, crushed)}};
+        vst4q_u8(out + i * 4, rgba);
+    }
+    return i;
+}
+
+// Columns [1, width - 1) 16 at a time; returns the first column left for the scalar path
+inline int peakingRowSimd(const uint8_t* above, const uint8_t* row, const uint8_t* below, int width, uint8_t* out) {
+    const int16x8_t threshold = vdupq_n_s16(kPeakingThreshold);
+    int x = 1;
+    for (; x + 17 <= width; x += 16) {
+        auto magnitude = [&](bool high) {
+            auto load = [&](const uint8_t* p) {
+                const uint8x16_t bytes = vld1q_u8(p);
+                return vreinterpretq_s16_u16(vmovl_u8(high ? vget_high_u8(bytes) : vget_low_u8(bytes)));
+            };
+            int16x8_t aboveLeft = load(above + x - 1), aboveMid = load(above + x), aboveRight = load(above + x + 1);
+            int16x8_t rowLeft = load(row + x - 1), rowRight = load(row + x + 1);
+            int16x8_t belowLeft = load(below + x - 1), belowMid = load(below + x), belowRight = load(below + x + 1);
+            int16x8_t gx = vsubq_s16(vaddq_s16(vaddq_s16(aboveRight, belowRight), vshlq_n_s16(rowRight, 1)),
+                                     vaddq_s16(vaddq_s16(aboveLeft, belowLeft), vshlq_n_s16(rowLeft, 1)));
+            int16x8_t gy = vsubq_s16(vaddq_s16(vaddq_s16(belowLeft, belowRight), vshlq_n_s16(belowMid, 1)),
+                                     vaddq_s16(vaddq_s16(aboveLeft, aboveRight), vshlq_n_s16(aboveMid, 1)));
+            return vcgtq_s16(vaddq_s16(vabsq_s16(gx), vabsq_s16(gy)), threshold);
+        };
+        uint8x16_t sharp = vcombine_u8(vmovn_u16(magnitude(false)), vmovn_u16(magnitude(true)));
+        uint8x16x4_t rgba = {{vdupq_n_u8(0), sharp, vdupq_n_u8(0), sharp}};
+        vst4q_u8(out + x * 4, rgba);
+    }
+    return x;
+}
+#elif (defined(__SSE2__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+// Interleave four planes of 16 bytes into 16 RGBA pixels
+inline void storeRgba(__m128i r, __m128i g, __m128i b, __m128i a, uint8_t* out) {
+    const __m128i rgLow = _mm_unpacklo_epi8(r, g), rgHigh = _mm_unpackhi_epi8(r, g);
+    const __m128i baLow = _mm_unpacklo_epi8(b, a), baHigh = _mm_unpackhi_epi8(b, a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(rgLow, baLow));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi16(rgLow, baLow));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 32), _mm_unpacklo_epi16(rgHigh, baHigh));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 48), _mm_unpackhi_epi16(rgHigh, baHigh));
+}
+
+// Deinterleaving needs SSSE3 shuffles, so this one is picked at runtime
+__attribute__((target("ssse3"))) inline int measureRowSsse3(const uint8_t* pixels, int count, uint8_t* luma,
+                                                             uint8_t* brightest) {
+    static const stats_detail::DeinterleaveMasks shuffles;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weightR = _mm_set1_epi16(54), weightG = _mm_set1_epi16(183), weightB = _mm_set1_epi16(19);
+    const __m128i rounding = _mm_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i loads[3] = {_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3 + 16)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 3 + 32))};
+        __m128i rgb[3];
+        for (int c = 0; c < 3; ++c) {
+            __m128i channel = zero;
+            for (int load = 0; load < 3; ++load) {
+                const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffles.masks[c][load]));
+                channel = _mm_or_si128(channel, _mm_shuffle_epi8(loads[load], mask));
+            }
+            rgb[c] = channel;
+        }
+        auto weighted = [&](bool high) {
+            auto widen = [&](__m128i v) { return high ? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero); };
+            __m128i sum = _mm_add_epi16(_mm_mullo_epi16(widen(rgb[0]), weightR), rounding);
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(widen(rgb[1]), weightG));
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(widen(rgb[2]), weightB));
+            return _mm_srli_epi16(sum, 8);
+        };
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(luma + i), _mm_packus_epi16(weighted(false), weighted(true)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(brightest + i), _mm_max_epu8(rgb[0], _mm_max_epu8(rgb[1], rgb[2])));
+    }
+    return i;
+}
+
+inline int measureRowSimd(const uint8_t* pixels, int count, uint8_t* luma, uint8_t* brightest) {
+    return srgb_detail::cpuHasSsse3() ? measureRowSsse3(pixels, count, luma, brightest) : 0;
+}
+
+inline int clippingRowSimd(const uint8_t* brightest, int count, uint8_t* out) {
+    const __m128i clippedLevel = _mm_set1_epi8(static_cast<char>(kClippedLevel));
+    const __m128i crushedLevel = _mm_set1_epi8(static_cast<char>(kCrushedLevel));
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(brightest + i));
+        const __m128i clipped = _mm_cmpeq_epi8(_mm_max_epu8(value, clippedLevel), value);
+        const __m128i crushed = _mm_cmpeq_epi8(_mm_min_epu8(value, crushedLevel), value);
+        storeRgba(clipped, _mm_setzero_si128(), crushed, _mm_or_si128(clipped, crushed), out + i * 4);
+    }
+    return i;
+}
+
+// Columns [1, width - 1) 16 at a time; returns the first column left for the scalar path
+inline int peakingRowSimd(const uint8_t* above, const uint8_t* row, const uint8_t* below, int width, uint8_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i threshold = _mm_set1_epi16(kPeakingThreshold);
+    int x = 1;
+    for (; x + 17 <= width; x += 16) {
+        auto magnitude = [&](bool high) {
+            auto load = [&](const uint8_t* p) {
+                const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                return high ? _mm_unpackhi_epi8(bytes, zero) : _mm_unpacklo_epi8(bytes, zero);
+            };
+            const __m128i aboveLeft = load(above + x - 1), aboveMid = load(above + x), aboveRight = load(above + x + 1);
+            const __m128i rowLeft = load(row + x - 1), rowRight = load(row + x + 1);
+            const __m128i belowLeft = load(below + x - 1), belowMid = load(below + x), belowRight = load(below + x + 1);
+            const __m128i gx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(aboveRight, belowRight), _mm_slli_epi16(rowRight, 1)),
+                                             _mm_add_epi16(_mm_add_epi16(aboveLeft, belowLeft), _mm_slli_epi16(rowLeft, 1)));
+            const __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(belowLeft, belowRight), _mm_slli_epi16(belowMid, 1)),
+                                             _mm_add_epi16(_mm_add_epi16(aboveLeft, aboveRight), _mm_slli_epi16(aboveMid, 1)));
+            const __m128i absGx = _mm_max_epi16(gx, _mm_sub_epi16(zero, gx));
+            const __m128i absGy = _mm_max_epi16(gy, _mm_sub_epi16(zero, gy));
+            return _mm_cmpgt_epi16(_mm_add_epi16(absGx, absGy), threshold);
+        };
+        const __m128i sharp = _mm_packs_epi16(magnitude(false), magnitude(true));
+        storeRgba(zero, sharp, zero, sharp, out + x * 4);
+    }
+    return x;
+}
+#else
+inline int measureRowSimd(const uint8_t*, int, uint8_t*, uint8_t*) { return 0; }
+inline int clippingRowSimd(const uint8_t*, int, uint8_t*) { return 0; }
+inline int peakingRowSimd(const uint8_t*, const uint8_t*, const uint8_t*, int, uint8_t*) { return 1; }
+#endif
+
+// Luma and brightest channel of a row, through the SIMD path for RGB
+inline void measureRow(const uint8_t* pixels, int width, int channels, uint8_t* luma, uint8_t* brightest) {
+    const int done = channels == 3 ? measureRowSimd(pixels, width, luma, brightest) : 0;
+    measureRowScalar(pixels + static_cast<size_t>(done) * channels, width - done, channels, luma + done, brightest + done);
+}
+
+} // namespace overlay_detail
+
+// Build both overlays for an 8-bit image with 3 or more interleaved channels (R, G, B first)
+// allowParallel splits the rows across the shared pool, for the image being viewed
+inline OverlayMasks computeOverlayMasks(const uint8_t* pixels, int width, int height, int channels, bool allowParallel) {
+    using namespace overlay_detail;
+    OverlayMasks masks;
+    if (!pixels || width <= 0 || height <= 0 || channels < 3) {
+        return masks;
+    }
+
+    // Allocate with malloc so CpuTexture can release them with stbi_image_free
+    const size_t count = static_cast<size_t>(width) * height;
+    uint8_t* clipping = static_cast<uint8_t*>(malloc(count * 4));
+    uint8_t* peaking = static_cast<uint8_t*>(malloc(count * 4));
+    if (!clipping || !peaking) {
+        free(clipping);
+        free(peaking);
+        return masks;
+    }
+    std::vector<uint8_t> luma(count), brightest(count);
+
+    const int rowsPerBand = 32;
+    const size_t bands = static_cast<size_t>((height + rowsPerBand - 1) / rowsPerBand);
+    auto forEachBand = [&](const std::function<void(int)>& rowFn) {
+        auto band = [&](size_t index) {
+            const int y0 = static_cast<int>(index) * rowsPerBand;
+            for (int y = y0; y < std::min(height, y0 + rowsPerBand); ++y) {
+                rowFn(y);
+            }
+        };
+        if (allowParallel) {
+            parallelFor(bands, band);
+        } else {
+            for (size_t index = 0; index < bands; ++index) {
+                band(index);
+            }
+        }
+    };
+
+    // Luma and brightest channel first, peaking needs the rows above and below
+    forEachBand([&](int y) {
+        const size_t offset = static_cast<size_t>(y) * width;
+        measureRow(pixels + offset * channels, width, channels, &luma[offset], &brightest[offset]);
+    });
+
+    forEachBand([&](int y) {
+        const size_t offset = static_cast<size_t>(y) * width;
+        uint8_t* clippingRow = clipping + offset * 4;
+        const int done = clippingRowSimd(&brightest[offset], width, clippingRow);
+        clippingRowScalar(&brightest[offset + done], width - done, clippingRow + static_cast<size_t>(done) * 4);
+
+        // Rows outside the image are reflected like the columns
+        const int aboveY = y > 0 ? y - 1 : std::min(1, height - 1);
+        const int belowY = y < height - 1 ? y + 1 : std::max(0, height - 2);
+        const uint8_t* above = &luma[static_cast<size_t>(aboveY) * width];
+        const uint8_t* row = &luma[offset];
+        const uint8_t* below = &luma[static_cast<size_t>(belowY) * width];
+        uint8_t* peakingRow = peaking + offset * 4;
+        peakingPixel(sobelMagnitude(above, row, below, width, 0) > kPeakingThreshold, peakingRow);
+        for (int x = peakingRowSimd(above, row, below, width, peakingRow); x < width; ++x) {
+            peakingPixel(sobelMagnitude(above, row, below, width, x) > kPeakingThreshold, peakingRow + x * 4);
+        }
+    });
+
+    masks.clipping = CpuTexture(clipping, width, height, 4);
+    masks.peaking = CpuTexture(peaking, width, height, 4);
+    return masks;
+}
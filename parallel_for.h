@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of helper threads for splitting a single job (one image) across cores
+// The calling thread always works on its own job too, so calls may come from any thread,
+// including from inside another parallelFor, without deadlocking.
+class ParallelPool {
+public:
+    static ParallelPool& instance() {
+        static ParallelPool pool;
+        return pool;
+    }
+
+    // Number of threads that can work on a job at once (helpers plus the caller)
+    size_t concurrency() const {
+        return helpers_.size() + 1;
+    }
+
+    // Call fn(i) for every i in [0, count) and return once all calls have finished
+    void run(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) {
+            return;
+        }
+        if (count == 1 || helpers_.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                fn(i);
+            }
+            return;
+        }
+
+        auto job = std::make_shared<Job>(count, fn);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(job);
+        }
+        wake_.notify_all();
+
+        // Work on our own job, then wait for helpers still running the last items
+        work(*job);
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&] { return job->completed == job->count; });
+    }
+
+private:
+    struct Job {
+        Job(size_t count, const std::function<void(size_t)>& fn) : count(count), fn(fn) {}
+
+        const size_t count;
+        const std::function<void(size_t)>& fn;
+        std::atomic<size_t> next{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t completed = 0;  // Guarded by mutex
+    };
+
+    std::vector<std::thread> helpers_;
+    std::deque<std::shared_ptr<Job>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+
+    ParallelPool() {
+        unsigned int numThreads = std::thread::hardware_concurrency();
+        for (unsigned int i = 1; i < numThreads; ++i) {
+            helpers_.emplace_back(&ParallelPool::helperThreadFunc, this);
+        }
+    }
+
+    ~ParallelPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : helpers_) {
+            thread.join();
+        }
+    }
+
+    // Claim and run items of a job until none are left
+    static void work(Job& job) {
+        size_t done = 0;
+        for (size_t i = job.next++; i < job.count; i = job.next++) {
+            job.fn(i);
+            done++;
+        }
+        if (done > 0) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.completed += done;
+            if (job.completed == job.count) {
+                job.finished.notify_all();
+            }
+        }
+    }
+
+    void helperThreadFunc() {
+        while (true) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                job = jobs_.front();
+                // Every item is claimed once next passes count, so stop offering the job
+                if (job->next >= job->count) {
+                    jobs_.pop_front();
+                    continue;
+                }
+            }
+            work(*job);
+        }
+    }
+};
+
+// Call fn(i) for every i in [0, count) across the shared pool
+inline void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    ParallelPool::instance().run(count, fn);
+}
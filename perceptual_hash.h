@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "overlays.h"
+
+// Perceptual hashes of previews for finding duplicates and bursts without decoding anything
+// again, and an index that answers "everything within this distance" over the whole catalog
+
+// Two 64-bit hashes of one image. Plain data so it can be written to the metadata index as is.
+struct PerceptualHash {
+    uint64_t dHash = 0;  // Signs of horizontal gradients of a 9x8 reduction
+    uint64_t pHash = 0;  // Signs of the 8x8 lowest frequencies of a 32x32 DCT against their median
+};
+
+// Smallest preview that is hashed, each cell of the 32x32 reduction needs a pixel
+constexpr int kHashMinSize = 32;
+
+// Distances (0-128) under which images count as the same picture and as frames of one burst
+constexpr int kDuplicateDistance = 6;
+constexpr int kBurstDistance = 24;
+constexpr int kSimilarDistance = 32;
+
+inline int popcount64(uint64_t value) {
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt64(value));
+#else
+    return __builtin_popcountll(value);
+#endif
+}
+
+// Hamming distance of both hashes added together, 0-128
+inline int hashDistance(const PerceptualHash& a, const PerceptualHash& b) {
+    return popcount64(a.dHash ^ b.dHash) + popcount64(a.pHash ^ b.pHash);
+}
+
+namespace hash_detail {
+
+// Rows of the 32 point DCT-II basis for the 8 lowest frequencies
+inline const float (&dctBasis())[8][32] {
+    static const struct Basis {
+        float values[8][32];
+        Basis() {
+            for (int u = 0; u < 8; ++u) {
+                for (int x = 0; x < 32; ++x) {
+                    values[u][x] = static_cast<float>(std::cos((2.0 * x + 1.0) * u * 3.14159265358979323846 / 64.0));
+                }
+            }
+        }
+    } basis;
+    return basis.values;
+}
+
+// Every hash within maxDistance of the query, in slot order
+inline void scanScalar(const PerceptualHash* hashes, size_t count, const PerceptualHash& query, int maxDistance,
+                       const size_t* imageIndices, std::vector<std::pair<size_t, int>>& found) {
+    for (size_t i = 0; i < count; ++i) {
+        const int distance = hashDistance(hashes[i], query);
+        if (distance <= maxDistance) {
+            found.emplace_back(imageIndices[i], distance);
+        }
+    }
+}
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+// Same scan compiled for the popcnt instruction, which the baseline x86-64 target can't assume
+__attribute__((target("popcnt"))) inline void scanPopcnt(const PerceptualHash* hashes, size_t count,
+                                                         const PerceptualHash& query, int maxDistance,
+                                                         const size_t* imageIndices,
+                                                         std::vector<std::pair<size_t, int>>& found) {
+    for (size_t i = 0; i < count; ++i) {
+        const int distance = __builtin_popcountll(hashes[i].dHash ^ query.dHash) +
+                             __builtin_popcountll(hashes[i].pHash ^ query.pHash);
+        if (distance <= maxDistance) {
+            found.emplace_back(imageIndices[i], distance);
+        }
+    }
+}
+
+inline bool cpuHasPopcnt() {
+    static const bool supported = __builtin_cpu_supports("popcnt");
+    return supported;
+}
+#endif
+
+} // namespace hash_detail
+
+// Hash an 8-bit image with 3 or more interleaved channels (R, G, B first)
+// Luma rows come from the SIMD path the overlays use and are area averaged into both
+// reductions in one pass, so a large preview is read once. Returns false if it's too small.
+inline bool computePerceptualHash(const uint8_t* pixels, int width, int height, int channels, PerceptualHash& out) {
+    if (!pixels || width < kHashMinSize || height < kHashMinSize || channels < 3) {
+        return false;
+    }
+
+    // Reduction cell of every column, then sums per cell
+    std::vector<uint8_t> cell32(width), cell9(width);
+    for (int x = 0; x < width; ++x) {
+        cell32[x] = static_cast<uint8_t>(static_cast<int64_t>(x) * 32 / width);
+        cell9[x] = static_cast<uint8_t>(static_cast<int64_t>(x) * 9 / width);
+    }
+    uint32_t sums32[32][32] = {}, counts32[32][32] = {};
+    uint32_t sums9[8][9] = {}, counts9[8][9] = {};
+    std::vector<uint8_t> luma(width), brightest(width);
+    for (int y = 0; y < height; ++y) {
+        overlay_detail::measureRow(pixels + static_cast<size_t>(y) * width * channels, width, channels,
+                                   luma.data(), brightest.data());
+        uint32_t* rowSums32 = sums32[static_cast<int64_t>(y) * 32 / height];
+        uint32_t* rowCounts32 = counts32[static_cast<int64_t>(y) * 32 / height];
+        uint32_t* rowSums9 = sums9[static_cast<int64_t>(y) * 8 / height];
+        uint32_t* rowCounts9 = counts9[static_cast<int64_t>(y) * 8 / height];
+        for (int x = 0; x < width; ++x) {
+            rowSums32[cell32[x]] += luma[x];
+            rowCounts32[cell32[x]]++;
+            rowSums9[cell9[x]] += luma[x];
+            rowCounts9[cell9[x]]++;
+        }
+    }
+
+    // dHash: is each cell brighter than its right neighbour
+    out.dHash = 0;
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            // Compare averages without dividing: a/ca > b/cb
+            const uint64_t left = static_cast<uint64_t>(sums9[y][x]) * counts9[y][x + 1];
+            const uint64_t right = static_cast<uint64_t>(sums9[y][x + 1]) * counts9[y][x];
+            out.dHash = (out.dHash << 1) | (left > right ? 1u : 0u);
+        }
+    }
+
+    // pHash: separable DCT, but only the 8 lowest frequencies of each direction are needed
+    float reduced[32][32];
+    for (int y = 0; y < 32; ++y) {
+        for (int x = 0; x < 32; ++x) {
+            reduced[y][x] = static_cast<float>(sums32[y][x]) / counts32[y][x];
+        }
+    }
+    const float (&basis)[8][32] = hash_detail::dctBasis();
+    float columns[8][32] = {};  // Vertical frequencies of every column
+    for (int v = 0; v < 8; ++v) {
+        for (int y = 0; y < 32; ++y) {
+            for (int x = 0; x < 32; ++x) {
+                columns[v][x] += basis[v][y] * reduced[y][x];
+            }
+        }
+    }
+    float coefficients[64];
+    for (int v = 0; v < 8; ++v) {
+        for (int u = 0; u < 8; ++u) {
+            float sum = 0.0f;
+            for (int x = 0; x < 32; ++x) {
+                sum += basis[u][x] * columns[v][x];
+            }
+            coefficients[v * 8 + u] = sum;
+        }
+    }
+
+    // The DC term only says how bright the image is, so it is left out of the median
+    float sorted[63];
+    std::copy(coefficients + 1, coefficients + 64, sorted);
+    std::nth_element(sorted, sorted + 31, sorted + 63);
+    const float median = sorted[31];
+    out.pHash = 0;
+    for (int i = 0; i < 64; ++i) {
+        out.pHash = (out.pHash << 1) | (coefficients[i] > median ? 1u : 0u);
+    }
+    return true;
+}
+
+// Near-duplicate queries over every hashed image, kept in flat arrays so a scan is a pass over
+// memory. Small radii use multi-index hashing: the 128 bits are split into 8 chunks of 16, and
+// two hashes within 7 bits of each other must agree exactly on at least one chunk, so only the
+// images sharing a chunk with the query are checked. Larger radii scan everything, which with
+// hardware popcount is a few milliseconds per million images.
+class SimilarityIndex {
+public:
+    void clear() {
+        hashes_.clear();
+        imageIndices_.clear();
+        buckets_.clear();
+        slots_.clear();
+    }
+
+    size_t size() const {
+        return slots_.size();
+    }
+
+    // Replaces the hash of an image already in the index
+    void insert(size_t imageIndex, const PerceptualHash& hash) {
+        remove(imageIndex);
+        const uint32_t slot = static_cast<uint32_t>(hashes_.size());
+        hashes_.push_back(hash);
+        imageIndices_.push_back(imageIndex);
+        slots_[imageIndex] = slot;
+        for (int chunk = 0; chunk < kChunks; ++chunk) {
+            buckets_[chunkKey(hash, chunk)].push_back(slot);
+        }
+    }
+
+    // The slot is only marked as removed, and skipped by queries from then on
+    void remove(size_t imageIndex) {
+        auto it = slots_.find(imageIndex);
+        if (it == slots_.end()) {
+            return;
+        }
+        imageIndices_[it->second] = kRemoved;
+        slots_.erase(it);
+    }
+
+    // Images within maxDistance of hash as (image index, distance), nearest first
+    std::vector<std::pair<size_t, int>> findWithin(const PerceptualHash& hash, int maxDistance) const {
+        std::vector<std::pair<size_t, int>> found;
+        if (maxDistance < kChunks) {
+            for (int chunk = 0; chunk < kChunks; ++chunk) {
+                auto it = buckets_.find(chunkKey(hash, chunk));
+                if (it == buckets_.end()) {
+                    continue;
+                }
+                for (uint32_t slot : it->second) {
+                    if (imageIndices_[slot] == kRemoved) {
+                        continue;
+                    }
+                    // Each image is reported from the first chunk it shares with the query
+                    const PerceptualHash& candidate = hashes_[slot];
+                    int first = 0;
+                    while (first < chunk && chunkKey(candidate, first) != chunkKey(hash, first)) {
+                        ++first;
+                    }
+                    const int distance = hashDistance(candidate, hash);
+                    if (first == chunk && distance <= maxDistance) {
+                        found.emplace_back(imageIndices_[slot], distance);
+                    }
+                }
+            }
+        } else {
+            scan(hash, maxDistance, found);
+            found.erase(std::remove_if(found.begin(), found.end(),
+                                       [](const auto& image) { return image.first == kRemoved; }),
+                        found.end());
+        }
+        std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second < b.second : a.first < b.first;
+        });
+        return found;
+    }
+
+private:
+    static constexpr int kChunks = 8;
+    static constexpr size_t kRemoved = SIZE_MAX;  // Image index of a removed slot
+
+    std::vector<PerceptualHash> hashes_;
+    std::vector<size_t> imageIndices_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> buckets_;  // Chunk number and value to slots
+    std::unordered_map<size_t, uint32_t> slots_;                   // Image index to its live slot
+
+    static uint32_t chunkKey(const PerceptualHash& hash, int chunk) {
+        const uint64_t bits = chunk < 4 ? hash.dHash : hash.pHash;
+        return static_cast<uint32_t>(chunk) << 16 | static_cast<uint32_t>((bits >> (chunk % 4 * 16)) & 0xFFFF);
+    }
+
+    void scan(const PerceptualHash& hash, int maxDistance, std::vector<std::pair<size_t, int>>& found) const {
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+        if (hash_detail::cpuHasPopcnt()) {
+            hash_detail::scanPopcnt(hashes_.data(), hashes_.size(), hash, maxDistance, imageIndices_.data(), found);
+            return;
+        }
+#endif
+        hash_detail::scanScalar(hashes_.data(), hashes_.size(), hash, maxDistance, imageIndices_.data(), found);
+    }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "texture_types.h"
+
+// Levels of detail the database keeps per image, each cached and evicted on its own so that
+// what one view needs never pushes out, or gets inflated by, what another needs
+
+enum class ImageLod {
+    Placeholder, // A few pixels across, kept for as many images as possible while scrolling
+    Thumbnail,   // Sidebar and grid sized
+    Screen,      // Preview covering the main view at its zoom
+    Full,        // The developed raw
+    Count
+};
+
+constexpr int kPreviewLods = static_cast<int>(ImageLod::Full);  // The LODs made from previews
+
+inline const char* imageLodName(ImageLod lod) {
+    switch (lod) {
+        case ImageLod::Placeholder: return "placeholders";
+        case ImageLod::Thumbnail: return "thumbnails";
+        case ImageLod::Screen: return "previews";
+        case ImageLod::Full: return "raws";
+        default: return "unknown";
+    }
+}
+
+// Longest edge a preview LOD is cut down to, 0 if it is kept at the size it was asked for
+inline int lodMaxSize(ImageLod lod) {
+    switch (lod) {
+        case ImageLod::Placeholder: return 32;
+        case ImageLod::Thumbnail: return 256;
+        default: return 0;
+    }
+}
+
+// Bytes of textures each LOD may hold before the least recently drawn are freed
+inline size_t lodBudgetBytes(ImageLod lod) {
+    switch (lod) {
+        case ImageLod::Placeholder: return size_t(64) << 20;
+        case ImageLod::Thumbnail: return size_t(256) << 20;
+        case ImageLod::Screen: return size_t(768) << 20;
+        case ImageLod::Full: return size_t(1536) << 20;
+        default: return 0;
+    }
+}
+
+// Preview LOD for something drawn targetSize pixels on its long edge (0 = as large as there is)
+inline ImageLod lodForSize(int targetSize) {
+    if (targetSize == 0 || targetSize > lodMaxSize(ImageLod::Thumbnail)) {
+        return ImageLod::Screen;
+    }
+    return targetSize <= lodMaxSize(ImageLod::Placeholder) ? ImageLod::Placeholder : ImageLod::Thumbnail;
+}
+
+// Copy of an 8-bit texture area averaged down to at most maxLongEdge on its long edge, or an
+// exact copy if it's already that small. Returns an empty texture on failure.
+inline CpuTexture reduceTexture(const CpuTexture& source, int maxLongEdge) {
+    if (!source.pixels || source.width <= 0 || source.height <= 0 || maxLongEdge <= 0) {
+        return CpuTexture();
+    }
+    const int longEdge = std::max(source.width, source.height);
+    const int width = longEdge <= maxLongEdge ? source.width
+                                              : std::max(1, static_cast<int>(static_cast<int64_t>(source.width) * maxLongEdge / longEdge));
+    const int height = longEdge <= maxLongEdge ? source.height
+                                               : std::max(1, static_cast<int>(static_cast<int64_t>(source.height) * maxLongEdge / longEdge));
+    const int channels = source.channels;
+
+    // Freed by CpuTexture with stbi_image_free, which is free()
+    auto* pixels = static_cast<unsigned char*>(malloc(static_cast<size_t>(width) * height * channels));
+    if (!pixels) {
+        return CpuTexture();
+    }
+
+    // Output column of every source column, then rows are summed into their output row
+    std::vector<int> cell(source.width);
+    for (int x = 0; x < source.width; ++x) {
+        cell[x] = static_cast<int>(static_cast<int64_t>(x) * width / source.width);
+    }
+    std::vector<uint32_t> sums(static_cast<size_t>(width) * channels);
+    std::vector<uint32_t> counts(width);
+    int outY = 0;
+    for (int y = 0; y < source.height; ++y) {
+        const unsigned char* row = source.pixels + static_cast<size_t>(y) * source.width * channels;
+        for (int x = 0; x < source.width; ++x) {
+            uint32_t* sum = &sums[static_cast<size_t>(cell[x]) * channels];
+            for (int c = 0; c < channels; ++c) {
+                sum[c] += row[x * channels + c];
+            }
+            counts[cell[x]]++;
+        }
+        const int nextOutY = y + 1 == source.height ? height
+                                                    : static_cast<int>(static_cast<int64_t>(y + 1) * height / source.height);
+        if (nextOutY != outY) {
+            unsigned char* out = pixels + static_cast<size_t>(outY) * width * channels;
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    out[x * channels + c] = static_cast<unsigned char>(
+                        (sums[static_cast<size_t>(x) * channels + c] + counts[x] / 2) / counts[x]);
+                }
+            }
+            std::fill(sums.begin(), sums.end(), 0u);
+            std::fill(counts.begin(), counts.end(), 0u);
+            outY = nextOutY;
+        }
+    }
+    return CpuTexture(pixels, width, height, channels);
+}
@@ -0,0 +1,502 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <libraw/libraw.h>
+#include "parallel_for.h"
+#include "srgb_output.h"
+#include "texture_types.h"
+
+// Named speed/quality tradeoffs for developing a raw, ordered fastest to best
+enum class DevelopProfile {
+    Culling,  // Half size, no demosaic - for flicking through a shoot
+    Review,   // Full size, bilinear demosaic
+    Final,    // Full size, gradient-corrected demosaic
+    Count
+};
+
+inline const char* developProfileName(DevelopProfile profile) {
+    switch (profile) {
+        case DevelopProfile::Culling: return "Culling";
+        case DevelopProfile::Review: return "Review";
+        case DevelopProfile::Final: return "Final";
+        default: return "Unknown";
+    }
+}
+
+// Configure LibRaw's dcraw_process() for a profile
+// Only used for sensors the native pipeline (developCfa) can't handle
+inline void applyDevelopProfile(libraw_output_params_t& params, DevelopProfile profile) {
+    // Shared settings for color accuracy
+    params.use_camera_wb = 1;
+    params.output_color = 1;  // sRGB
+    params.gamm[0] = 1.0 / 2.4;
+    params.gamm[1] = 12.92;
+    params.no_auto_bright = 0;
+
+    switch (profile) {
+        case DevelopProfile::Culling:
+            params.half_size = 1;  // Each 2x2 block becomes one pixel, skipping demosaic
+            params.user_qual = 0;
+            break;
+        case DevelopProfile::Review:
+            params.half_size = 0;
+            params.user_qual = 2;  // PPG
+            break;
+        default:
+            params.half_size = 0;
+            params.user_qual = 3;  // AHD
+            break;
+    }
+}
+
+// View of unpacked Bayer/X-Trans sensor data plus the color information needed to develop it
+// Does not own the samples - they belong to whoever unpacked the file (e.g. LibRaw)
+struct CfaImage {
+    const uint16_t* data = nullptr;  // First visible sample
+    size_t pitch = 0;                // Samples per row
+    int width = 0;                   // Visible size in samples
+    int height = 0;
+    int patternSize = 2;             // 2 for Bayer, 6 for X-Trans
+    uint8_t pattern[6][6] = {};      // Color (0=R, 1=G, 2=B) at each position of the repeating tile
+    float black[3] = {};             // Black level per color
+    float white = 0.0f;              // Saturation level
+    float wbMul[3] = {1.0f, 1.0f, 1.0f};  // White balance, normalized so the smallest is 1
+    float rgbCam[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};  // Camera RGB to linear sRGB
+
+    bool valid() const { return data && width > 0 && height > 0 && white > 0.0f; }
+
+    int colorAt(int row, int col) const {
+        return pattern[row % patternSize][col % patternSize];
+    }
+
+    uint16_t at(int row, int col) const {
+        return data[static_cast<size_t>(row) * pitch + col];
+    }
+};
+
+// Demosaiced camera RGB kept from a develop so the look can be adjusted without developing again
+// White balanced as shot and clipped to [0, 1], the same values the develop fed its color matrix
+struct LinearImage {
+    std::vector<uint16_t> cam;  // Interleaved camera RGB, width * height * 3
+    int width = 0;
+    int height = 0;
+    float rgbCam[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    void allocate(int w, int h, const float (&matrix)[3][3]) {
+        width = w;
+        height = h;
+        cam.resize(static_cast<size_t>(w) * h * 3);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                rgbCam[i][j] = matrix[i][j];
+            }
+        }
+    }
+};
+
+// Build a CfaImage from a LibRaw processor after unpack()
+// Returns an invalid image for sensors this pipeline doesn't handle (Foveon, linear DNG, etc.)
+inline CfaImage cfaImageFromLibRaw(LibRaw& rawProcessor) {
+    CfaImage cfa;
+    const libraw_data_t& d = rawProcessor.imgdata;
+    const unsigned filters = d.idata.filters;
+    if (!d.rawdata.raw_image || filters == 0 || d.idata.colors != 3) {
+        return cfa;
+    }
+    // Rotated (Fuji SuperCCD) and non-square sensor layouts need LibRaw's own handling
+    if (d.rawdata.ioparams.fuji_width != 0 || d.sizes.pixel_aspect != 1.0) {
+        return cfa;
+    }
+
+    cfa.pitch = d.sizes.raw_pitch / 2;
+    cfa.data = d.rawdata.raw_image + static_cast<size_t>(d.sizes.top_margin) * cfa.pitch + d.sizes.left_margin;
+    cfa.width = d.sizes.width;
+    cfa.height = d.sizes.height;
+    cfa.patternSize = filters == 9 ? 6 : 2;
+
+    for (int row = 0; row < 6; ++row) {
+        for (int col = 0; col < 6; ++col) {
+            int c = rawProcessor.COLOR(row, col);
+            cfa.pattern[row][col] = static_cast<uint8_t>(c == 3 ? 1 : c);  // 3 is the second green
+        }
+    }
+
+    // Black is the common level, one per CFA color (cblack[0-3]) and a repeating pattern of
+    // cblack[4] rows by cblack[5] columns from cblack[6] on, all of which dcraw_process() takes
+    // off each site. Each color keeps one level here, the mean of its sites, so sensors whose
+    // sites of one color differ by more than a few units are left to LibRaw.
+    const unsigned patternRows = d.color.cblack[4];
+    const unsigned patternCols = d.color.cblack[5];
+    const bool hasPattern = patternRows > 0 && patternCols > 0;
+    if (hasPattern && (patternRows > 64 || patternCols > 64 ||
+                       6 + patternRows * patternCols > sizeof(d.color.cblack) / sizeof(d.color.cblack[0]))) {
+        return CfaImage();
+    }
+    double blackSum[3] = {};
+    int blackSites[3] = {};
+    float blackMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float blackMax[3] = {0.0f, 0.0f, 0.0f};
+    const unsigned rows = cfa.patternSize * (hasPattern ? patternRows : 1);
+    const unsigned cols = cfa.patternSize * (hasPattern ? patternCols : 1);
+    for (unsigned row = 0; row < rows; ++row) {
+        for (unsigned col = 0; col < cols; ++col) {
+            const int site = rawProcessor.COLOR(static_cast<int>(row), static_cast<int>(col));
+            float black = static_cast<float>(d.color.black + d.color.cblack[site & 3]);
+            if (hasPattern) {
+                black += static_cast<float>(d.color.cblack[6 + (row % patternRows) * patternCols + col % patternCols]);
+            }
+            const int c = cfa.colorAt(static_cast<int>(row), static_cast<int>(col));
+            blackSum[c] += black;
+            blackSites[c]++;
+            blackMin[c] = std::min(blackMin[c], black);
+            blackMax[c] = std::max(blackMax[c], black);
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        if (blackSites[c] == 0 || blackMax[c] - blackMin[c] > 4.0f) {
+            return CfaImage();
+        }
+        cfa.black[c] = static_cast<float>(blackSum[c] / blackSites[c]);
+    }
+    cfa.white = static_cast<float>(d.color.maximum);
+
+    // As-shot white balance, or the daylight multipliers if the camera didn't record one
+    const float* mul = d.color.cam_mul[0] > 0.0f ? d.color.cam_mul : d.color.pre_mul;
+    if (mul[0] > 0.0f && mul[1] > 0.0f && mul[2] > 0.0f) {
+        float minMul = std::min({mul[0], mul[1], mul[2]});
+        for (int c = 0; c < 3; ++c) {
+            cfa.wbMul[c] = mul[c] / minMul;
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            cfa.rgbCam[i][j] = d.color.rgb_cam[i][j];
+        }
+    }
+    return cfa;
+}
+
+// Develop a small thumbnail straight from the sensor data without demosaicing
+// Each output pixel averages a block of whole CFA tiles (superpixel), so the cost is a single
+// pass over the samples. targetSize is the minimum long edge of the result.
+// If linearOut is set it receives the camera RGB behind every output pixel.
+inline CpuTexture developSuperpixelThumbnail(const CfaImage& cfa, int targetSize, LinearImage* linearOut = nullptr) {
+    if (!cfa.valid()) {
+        return CpuTexture();
+    }
+
+    // X-Trans has every color in each 3x3 quarter of its tile, Bayer in each 2x2
+    const int tile = cfa.patternSize == 6 ? 3 : 2;
+    const int longEdgeTiles = std::max(cfa.width, cfa.height) / tile;
+    const int tilesPerPixel = std::max(1, targetSize > 0 ? longEdgeTiles / targetSize : 1);
+    const int block = tile * tilesPerPixel;
+    const int outWidth = cfa.width / block;
+    const int outHeight = cfa.height / block;
+    if (outWidth <= 0 || outHeight <= 0) {
+        return CpuTexture();
+    }
+
+    // Allocate with malloc so CpuTexture can release it with stbi_image_free
+    unsigned char* pixels = static_cast<unsigned char*>(malloc(static_cast<size_t>(outWidth) * outHeight * 3));
+    if (!pixels) {
+        return CpuTexture();
+    }
+
+    float scale[3];
+    for (int c = 0; c < 3; ++c) {
+        scale[c] = cfa.wbMul[c] / std::max(1.0f, cfa.white - cfa.black[c]);
+    }
+
+    std::vector<uint32_t> sums(static_cast<size_t>(outWidth) * 3);
+    std::vector<uint32_t> counts(static_cast<size_t>(outWidth) * 3);
+    std::vector<uint16_t> linear(static_cast<size_t>(outWidth) * 3);
+    if (linearOut) {
+        linearOut->allocate(outWidth, outHeight, cfa.rgbCam);
+    }
+    for (int oy = 0; oy < outHeight; ++oy) {
+        std::fill(sums.begin(), sums.end(), 0u);
+        std::fill(counts.begin(), counts.end(), 0u);
+
+        // Accumulate one row of blocks, walking the pattern instead of taking a modulo per sample
+        for (int y = oy * block; y < (oy + 1) * block; ++y) {
+            const uint16_t* row = cfa.data + static_cast<size_t>(y) * cfa.pitch;
+            const uint8_t* colors = cfa.pattern[y % cfa.patternSize];
+            for (int ox = 0; ox < outWidth; ++ox) {
+                uint32_t* sum = &sums[static_cast<size_t>(ox) * 3];
+                uint32_t* count = &counts[static_cast<size_t>(ox) * 3];
+                const int x0 = ox * block;
+                int px = x0 % cfa.patternSize;
+                for (int x = x0; x < x0 + block; ++x) {
+                    int c = colors[px];
+                    sum[c] += row[x];
+                    count[c]++;
+                    if (++px == cfa.patternSize) px = 0;
+                }
+            }
+        }
+
+        for (int ox = 0; ox < outWidth; ++ox) {
+            const uint32_t* sum = &sums[static_cast<size_t>(ox) * 3];
+            const uint32_t* count = &counts[static_cast<size_t>(ox) * 3];
+            float cam[3];
+            for (int c = 0; c < 3; ++c) {
+                float mean = count[c] ? static_cast<float>(sum[c]) / count[c] : 0.0f;
+                cam[c] = std::max(0.0f, mean - cfa.black[c]) * scale[c];
+            }
+            if (linearOut) {
+                uint16_t* kept = &linearOut->cam[(static_cast<size_t>(oy) * outWidth + ox) * 3];
+                for (int c = 0; c < 3; ++c) {
+                    kept[c] = quantizeLinear16(cam[c]);
+                }
+            }
+
+            for (int c = 0; c < 3; ++c) {
+                float rgb = cfa.rgbCam[c][0] * cam[0] + cfa.rgbCam[c][1] * cam[1] + cfa.rgbCam[c][2] * cam[2];
+                linear[static_cast<size_t>(ox) * 3 + c] = quantizeLinear16(rgb);
+            }
+        }
+        linear16ToSrgb8Row(linear.data(), pixels + static_cast<size_t>(oy) * outWidth * 3, outWidth, 3);
+    }
+
+    return CpuTexture(pixels, outWidth, outHeight, 3);
+}
+
+// Demosaic algorithms for the native full size develop
+enum class DemosaicMethod {
+    Bilinear,           // Average of the nearest samples of each color (Bayer and X-Trans)
+    GradientCorrected,  // Malvar-He-Cutler 5x5 kernels (Bayer only, X-Trans falls back to bilinear)
+};
+
+// Output tiles are developed independently across the pool, each from its own padded
+// window of the sensor data so neighbouring tiles never need to share intermediate results
+constexpr int kDevelopTileSize = 256;
+constexpr int kDevelopTileBorder = 2;  // Widest demosaic kernel reaches 2 samples out
+
+namespace develop_detail {
+
+// Mirror a coordinate into [0, size) about the edge samples, which keeps the Bayer phase
+inline int reflect(int i, int size) {
+    if (size == 1) return 0;
+    while (i < 0 || i >= size) {
+        i = i < 0 ? -i : 2 * (size - 1) - i;
+    }
+    return i;
+}
+
+// True if the pattern is a 2x2 Bayer with the greens on one diagonal, in any phase (a region
+// starting on an odd row or column shifts RGGB to GRBG and so on)
+inline bool isStandardBayer(const CfaImage& cfa) {
+    if (cfa.patternSize != 2) return false;
+    const uint8_t (&p)[6][6] = cfa.pattern;
+    if (p[0][0] == 1 && p[1][1] == 1) {
+        return p[0][1] != 1 && p[1][0] != 1 && p[0][1] != p[1][0];
+    }
+    return p[0][0] != 1 && p[1][1] != 1 && p[0][0] != p[1][1] && p[0][1] == 1 && p[1][0] == 1;
+}
+
+// Sensor window of one tile: white balanced samples scaled to [0, 1] plus their colors
+struct TileWindow {
+    int width = 0;
+    int height = 0;
+    std::vector<float> values;
+    std::vector<uint8_t> colors;
+
+    float value(int y, int x) const { return values[static_cast<size_t>(y) * width + x]; }
+    uint8_t color(int y, int x) const { return colors[static_cast<size_t>(y) * width + x]; }
+};
+
+// Fill the window for the output rectangle at (x0, y0) size w x h, plus the border
+inline void loadTileWindow(const CfaImage& cfa, int x0, int y0, int w, int h, TileWindow& window) {
+    const int border = kDevelopTileBorder;
+    window.width = w + 2 * border;
+    window.height = h + 2 * border;
+    window.values.resize(static_cast<size_t>(window.width) * window.height);
+    window.colors.resize(window.values.size());
+
+    // Clip at the white level, remove black and apply white balance, clipping channels that
+    // saturate after scaling so blown highlights stay neutral
+    float scale[3];
+    for (int c = 0; c < 3; ++c) {
+        scale[c] = cfa.wbMul[c] / std::max(1.0f, cfa.white - cfa.black[c]);
+    }
+
+    std::vector<int> columns(window.width);
+    for (int x = 0; x < window.width; ++x) {
+        columns[x] = reflect(x0 - border + x, cfa.width);
+    }
+    for (int y = 0; y < window.height; ++y) {
+        const int sensorRow = reflect(y0 - border + y, cfa.height);
+        const uint16_t* row = cfa.data + static_cast<size_t>(sensorRow) * cfa.pitch;
+        const uint8_t* rowColors = cfa.pattern[sensorRow % cfa.patternSize];
+        float* values = &window.values[static_cast<size_t>(y) * window.width];
+        uint8_t* colors = &window.colors[static_cast<size_t>(y) * window.width];
+        for (int x = 0; x < window.width; ++x) {
+            const int sensorCol = columns[x];
+            const int c = rowColors[sensorCol % cfa.patternSize];
+            const float sample = std::min(static_cast<float>(row[sensorCol]), cfa.white);
+            values[x] = std::min(1.0f, std::max(0.0f, sample - cfa.black[c]) * scale[c]);
+            colors[x] = static_cast<uint8_t>(c);
+        }
+    }
+}
+
+// Camera RGB at window position (y, x) from the same colored samples around it
+// Uses the 3x3 neighbourhood, widening to 5x5 for colors it doesn't contain
+inline void demosaicBilinear(const TileWindow& window, int y, int x, float cam[3]) {
+    float sum[3] = {};
+    int count[3] = {};
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            const int c = window.color(y + dy, x + dx);
+            sum[c] += window.value(y + dy, x + dx);
+            count[c]++;
+        }
+    }
+    if (!count[0] || !count[1] || !count[2]) {
+        float outerSum[3] = {};
+        int outerCount[3] = {};
+        for (int dy = -2; dy <= 2; ++dy) {
+            for (int dx = -2; dx <= 2; ++dx) {
+                if (dy > -2 && dy < 2 && dx > -2 && dx < 2) continue;
+                const int c = window.color(y + dy, x + dx);
+                outerSum[c] += window.value(y + dy, x + dx);
+                outerCount[c]++;
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            if (!count[c]) {
+                sum[c] = outerSum[c];
+                count[c] = outerCount[c];
+            }
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        cam[c] = count[c] ? sum[c] / count[c] : 0.0f;
+    }
+    cam[window.color(y, x)] = window.value(y, x);
+}
+
+// Camera RGB at window position (y, x) of a standard Bayer using the Malvar-He-Cutler kernels:
+// bilinear interpolation corrected by the Laplacian of the color actually sampled there
+inline void demosaicGradientCorrected(const TileWindow& window, int y, int x, float cam[3]) {
+    auto v = [&](int dy, int dx) { return window.value(y + dy, x + dx); };
+    const int c = window.color(y, x);
+    const float center = v(0, 0);
+    cam[c] = center;
+
+    if (c != 1) {
+        // Red or blue site: green from the cross, the other color from the diagonals
+        const float cross1 = v(-1, 0) + v(1, 0) + v(0, -1) + v(0, 1);
+        const float cross2 = v(-2, 0) + v(2, 0) + v(0, -2) + v(0, 2);
+        const float diagonal = v(-1, -1) + v(-1, 1) + v(1, -1) + v(1, 1);
+        cam[1] = (4.0f * center + 2.0f * cross1 - cross2) * 0.125f;
+        cam[2 - c] = (6.0f * center + 2.0f * diagonal - 1.5f * cross2) * 0.125f;
+    } else {
+        // Green site: one color sits left/right, the other above/below
+        const float horizontal1 = v(0, -1) + v(0, 1);
+        const float vertical1 = v(-1, 0) + v(1, 0);
+        const float horizontal2 = v(0, -2) + v(0, 2);
+        const float vertical2 = v(-2, 0) + v(2, 0);
+        const float diagonal = v(-1, -1) + v(-1, 1) + v(1, -1) + v(1, 1);
+        const int rowColor = window.color(y, x + 1);
+        cam[rowColor] = (5.0f * center + 4.0f * horizontal1 - diagonal - horizontal2 + 0.5f * vertical2) * 0.125f;
+        cam[2 - rowColor] = (5.0f * center + 4.0f * vertical1 - diagonal - vertical2 + 0.5f * horizontal2) * 0.125f;
+    }
+}
+
+} // namespace develop_detail
+
+// Pixels of a width x height image covered by a rectangle in 0-1 coordinates, grown by margin
+// and clipped to the image
+inline SDL_Rect regionPixels(const SDL_FRect& uv, int width, int height, int margin) {
+    const int x0 = std::max(0, static_cast<int>(std::floor(uv.x * width)) - margin);
+    const int y0 = std::max(0, static_cast<int>(std::floor(uv.y * height)) - margin);
+    const int x1 = std::min(width, static_cast<int>(std::ceil((uv.x + uv.w) * width)) + margin);
+    const int y1 = std::min(height, static_cast<int>(std::ceil((uv.y + uv.h) * height)) + margin);
+    return SDL_Rect{x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)};
+}
+
+// Develop a rectangle of the image at full size from the sensor data: black/white level, white
+// balance, demosaic and camera to sRGB per tile, then the shared 16-bit output stage per row.
+// The demosaic reads the real samples around the rectangle, so the result matches the same
+// pixels of a full develop. If linearOut is set it receives the demosaiced camera RGB.
+inline CpuTexture developRegion(const CfaImage& cfa, DemosaicMethod method, const SDL_Rect& region,
+                                LinearImage* linearOut = nullptr) {
+    if (!cfa.valid() || cfa.width < 2 || cfa.height < 2 || region.w <= 0 || region.h <= 0 ||
+        region.x < 0 || region.y < 0 || region.x + region.w > cfa.width || region.y + region.h > cfa.height) {
+        return CpuTexture();
+    }
+    if (method == DemosaicMethod::GradientCorrected && !develop_detail::isStandardBayer(cfa)) {
+        method = DemosaicMethod::Bilinear;
+    }
+
+    // Allocate with malloc so CpuTexture can release it with stbi_image_free
+    const int width = region.w;
+    const int height = region.h;
+    unsigned char* pixels = static_cast<unsigned char*>(malloc(static_cast<size_t>(width) * height * 3));
+    if (!pixels) {
+        return CpuTexture();
+    }
+
+    if (linearOut) {
+        linearOut->allocate(width, height, cfa.rgbCam);
+    }
+
+    const int tilesAcross = (width + kDevelopTileSize - 1) / kDevelopTileSize;
+    const int tilesDown = (height + kDevelopTileSize - 1) / kDevelopTileSize;
+    parallelFor(static_cast<size_t>(tilesAcross) * tilesDown, [&](size_t tile) {
+        const int x0 = static_cast<int>(tile % tilesAcross) * kDevelopTileSize;
+        const int y0 = static_cast<int>(tile / tilesAcross) * kDevelopTileSize;
+        const int w = std::min(kDevelopTileSize, width - x0);
+        const int h = std::min(kDevelopTileSize, height - y0);
+
+        develop_detail::TileWindow window;
+        develop_detail::loadTileWindow(cfa, region.x + x0, region.y + y0, w, h, window);
+
+        std::vector<uint16_t> linear(static_cast<size_t>(w) * 3);
+        for (int y = 0; y < h; ++y) {
+            uint16_t* kept = linearOut ? &linearOut->cam[(static_cast<size_t>(y0 + y) * width + x0) * 3] : nullptr;
+            for (int x = 0; x < w; ++x) {
+                float cam[3];
+                if (method == DemosaicMethod::GradientCorrected) {
+                    develop_detail::demosaicGradientCorrected(window, y + kDevelopTileBorder, x + kDevelopTileBorder, cam);
+                } else {
+                    develop_detail::demosaicBilinear(window, y + kDevelopTileBorder, x + kDevelopTileBorder, cam);
+                }
+                if (kept) {
+                    for (int c = 0; c < 3; ++c) {
+                        kept[static_cast<size_t>(x) * 3 + c] = quantizeLinear16(cam[c]);
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    float rgb = cfa.rgbCam[c][0] * cam[0] + cfa.rgbCam[c][1] * cam[1] + cfa.rgbCam[c][2] * cam[2];
+                    linear[static_cast<size_t>(x) * 3 + c] = quantizeLinear16(rgb);
+                }
+            }
+            linear16ToSrgb8Row(linear.data(), pixels + (static_cast<size_t>(y0 + y) * width + x0) * 3, w, 3);
+        }
+    });
+
+    return CpuTexture(pixels, width, height, 3);
+}
+
+// Develop the whole image at full size, see developRegion()
+inline CpuTexture developTiled(const CfaImage& cfa, DemosaicMethod method, LinearImage* linearOut = nullptr) {
+    return developRegion(cfa, method, SDL_Rect{0, 0, cfa.width, cfa.height}, linearOut);
+}
+
+// Develop sensor data natively with a profile's settings
+// Culling is half size from whole CFA tiles, Review and Final demosaic at full size
+inline CpuTexture developCfa(const CfaImage& cfa, DevelopProfile profile, LinearImage* linearOut = nullptr) {
+    switch (profile) {
+        case DevelopProfile::Culling: return developSuperpixelThumbnail(cfa, 0, linearOut);
+        case DevelopProfile::Review: return developTiled(cfa, DemosaicMethod::Bilinear, linearOut);
+        default: return developTiled(cfa, DemosaicMethod::GradientCorrected, linearOut);
+    }
+}
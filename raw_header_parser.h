@@ -0,0 +1,499 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "metadata_index.h"
+
+// Minimal parser that locates embedded JPEG previews and the orientation from the first few KB
+// of a raw file, without LibRaw. Understands TIFF based raws (NEF, CR2, ARW, DNG, PEF, RW2, ...),
+// CR3 and RAF, plus plain JPEGs (RAW+JPEG sidecars), which are their own preview.
+// Every read is bounds-checked against the buffer, so any input is safe to pass.
+
+// Bytes to read from the start of a file before calling parseRawHeader
+constexpr size_t kRawHeaderReadSize = 64 * 1024;
+
+// Bounds-checked reads from a byte buffer in either byte order
+class ByteReader {
+public:
+    ByteReader(const uint8_t* data, size_t size, bool bigEndian = false)
+        : data_(data), size_(size), bigEndian_(bigEndian) {}
+
+    size_t size() const { return size_; }
+    const uint8_t* data() const { return data_; }
+    void setBigEndian(bool bigEndian) { bigEndian_ = bigEndian; }
+
+    bool has(uint64_t offset, uint64_t length) const {
+        return offset <= size_ && length <= size_ - offset;
+    }
+
+    bool u8(uint64_t offset, uint8_t& out) const {
+        if (!has(offset, 1)) return false;
+        out = data_[offset];
+        return true;
+    }
+
+    bool u16(uint64_t offset, uint16_t& out) const {
+        if (!has(offset, 2)) return false;
+        const uint8_t* p = data_ + offset;
+        out = bigEndian_ ? static_cast<uint16_t>(p[0] << 8 | p[1]) : static_cast<uint16_t>(p[1] << 8 | p[0]);
+        return true;
+    }
+
+    bool u32(uint64_t offset, uint32_t& out) const {
+        uint16_t a, b;
+        if (!u16(offset, a) || !u16(offset + 2, b)) return false;
+        out = bigEndian_ ? (static_cast<uint32_t>(a) << 16 | b) : (static_cast<uint32_t>(b) << 16 | a);
+        return true;
+    }
+
+    bool u64(uint64_t offset, uint64_t& out) const {
+        uint32_t a, b;
+        if (!u32(offset, a) || !u32(offset + 4, b)) return false;
+        out = bigEndian_ ? (static_cast<uint64_t>(a) << 32 | b) : (static_cast<uint64_t>(b) << 32 | a);
+        return true;
+    }
+
+    bool matches(uint64_t offset, const char* text) const {
+        size_t length = strlen(text);
+        return has(offset, length) && memcmp(data_ + offset, text, length) == 0;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    bool bigEndian_;
+};
+
+// Convert an EXIF orientation tag to a LibRaw flip value (only the rotations LibRaw reports)
+inline int exifOrientationToFlip(uint16_t orientation) {
+    switch (orientation) {
+        case 3: return 3;
+        case 6: return 6;
+        case 8: return 5;
+        default: return 0;
+    }
+}
+
+// Read the size of a JPEG at position from its SOF marker
+// Returns false if the SOF isn't within the buffer
+inline bool jpegDimensions(const ByteReader& reader, uint64_t position, uint16_t& width, uint16_t& height) {
+    ByteReader r(reader.data(), reader.size(), true);
+    uint16_t marker;
+    if (!r.u16(position, marker) || marker != 0xFFD8) return false;
+
+    position += 2;
+    for (int i = 0; i < 32; ++i) {
+        uint16_t segmentLength;
+        if (!r.u16(position, marker) || !r.u16(position + 2, segmentLength)) return false;
+        if ((marker & 0xFF00) != 0xFF00 || marker == 0xFFDA) return false;
+        // SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xFFC0 && marker <= 0xFFCF && marker != 0xFFC4 && marker != 0xFFC8 && marker != 0xFFCC) {
+            return r.u16(position + 5, height) && r.u16(position + 7, width);
+        }
+        position += 2 + segmentLength;
+    }
+    return false;
+}
+
+namespace raw_header_detail {
+
+constexpr int kMaxIfdDepth = 4;
+constexpr int kMaxIfds = 32;
+constexpr uint16_t kMaxIfdEntries = 1024;
+
+// One directory entry; value is either inline or at an offset relative to the TIFF header
+struct TiffEntry {
+    uint16_t tag = 0;
+    uint16_t type = 0;
+    uint32_t count = 0;
+    uint64_t valuePosition = 0;  // Absolute position of the value in the buffer
+};
+
+inline uint32_t tiffTypeSize(uint16_t type) {
+    switch (type) {
+        case 1: case 2: case 6: case 7: return 1;
+        case 3: case 8: return 2;
+        case 4: case 9: case 11: case 13: return 4;
+        case 5: case 10: case 12: return 8;
+        default: return 0;
+    }
+}
+
+inline bool readTiffEntry(const ByteReader& r, uint64_t tiffBase, uint64_t position, TiffEntry& entry) {
+    uint32_t inlineOrOffset;
+    if (!r.u16(position, entry.tag) || !r.u16(position + 2, entry.type) ||
+        !r.u32(position + 4, entry.count) || !r.u32(position + 8, inlineOrOffset)) {
+        return false;
+    }
+    uint64_t bytes = static_cast<uint64_t>(tiffTypeSize(entry.type)) * entry.count;
+    entry.valuePosition = bytes <= 4 ? position + 8 : tiffBase + inlineOrOffset;
+    return true;
+}
+
+// Read element index of a SHORT/LONG/IFD entry
+inline bool tiffEntryValue(const ByteReader& r, const TiffEntry& entry, uint32_t index, uint32_t& out) {
+    if (index >= entry.count) return false;
+    if (entry.type == 3 || entry.type == 8) {
+        uint16_t value;
+        if (!r.u16(entry.valuePosition + index * 2ull, value)) return false;
+        out = value;
+        return true;
+    }
+    if (entry.type == 4 || entry.type == 9 || entry.type == 13) {
+        return r.u32(entry.valuePosition + index * 4ull, out);
+    }
+    return false;
+}
+
+struct TiffScan {
+    TiffScan(const ByteReader& reader, uint64_t tiffBase, uint64_t fileSize, FileMetadata& out)
+        : reader(reader), tiffBase(tiffBase), fileSize(fileSize), out(out) {}
+
+    const ByteReader& reader;
+    uint64_t tiffBase;   // Position of the TIFF header; offsets in the file are relative to it
+    uint64_t fileSize;
+    FileMetadata& out;
+    bool foundOrientation = false;
+    std::string make, model;
+    int64_t dateTime = 0;          // IFD0 DateTime, when the file was last written
+    int64_t dateTimeOriginal = 0;  // EXIF DateTimeOriginal, when the shot was taken
+    int ifdsVisited = 0;
+    std::vector<uint64_t> visited;
+};
+
+inline void addPreview(TiffScan& scan, uint64_t offset, uint64_t length, uint32_t width, uint32_t height) {
+    if (length < 2 || length > UINT32_MAX || offset > scan.fileSize || length > scan.fileSize - offset) {
+        return;
+    }
+    for (const PreviewLocation& existing : scan.out.previews) {
+        if (existing.offset == offset) return;
+    }
+    PreviewLocation location;
+    location.offset = offset;
+    location.length = static_cast<uint32_t>(length);
+    location.width = static_cast<uint16_t>(std::min<uint32_t>(width, UINT16_MAX));
+    location.height = static_cast<uint16_t>(std::min<uint32_t>(height, UINT16_MAX));
+    scan.out.previews.push_back(location);
+}
+
+// Read an ASCII entry, up to its terminator
+inline std::string tiffEntryString(const ByteReader& r, const TiffEntry& entry) {
+    if (entry.type != 2 || entry.count == 0 || entry.count > 256 || !r.has(entry.valuePosition, entry.count)) {
+        return std::string();
+    }
+    const char* text = reinterpret_cast<const char*>(r.data() + entry.valuePosition);
+    return std::string(text, strnlen(text, entry.count));
+}
+
+inline int64_t tiffEntryDateTime(const ByteReader& r, const TiffEntry& entry) {
+    std::string text = tiffEntryString(r, entry);
+    return parseExifDateTime(text.data(), text.size());
+}
+
+inline void scanIfd(TiffScan& scan, uint64_t ifdPosition, int depth, bool isIfd0) {
+    const ByteReader& r = scan.reader;
+    if (depth > kMaxIfdDepth || scan.ifdsVisited >= kMaxIfds) return;
+    for (uint64_t seen : scan.visited) {
+        if (seen == ifdPosition) return;  // Loop in the IFD chain
+    }
+    scan.visited.push_back(ifdPosition);
+    scan.ifdsVisited++;
+
+    uint16_t entryCount;
+    if (!r.u16(ifdPosition, entryCount) || entryCount > kMaxIfdEntries) return;
+
+    uint32_t width = 0, height = 0, compression = 0, photometric = 0, subFileType = 0;
+    uint32_t jpegOffset = 0, jpegLength = 0;
+    TiffEntry stripOffsets, stripCounts, subIfds;
+    bool hasStrips = false, hasStripCounts = false, hasSubIfds = false, hasCr2Slices = false;
+    uint32_t exifIfd = 0;
+
+    for (uint16_t i = 0; i < entryCount; ++i) {
+        TiffEntry entry;
+        if (!readTiffEntry(r, scan.tiffBase, ifdPosition + 2 + i * 12ull, entry)) return;
+
+        uint32_t value = 0;
+        switch (entry.tag) {
+            case 0x00FE: tiffEntryValue(r, entry, 0, subFileType); break;
+            case 0x0100: tiffEntryValue(r, entry, 0, width); break;
+            case 0x0101: tiffEntryValue(r, entry, 0, height); break;
+            case 0x0103: tiffEntryValue(r, entry, 0, compression); break;
+            case 0x0106: tiffEntryValue(r, entry, 0, photometric); break;
+            case 0x0111: stripOffsets = entry; hasStrips = true; break;
+            case 0x0117: stripCounts = entry; hasStripCounts = true; break;
+            case 0x014A: subIfds = entry; hasSubIfds = true; break;
+            case 0x0201: tiffEntryValue(r, entry, 0, jpegOffset); break;
+            case 0x0202: tiffEntryValue(r, entry, 0, jpegLength); break;
+            case 0xC640: hasCr2Slices = true; break;
+            case 0x8769: tiffEntryValue(r, entry, 0, exifIfd); break;
+            case 0x9003: scan.dateTimeOriginal = tiffEntryDateTime(r, entry); break;
+            case 0x010F: if (isIfd0) scan.make = tiffEntryString(r, entry); break;
+            case 0x0110: if (isIfd0) scan.model = tiffEntryString(r, entry); break;
+            case 0x0132: if (isIfd0) scan.dateTime = tiffEntryDateTime(r, entry); break;
+            case 0x0112:
+                if (isIfd0 && tiffEntryValue(r, entry, 0, value)) {
+                    scan.out.orientation = exifOrientationToFlip(static_cast<uint16_t>(value));
+                    scan.foundOrientation = true;
+                }
+                break;
+            case 0x002E:
+                // Panasonic RW2 JpgFromRaw: the whole JPEG is the value
+                if (entry.type == 7 && entry.count > 4) {
+                    addPreview(scan, entry.valuePosition, entry.count, 0, 0);
+                }
+                break;
+            default: break;
+        }
+    }
+
+    if (jpegOffset && jpegLength) {
+        addPreview(scan, scan.tiffBase + jpegOffset, jpegLength, width, height);
+    } else if (hasStrips && hasStripCounts && stripOffsets.count == 1 && stripCounts.count == 1) {
+        // Single strip JPEG preview. Exclude raw data stored as lossless JPEG: CR2 slices,
+        // and CFA/LinearRaw images that aren't marked as reduced resolution
+        bool isRawPhotometric = photometric == 32803 || photometric == 34892;
+        bool isJpeg = compression == 6 || (compression == 7 && subFileType == 1 && !isRawPhotometric);
+        uint32_t offset, length;
+        if (isJpeg && !hasCr2Slices &&
+            tiffEntryValue(r, stripOffsets, 0, offset) && tiffEntryValue(r, stripCounts, 0, length)) {
+            addPreview(scan, scan.tiffBase + offset, length, width, height);
+        }
+    }
+
+    if (hasSubIfds) {
+        for (uint32_t i = 0; i < subIfds.count && i < 8; ++i) {
+            uint32_t offset;
+            if (tiffEntryValue(r, subIfds, i, offset)) {
+                scanIfd(scan, scan.tiffBase + offset, depth + 1, false);
+            }
+        }
+    }
+
+    // The EXIF IFD holds the capture time
+    if (exifIfd != 0) {
+        scanIfd(scan, scan.tiffBase + exifIfd, depth + 1, false);
+    }
+
+    // Follow the chain (IFD0 -> IFD1 -> ...) at the same depth
+    uint32_t nextIfd;
+    if (r.u32(ifdPosition + 2 + entryCount * 12ull, nextIfd) && nextIfd != 0) {
+        scanIfd(scan, scan.tiffBase + nextIfd, depth, false);
+    }
+}
+
+// Parse a TIFF structure starting at tiffBase. Returns false if there is no valid header.
+// Accepts the standard magic plus the Olympus (ORF) and Panasonic (RW2) variants.
+inline bool scanTiff(ByteReader& r, uint64_t tiffBase, uint64_t fileSize, FileMetadata& out, bool& foundOrientation) {
+    if (r.matches(tiffBase, "II")) {
+        r.setBigEndian(false);
+    } else if (r.matches(tiffBase, "MM")) {
+        r.setBigEndian(true);
+    } else {
+        return false;
+    }
+
+    uint16_t magic;
+    uint32_t firstIfd;
+    if (!r.u16(tiffBase + 2, magic) || !r.u32(tiffBase + 4, firstIfd)) return false;
+    if (magic != 42 && magic != 0x4F52 && magic != 0x5352 && magic != 0x55) return false;
+
+    TiffScan scan{r, tiffBase, fileSize, out};
+    scanIfd(scan, tiffBase + firstIfd, 0, true);
+    foundOrientation = foundOrientation || scan.foundOrientation;
+    if (!scan.make.empty() || !scan.model.empty()) {
+        out.camera = cameraName(scan.make, scan.model);
+    }
+    if (scan.dateTimeOriginal != 0 || scan.dateTime != 0) {
+        out.captureTime = scan.dateTimeOriginal != 0 ? scan.dateTimeOriginal : scan.dateTime;
+    }
+    return true;
+}
+
+// Find the TIFF header inside the EXIF (APP1) segment of a JPEG at jpegPosition
+// Only looks at the segments before the image data, so it's cheap to call on a prefix
+inline bool findJpegExifTiff(const ByteReader& fileReader, uint64_t jpegPosition, uint64_t& tiffPosition, uint64_t& tiffEnd) {
+    ByteReader r(fileReader.data(), fileReader.size(), true);
+    uint16_t marker;
+    if (!r.u16(jpegPosition, marker) || marker != 0xFFD8) return false;
+
+    uint64_t position = jpegPosition + 2;
+    for (int i = 0; i < 16; ++i) {
+        uint16_t segmentLength;
+        if (!r.u16(position, marker) || !r.u16(position + 2, segmentLength)) return false;
+        if ((marker & 0xFF00) != 0xFF00 || marker == 0xFFDA) return false;  // Start of scan, no EXIF
+        if (marker == 0xFFE1 && r.matches(position + 4, "Exif")) {
+            tiffPosition = position + 10;
+            tiffEnd = position + 2 + segmentLength;
+            return true;
+        }
+        position += 2 + segmentLength;
+    }
+    return false;
+}
+
+// Read the orientation, camera, capture time and the nested thumbnail from the EXIF block of a
+// JPEG at jpegPosition, if it's within the buffer. Thumbnail offsets are absolute positions.
+inline void scanJpegExif(const ByteReader& fileReader, uint64_t jpegPosition, uint64_t fileSize,
+                         FileMetadata& out, bool& foundOrientation) {
+    uint64_t tiffPosition, tiffEnd;
+    if (!findJpegExifTiff(fileReader, jpegPosition, tiffPosition, tiffEnd)) return;
+
+    ByteReader r(fileReader.data(), std::min<uint64_t>(tiffEnd, fileReader.size()));
+    FileMetadata exif;
+    bool exifOrientation = false;
+    if (!scanTiff(r, tiffPosition, fileSize, exif, exifOrientation)) return;
+    if (exifOrientation) {
+        out.orientation = exif.orientation;
+        foundOrientation = true;
+    }
+    if (!exif.camera.empty()) {
+        out.camera = exif.camera;
+    }
+    if (exif.captureTime != 0) {
+        out.captureTime = exif.captureTime;
+    }
+    for (const PreviewLocation& thumbnail : exif.previews) {
+        out.previews.push_back(thumbnail);
+    }
+}
+
+// Canon CR3 (ISO base media file): orientation and camera from CMT1, the capture time from
+// CMT2, the thumbnail from THMB and the 1620px preview from the PRVW box located through the
+// CTBO offset table
+inline void scanCr3(const ByteReader& fileReader, uint64_t fileSize, FileMetadata& out, bool& foundOrientation) {
+    static const uint8_t kCanonUuid[16] = {0x85, 0xc0, 0xb6, 0x87, 0x82, 0x0f, 0x11, 0xe0,
+                                           0x81, 0x11, 0xf4, 0xce, 0x46, 0x2b, 0x6a, 0x48};
+    ByteReader r(fileReader.data(), fileReader.size(), true);
+
+    // Iterate the boxes in [begin, end), calling visit(position, headerSize, boxSize, type)
+    auto forEachBox = [&r](uint64_t begin, uint64_t end, auto&& visit) {
+        uint64_t position = begin;
+        for (int i = 0; i < 64 && position + 8 <= end; ++i) {
+            uint32_t size32;
+            if (!r.u32(position, size32)) return;
+            uint64_t boxSize = size32;
+            uint64_t headerSize = 8;
+            if (size32 == 1) {
+                if (!r.u64(position + 8, boxSize)) return;
+                headerSize = 16;
+            }
+            if (boxSize < headerSize) return;
+            visit(position, headerSize, boxSize);
+            position += boxSize;
+        }
+    };
+
+    forEachBox(0, r.size(), [&](uint64_t moov, uint64_t moovHeader, uint64_t moovSize) {
+        if (!r.matches(moov + 4, "moov")) return;
+        forEachBox(moov + moovHeader, std::min<uint64_t>(moov + moovSize, r.size()), [&](uint64_t uuid, uint64_t uuidHeader, uint64_t uuidSize) {
+            if (!r.matches(uuid + 4, "uuid") || !r.has(uuid + uuidHeader, 16) ||
+                memcmp(r.data() + uuid + uuidHeader, kCanonUuid, 16) != 0) {
+                return;
+            }
+            uint64_t childrenBegin = uuid + uuidHeader + 16;
+            uint64_t childrenEnd = std::min<uint64_t>(uuid + uuidSize, r.size());
+            forEachBox(childrenBegin, childrenEnd, [&](uint64_t box, uint64_t, uint64_t boxSize) {
+                if (r.matches(box + 4, "CMT1")) {
+                    ByteReader tiffReader(r.data(), std::min<uint64_t>(box + boxSize, r.size()));
+                    FileMetadata ifd0;
+                    bool ifd0Orientation = false;
+                    if (scanTiff(tiffReader, box + 8, fileSize, ifd0, ifd0Orientation)) {
+                        if (ifd0Orientation) {
+                            out.orientation = ifd0.orientation;
+                            foundOrientation = true;
+                        }
+                        out.camera = ifd0.camera;
+                    }
+                } else if (r.matches(box + 4, "CMT2")) {
+                    // The EXIF IFD on its own, so its tags are read as if it were IFD0
+                    ByteReader tiffReader(r.data(), std::min<uint64_t>(box + boxSize, r.size()));
+                    FileMetadata exif;
+                    bool exifOrientation = false;
+                    if (scanTiff(tiffReader, box + 8, fileSize, exif, exifOrientation)) {
+                        out.captureTime = exif.captureTime;
+                    }
+                } else if (r.matches(box + 4, "THMB")) {
+                    uint16_t width, height;
+                    uint32_t length;
+                    if (r.u16(box + 12, width) && r.u16(box + 14, height) && r.u32(box + 16, length) &&
+                        length <= boxSize) {
+                        TiffScan scan{r, 0, fileSize, out};
+                        addPreview(scan, box + 24, length, width, height);
+                    }
+                } else if (r.matches(box + 4, "CTBO")) {
+                    uint32_t count;
+                    if (!r.u32(box + 8, count)) return;
+                    for (uint32_t i = 0; i < count && i < 16; ++i) {
+                        uint64_t record = box + 12 + i * 20ull;
+                        uint32_t index;
+                        uint64_t offset, size;
+                        if (!r.u32(record, index) || !r.u64(record + 4, offset) || !r.u64(record + 12, size)) return;
+                        // Record 2 is the uuid box holding PRVW; its JPEG starts 56 bytes in
+                        if (index == 2 && size > 56) {
+                            TiffScan scan{r, 0, fileSize, out};
+                            addPreview(scan, offset + 56, size - 56, 0, 0);
+                        }
+                    }
+                }
+            });
+        });
+    });
+}
+
+}  // namespace raw_header_detail
+
+// Locate embedded JPEG previews (and the orientation) from the start of a file
+// header holds the first bytes of the file (ideally kRawHeaderReadSize), fileSize its full size.
+// Returns false if the format isn't recognized or no preview was found - use LibRaw instead.
+inline bool parseRawHeader(const uint8_t* header, size_t headerSize, uint64_t fileSize, FileMetadata& out) {
+    using namespace raw_header_detail;
+    ByteReader r(header, headerSize);
+    out.orientation = 0;
+    out.previews.clear();
+    out.captureTime = 0;
+    out.camera.clear();
+    bool foundOrientation = false;
+
+    if (r.matches(0, "FUJIFILMCCD-RAW")) {
+        // Fixed offsets in the RAF header, big endian
+        ByteReader be(header, headerSize, true);
+        uint32_t jpegOffset, jpegLength;
+        if (!be.u32(84, jpegOffset) || !be.u32(88, jpegLength)) return false;
+        TiffScan scan{be, 0, fileSize, out};
+        addPreview(scan, jpegOffset, jpegLength, 0, 0);
+        scanJpegExif(r, jpegOffset, fileSize, out, foundOrientation);
+    } else if (r.matches(4, "ftypcrx ")) {
+        scanCr3(r, fileSize, out, foundOrientation);
+    } else if (r.matches(0, "\xFF\xD8\xFF")) {
+        // A plain JPEG is its own full size preview, next to any thumbnail in its EXIF
+        TiffScan scan{r, 0, fileSize, out};
+        addPreview(scan, 0, fileSize, 0, 0);
+        scanJpegExif(r, 0, fileSize, out, foundOrientation);
+        foundOrientation = true;  // Without an EXIF orientation the JPEG is upright
+    } else if (!scanTiff(r, 0, fileSize, out, foundOrientation)) {
+        return false;
+    }
+
+    // Fill in sizes the container didn't record when the JPEG header is within the buffer
+    for (PreviewLocation& preview : out.previews) {
+        if (preview.width == 0 || preview.height == 0) {
+            jpegDimensions(r, preview.offset, preview.width, preview.height);
+        }
+    }
+
+    // Without the orientation we'd show portrait shots sideways - let LibRaw handle those
+    return foundOrientation && !out.previews.empty();
+}
+
+// Read the start of a file and locate its previews with parseRawHeader
+inline bool locatePreviewsFromHeader(const std::string& path, uint64_t fileSize, FileMetadata& out) {
+    std::vector<unsigned char> header;
+    uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(fileSize, kRawHeaderReadSize));
+    if (!readFileRange(path, 0, length, header)) {
+        return false;
+    }
+    return parseRawHeader(header.data(), header.size(), fileSize, out);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "overlays.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Sharpness scores for picking the best frame of a burst, measured by the workers from a
+// mid-size preview so every image is scored at the same scale
+
+// Long edge the luma is reduced to before scoring. Previews smaller than this aren't scored,
+// a score is only comparable with others taken at the same size.
+constexpr int kSharpnessSize = 512;
+
+// Frames scoring below this fraction of the sharpest frame of their burst count as soft
+constexpr float kSoftFraction = 0.5f;
+
+namespace sharpness_detail {
+
+// Sum and sum of squares of the 4-neighbour Laplacian over a row, for x in [begin, end)
+inline void laplacianRowScalar(const uint8_t* above, const uint8_t* row, const uint8_t* below, int begin, int end,
+                               int64_t& sum, int64_t& sumSquares) {
+    for (int x = begin; x < end; ++x) {
+        const int laplacian = above[x] + below[x] + row[x - 1] + row[x + 1] - 4 * row[x];
+        sum += laplacian;
+        sumSquares += laplacian * laplacian;
+    }
+}
+
+// Same, 8 pixels at a time. Returns the first x it didn't reach. The 32-bit lanes hold a
+// whole row of the reduced image (at most 2 * 1020^2 per step) before being widened.
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+inline int laplacianRowSimd(const uint8_t* above, const uint8_t* row, const uint8_t* below, int begin, int end,
+                            int64_t& sum, int64_t& sumSquares) {
+    int32x4_t sums = vdupq_n_s32(0), squares = vdupq_n_s32(0);
+    int x = begin;
+    for (; x + 8 <= end; x += 8) {
+        auto load = [](const uint8_t* p) { return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p))); };
+        int16x8_t laplacian = vaddq_s16(vaddq_s16(load(above + x), load(below + x)),
+                                        vaddq_s16(load(row + x - 1), load(row + x + 1)));
+        laplacian = vsubq_s16(laplacian, vshlq_n_s16(load(row + x), 2));
+        sums = vpadalq_s16(sums, laplacian);
+        squares = vmlal_s16(squares, vget_low_s16(laplacian), vget_low_s16(laplacian));
+        squares = vmlal_s16(squares, vget_high_s16(laplacian), vget_high_s16(laplacian));
+    }
+    sum += vaddvq_s32(sums);
+    sumSquares += vaddvq_s32(squares);
+    return x;
+}
+#elif (defined(__SSE2__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+inline int laplacianRowSimd(const uint8_t* above, const uint8_t* row, const uint8_t* below, int begin, int end,
+                            int64_t& sum, int64_t& sumSquares) {
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi16(1);
+    __m128i sums = zero, squares = zero;
+    int x = begin;
+    for (; x + 8 <= end; x += 8) {
+        auto load = [&](const uint8_t* p) {
+            return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+        };
+        __m128i laplacian = _mm_add_epi16(_mm_add_epi16(load(above + x), load(below + x)),
+                                          _mm_add_epi16(load(row + x - 1), load(row + x + 1)));
+        laplacian = _mm_sub_epi16(laplacian, _mm_slli_epi16(load(row + x), 2));
+        sums = _mm_add_epi32(sums, _mm_madd_epi16(laplacian, ones));
+        squares = _mm_add_epi32(squares, _mm_madd_epi16(laplacian, laplacian));
+    }
+    alignas(16) int32_t lanes[2][4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes[0]), sums);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes[1]), squares);
+    for (int i = 0; i < 4; ++i) {
+        sum += lanes[0][i];
+        sumSquares += lanes[1][i];
+    }
+    return x;
+}
+#else
+inline int laplacianRowSimd(const uint8_t*, const uint8_t*, const uint8_t*, int begin, int, int64_t&, int64_t&) {
+    return begin;
+}
+#endif
+
+} // namespace sharpness_detail
+
+// Score the sharpness of an 8-bit image with 3 or more interleaved channels (R, G, B first):
+// the variance of the Laplacian of its luma, area averaged to kSharpnessSize on the long edge.
+// Higher is sharper. Returns false if the image is smaller than kSharpnessSize, or under the
+// 3 pixels the Laplacian needs across its short edge.
+inline bool computeSharpness(const uint8_t* pixels, int width, int height, int channels, float& score) {
+    if (!pixels || std::max(width, height) < kSharpnessSize || std::min(width, height) < 3 || channels < 3) {
+        return false;
+    }
+    const int outWidth = width >= height ? kSharpnessSize : std::max(3, width * kSharpnessSize / height);
+    const int outHeight = width >= height ? std::max(3, height * kSharpnessSize / width) : kSharpnessSize;
+
+    // Reduce the luma rows as they are measured, one output row at a time
+    std::vector<uint16_t> cell(width);
+    for (int x = 0; x < width; ++x) {
+        cell[x] = static_cast<uint16_t>(static_cast<int64_t>(x) * outWidth / width);
+    }
+    std::vector<uint8_t> reduced(static_cast<size_t>(outWidth) * outHeight);
+    std::vector<uint32_t> sums(outWidth), counts(outWidth);
+    std::vector<uint8_t> luma(width), brightest(width);
+    for (int y = 0; y < height; ++y) {
+        overlay_detail::measureRow(pixels + static_cast<size_t>(y) * width * channels, width, channels,
+                                   luma.data(), brightest.data());
+        for (int x = 0; x < width; ++x) {
+            sums[cell[x]] += luma[x];
+            counts[cell[x]]++;
+        }
+        const int outY = static_cast<int>(static_cast<int64_t>(y) * outHeight / height);
+        const bool lastOfRow = y + 1 == height || static_cast<int64_t>(y + 1) * outHeight / height != outY;
+        if (lastOfRow) {
+            uint8_t* out = reduced.data() + static_cast<size_t>(outY) * outWidth;
+            for (int x = 0; x < outWidth; ++x) {
+                out[x] = static_cast<uint8_t>((sums[x] + counts[x] / 2) / counts[x]);
+            }
+            std::fill(sums.begin(), sums.end(), 0u);
+            std::fill(counts.begin(), counts.end(), 0u);
+        }
+    }
+
+    int64_t sum = 0, sumSquares = 0;
+    for (int y = 1; y + 1 < outHeight; ++y) {
+        const uint8_t* row = reduced.data() + static_cast<size_t>(y) * outWidth;
+        const int x = sharpness_detail::laplacianRowSimd(row - outWidth, row, row + outWidth, 1, outWidth - 1,
+                                                          sum, sumSquares);
+        sharpness_detail::laplacianRowScalar(row - outWidth, row, row + outWidth, x, outWidth - 1, sum, sumSquares);
+    }
+    const double count = static_cast<double>(outWidth - 2) * (outHeight - 2);
+    const double mean = sum / count;
+    score = static_cast<float>(sumSquares / count - mean * mean);
+    return true;
+}
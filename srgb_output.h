@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Output stage shared by the develop pipelines: linear 16-bit RGB to 8-bit sRGB
+// Values go through one 65536 entry table, so every path (scalar, AVX2, NEON) produces
+// exactly the same bytes.
+
+// Output table for every 16-bit linear value, padded so a 32-bit gather at the last index
+// stays inside it. contrast (-1 to 1, 0 = none) bends the encoded values into an S curve
+// around middle grey.
+inline std::vector<uint8_t> makeSrgbLut16(float contrast = 0.0f) {
+    std::vector<uint8_t> values(65536 + 3, 0);
+    const double power = std::exp2(static_cast<double>(contrast));
+    for (size_t i = 0; i < 65536; ++i) {
+        double v = static_cast<double>(i) / 65535.0;
+        double s = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+        if (contrast != 0.0f) {
+            s = std::clamp(s, 0.0, 1.0);
+            s = s < 0.5 ? 0.5 * std::pow(2.0 * s, power) : 1.0 - 0.5 * std::pow(2.0 - 2.0 * s, power);
+        }
+        values[i] = static_cast<uint8_t>(std::lround(std::clamp(s, 0.0, 1.0) * 255.0));
+    }
+    return values;
+}
+
+namespace srgb_detail {
+
+// Plain sRGB table shared by the develop pipelines
+inline const uint8_t* lut16() {
+    static const std::vector<uint8_t> table = makeSrgbLut16();
+    return table.data();
+}
+
+inline void mapScalar(const uint16_t* src, uint8_t* dst, size_t count, const uint8_t* lut) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(__ARM_NEON) && (defined(__GNUC__) || defined(__clang__))
+// 16 values per iteration: widen to 32-bit indices, gather 4 table bytes each and keep the first
+__attribute__((target("avx2"))) inline size_t mapAvx2(const uint16_t* src, uint8_t* dst, size_t count, const uint8_t* lut) {
+    const int* table = reinterpret_cast<const int*>(lut);
+    const __m256i lowByte = _mm256_set1_epi32(0xFF);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i indexLow = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        __m256i indexHigh = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8)));
+        __m256i low = _mm256_and_si256(_mm256_i32gather_epi32(table, indexLow, 1), lowByte);
+        __m256i high = _mm256_and_si256(_mm256_i32gather_epi32(table, indexHigh, 1), lowByte);
+        // Packs work per 128-bit lane, so restore the order before storing
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xD8);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+    }
+    return i;
+}
+
+inline bool cpuHasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+// 4 pixels per iteration: spread the 12 RGB bytes into 16 and set every alpha
+__attribute__((target("ssse3"))) inline size_t expandRgbToRgbaSsse3(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    size_t i = 0;
+    for (; (i + 4) * 3 + 4 <= pixels * 3; i += 4) {
+        __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+    }
+    return i;
+}
+
+inline bool cpuHasSsse3() {
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+#endif
+
+// Expand packed RGB bytes to RGBA with opaque alpha
+inline void expandRgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    size_t i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+        uint8x16x4_t rgba = {{rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(255)}};
+        vst4q_u8(dst + i * 4, rgba);
+    }
+#elif (defined(__SSE2__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+    if (cpuHasSsse3()) {
+        i = expandRgbToRgbaSsse3(src, dst, pixels);
+    }
+#endif
+    for (; i < pixels; ++i) {
+        dst[i * 4 + 0] = src[i * 3 + 0];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 255;
+    }
+}
+
+} // namespace srgb_detail
+
+// Quantize a linear value to the 16-bit input of the output stage, clamping to [0, 1]
+inline uint16_t quantizeLinear16(float linear) {
+    return static_cast<uint16_t>(std::clamp(linear, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+// sRGB transfer curve for a single 16-bit linear value
+inline uint8_t linear16ToSrgb8(uint16_t linear) {
+    return srgb_detail::lut16()[linear];
+}
+
+// Convert a row of interleaved linear 16-bit RGB to 8-bit sRGB, packed as RGB24
+// (dstChannels 3) or RGBA32 with opaque alpha (dstChannels 4), through the plain sRGB table
+// or one from makeSrgbLut16()
+// The table lookups use AVX2 gathers when the CPU has them; NEON has no gather for a table
+// this size, so there the lookups stay scalar and only the RGBA packing is vectorized
+// (as it is with SSSE3).
+inline void linear16ToSrgb8Row(const uint16_t* src, uint8_t* dst, size_t pixels, int dstChannels,
+                               const uint8_t* lut = nullptr) {
+    if (!lut) {
+        lut = srgb_detail::lut16();
+    }
+    const size_t count = pixels * 3;
+
+    // RGBA is mapped in chunks through a small RGB buffer, then expanded
+    if (dstChannels == 4) {
+        uint8_t rgb[3 * 256];
+        for (size_t first = 0; first < pixels; first += 256) {
+            const size_t chunk = std::min<size_t>(256, pixels - first);
+            linear16ToSrgb8Row(src + first * 3, rgb, chunk, 3, lut);
+            srgb_detail::expandRgbToRgba(rgb, dst + first * 4, chunk);
+        }
+        return;
+    }
+
+    size_t i = 0;
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(__ARM_NEON) && (defined(__GNUC__) || defined(__clang__))
+    if (srgb_detail::cpuHasAvx2()) {
+        i = srgb_detail::mapAvx2(src, dst, count, lut);
+    }
+#endif
+    srgb_detail::mapScalar(src + i, dst + i, count - i, lut);
+}
@@ -0,0 +1,181 @@
+// Checks that CatalogSnapshot reads back what it wrote, and that damaged or truncated snapshots
+// are rejected by open() rather than read past the end of the mapping
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "../catalog_snapshot.h"
+#include "check.h"
+
+namespace {
+
+using test::check;
+using Bytes = std::vector<char>;
+
+const std::string& snapshotPath() {
+    static const std::string path = (fs::temp_directory_path() / "catalog_snapshot_test.bin").string();
+    return path;
+}
+
+// A small catalog with a sidecar and two folders, written as a snapshot
+Bytes writeSnapshot() {
+    CatalogView catalog;
+    std::vector<fs::path> sidecars;
+    std::vector<std::string> filterNames;
+    for (int i = 0; i < 5; ++i) {
+        CatalogKeys keys;
+        keys.name = "IMG_" + std::to_string(100 + i) + ".CR3";
+        keys.path = "/photos/" + std::string(i < 3 ? "a/" : "b/") + keys.name;
+        keys.camera = i % 2 ? "Canon EOS R5" : "";
+        keys.fileSize = 1000 + i;
+        keys.captureTime = 50 - i;
+        catalog.add(keys);
+        sidecars.push_back(i == 2 ? fs::path("/photos/a/IMG_102.JPG") : fs::path());
+        filterNames.push_back(keys.name);
+    }
+    catalog.update();
+    CatalogSnapshotState state;
+    state.root = "/photos";
+    state.currentImage = 3;
+    const std::vector<char> keep = {1, 1, 0, 1, 1};
+    const std::vector<CatalogFolder> folders = {{"/photos/a", 10, 1}, {"/photos/b", 20, 2}};
+    check(CatalogSnapshot::write(snapshotPath(), state, catalog, sidecars, filterNames, keep, folders),
+          "snapshot written");
+
+    std::ifstream file(snapshotPath(), std::ios::binary);
+    return Bytes(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+bool opens(const Bytes& bytes) {
+    {
+        std::ofstream file(snapshotPath(), std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+    CatalogSnapshot snapshot;
+    return snapshot.open(snapshotPath());
+}
+
+CatalogSnapshotHeader headerOf(const Bytes& bytes) {
+    CatalogSnapshotHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    return header;
+}
+
+Bytes withHeader(Bytes bytes, const CatalogSnapshotHeader& header) {
+    if (bytes.size() < sizeof(header)) {
+        bytes.resize(sizeof(header));
+    }
+    memcpy(bytes.data(), &header, sizeof(header));
+    return bytes;
+}
+
+void testRoundTrip(const Bytes& bytes) {
+    check(opens(bytes), "written snapshot opens");
+    CatalogSnapshot snapshot;
+    if (!snapshot.open(snapshotPath())) {
+        return;
+    }
+    check(snapshot.size() == 4, "images left out aren't saved");
+    check(snapshot.folderCount() == 2, "folders saved");
+    check(snapshot.text(snapshot.header().root) == "/photos", "root saved");
+    check(snapshot.header().currentImage == 2, "current image renumbered");
+    check(snapshot.text(snapshot.image(2).path) == "/photos/b/IMG_103.CR3", "paths renumbered");
+    check(snapshot.text(snapshot.folder(1).path) == "/photos/b", "folder paths saved");
+}
+
+// Header fields set to values that overflow the section arithmetic, or point outside the file
+void testDamagedHeaders(const Bytes& bytes) {
+    const CatalogSnapshotHeader good = headerOf(bytes);
+    const uint64_t fileSize = bytes.size();
+
+    check(!opens(Bytes(bytes.begin(), bytes.end() - 1)), "truncated file rejected");
+    check(!opens(Bytes(bytes.begin(), bytes.begin() + sizeof(CatalogSnapshotHeader) - 1)),
+          "file shorter than the header rejected");
+
+    // Truncated, with the recorded size changed to match
+    for (uint64_t size : {fileSize - 1, good.stringsOffset, good.tiedOffset + 1, good.foldersOffset,
+                          static_cast<uint64_t>(sizeof(CatalogSnapshotHeader))}) {
+        CatalogSnapshotHeader h = good;
+        h.fileSize = size;
+        check(!opens(withHeader(Bytes(bytes.begin(), bytes.begin() + size), h)), "truncated sections rejected");
+    }
+
+    // A header on its own, its strings running from far past the end and wrapping back to it
+    {
+        CatalogSnapshotHeader h = good;
+        h.fileSize = sizeof(CatalogSnapshotHeader);
+        h.imagesOffset = 1ull << 40;
+        h.stringsSize = h.fileSize - h.stringsOffset;
+        check(!opens(withHeader(Bytes(), h)), "header-only file with wrapped strings rejected");
+    }
+
+    const uint64_t kHuge[] = {fileSize + 8, 1ull << 40, (1ull << 63) + 8, UINT64_MAX - 7, UINT64_MAX};
+    auto rejects = [&](auto&& damage, const char* what) {
+        for (uint64_t value : kHuge) {
+            CatalogSnapshotHeader h = good;
+            damage(h, value);
+            check(!opens(withHeader(bytes, h)), what);
+        }
+    };
+    rejects([](CatalogSnapshotHeader& h, uint64_t v) { h.imagesOffset = v; }, "images past the end rejected");
+    rejects([](CatalogSnapshotHeader& h, uint64_t v) { h.foldersOffset = v; }, "folders past the end rejected");
+    rejects([](CatalogSnapshotHeader& h, uint64_t v) { h.sortedOffset = v; }, "sorted lists past the end rejected");
+    rejects([](CatalogSnapshotHeader& h, uint64_t v) { h.tiedOffset = v; }, "tie flags past the end rejected");
+    rejects([](CatalogSnapshotHeader& h, uint64_t v) { h.imageCount = v; }, "huge image count rejected");
+    rejects([](CatalogSnapshotHeader& h, uint64_t v) { h.folderCount = v; }, "huge folder count rejected");
+    rejects([&](CatalogSnapshotHeader& h, uint64_t v) {
+        h.stringsOffset = v;
+        h.stringsSize = fileSize - v;  // Wraps, so offset plus size still comes to the file size
+    }, "strings past the end rejected");
+    for (SnapshotString root : {SnapshotString{static_cast<uint32_t>(good.stringsSize), 1},
+                                SnapshotString{UINT32_MAX, UINT32_MAX}}) {
+        CatalogSnapshotHeader h = good;
+        h.root = root;
+        check(!opens(withHeader(bytes, h)), "root outside the strings rejected");
+    }
+
+    // A string of an image reaching past the string table
+    {
+        Bytes damaged = bytes;
+        CatalogSnapshotImage image;
+        memcpy(&image, damaged.data() + good.imagesOffset, sizeof(image));
+        image.camera.length = static_cast<uint32_t>(good.stringsSize - image.camera.offset + 1);
+        memcpy(damaged.data() + good.imagesOffset, &image, sizeof(image));
+        check(!opens(damaged), "image string outside the strings rejected");
+    }
+}
+
+// Random header fields and lengths; open() may accept or reject them but must not crash
+void testRandomDamage(const Bytes& bytes) {
+    std::mt19937_64 rng(5);
+    const size_t fields = sizeof(CatalogSnapshotHeader) / sizeof(uint64_t);
+    for (int round = 0; round < 2000; ++round) {
+        Bytes damaged = bytes;
+        if (rng() % 2) {
+            damaged.resize(sizeof(CatalogSnapshotHeader) + rng() % (bytes.size() - sizeof(CatalogSnapshotHeader)));
+        }
+        for (int change = 0; change < 1 + static_cast<int>(rng() % 3); ++change) {
+            const uint64_t value = rng() % 2 ? rng() : rng() % (2 * bytes.size());
+            memcpy(damaged.data() + 8 * (1 + rng() % (fields - 1)), &value, sizeof(value));
+        }
+        CatalogSnapshotHeader h = headerOf(damaged);
+        h.fileSize = damaged.size();  // Past the size check, so the section checks are exercised
+        opens(withHeader(damaged, h));
+    }
+}
+
+}  // namespace
+
+int main() {
+    const Bytes bytes = writeSnapshot();
+    testRoundTrip(bytes);
+    std::cerr.setstate(std::ios::badbit);  // Quiet open()'s note for every damaged snapshot
+    testDamagedHeaders(bytes);
+    testRandomDamage(bytes);
+    fs::remove(snapshotPath());
+    return test::finish("catalog_snapshot_test");
+}
@@ -0,0 +1,163 @@
+// Checks CatalogView's incremental sorting against std::stable_sort, as images are added in
+// batches and re-keyed (the way headers read by the workers replace the scan's stand-in keys)
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "../catalog_view.h"
+#include "check.h"
+
+namespace {
+
+using test::check;
+
+std::string lower(std::string text) {
+    for (char& c : text) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return text;
+}
+
+// -1, 0 or 1 comparing two images' keys
+int compareKeys(SortKey key, const CatalogKeys& a, const CatalogKeys& b) {
+    auto sign = [](auto x, auto y) { return x < y ? -1 : (y < x ? 1 : 0); };
+    switch (key) {
+        case SortKey::CaptureTime: return sign(a.captureTime, b.captureTime);
+        case SortKey::FileName: return sign(lower(a.name), lower(b.name));
+        case SortKey::Folder: return sign(lower(a.path), lower(b.path));
+        case SortKey::FileSize: return sign(a.fileSize, b.fileSize);
+        case SortKey::Camera: return sign(lower(a.camera), lower(b.camera));
+        default: return 0;
+    }
+}
+
+// What order() should be: by primary then secondary, either way round, ties in ID order
+std::vector<uint32_t> expectedOrder(const std::vector<CatalogKeys>& keys, SortKey primary, SortKey secondary,
+                                    bool descending) {
+    std::vector<uint32_t> ids(keys.size());
+    for (uint32_t id = 0; id < ids.size(); ++id) {
+        ids[id] = id;
+    }
+    std::stable_sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) {
+        int order = compareKeys(primary, keys[a], keys[b]);
+        if (order == 0) {
+            order = compareKeys(secondary, keys[a], keys[b]);
+        }
+        return descending ? order > 0 : order < 0;
+    });
+    return ids;
+}
+
+// Every order and every tie flag against the reference
+void checkView(CatalogView& view, const std::vector<CatalogKeys>& keys, const char* stage) {
+    const int keyCount = static_cast<int>(SortKey::Count);
+    for (int key = 0; key < keyCount; ++key) {
+        const std::vector<uint32_t>& sorted = view.sortedBy(static_cast<SortKey>(key));
+        const std::vector<char>& tied = view.tiedBy(static_cast<SortKey>(key));
+        bool tiesMatch = sorted.size() == keys.size() && tied.size() == keys.size();
+        for (size_t i = 0; tiesMatch && i < sorted.size(); ++i) {
+            const bool equal = i > 0 && compareKeys(static_cast<SortKey>(key), keys[sorted[i - 1]], keys[sorted[i]]) == 0;
+            tiesMatch = (tied[i] != 0) == equal;
+        }
+        if (!tiesMatch) {
+            std::printf("%s: tie flags of %s\n", stage, sortKeyName(static_cast<SortKey>(key)));
+        }
+        check(tiesMatch, "tie flags");
+    }
+    for (int primary = 0; primary < keyCount; ++primary) {
+        for (int secondary = 0; secondary < keyCount; ++secondary) {
+            for (bool descending : {false, true}) {
+                view.setOrder(static_cast<SortKey>(primary), static_cast<SortKey>(secondary), descending);
+                view.update();
+                const bool matches = view.order() == expectedOrder(keys, static_cast<SortKey>(primary),
+                                                                   static_cast<SortKey>(secondary), descending);
+                if (!matches) {
+                    std::printf("%s: order by %s then %s%s\n", stage, sortKeyName(static_cast<SortKey>(primary)),
+                                sortKeyName(static_cast<SortKey>(secondary)), descending ? ", descending" : "");
+                }
+                check(matches, "order");
+            }
+        }
+    }
+}
+
+CatalogKeys makeKeys(const std::string& folder, const std::string& name, const std::string& camera,
+                     uint64_t fileSize, int64_t captureTime) {
+    CatalogKeys keys;
+    keys.path = folder + "/" + name;
+    keys.name = name;
+    keys.camera = camera;
+    keys.fileSize = fileSize;
+    keys.captureTime = captureTime;
+    return keys;
+}
+
+// Re-keying the lowest ID into a tie with the first kept image (the case that split ties)
+void testRekeyAheadOfFirst() {
+    CatalogView view;
+    std::vector<CatalogKeys> keys = {
+        makeKeys("/d", "a.cr3", "", 1, 1),
+        makeKeys("/d", "b.cr3", "Canon", 1, 1),
+        makeKeys("/d", "c.cr3", "Canon", 1, 1),
+    };
+    for (const CatalogKeys& k : keys) {
+        view.add(k);
+    }
+    view.update();
+    keys[0].camera = "Canon";
+    view.setKeys(0, keys[0]);
+    view.setOrder(SortKey::Camera, SortKey::FileName, false);
+    view.update();
+    check(view.order() == std::vector<uint32_t>({0, 1, 2}), "re-keyed ID 0 joins the tie ahead of the rest");
+    checkView(view, keys, "re-key ahead of first");
+}
+
+// Random catalogs with few distinct values, so there are many ties and shared text prefixes
+void testRandom(unsigned seed) {
+    std::mt19937 rng(seed);
+    static const char* kCameras[] = {"", "Canon EOS R5", "Canon EOS R6", "SONY ILCE-7M4", "sony ilce-7m4"};
+    auto randomKeys = [&]() {
+        return makeKeys("/photos/" + std::to_string(rng() % 4), "IMG_000" + std::to_string(rng() % 20) + ".CR3",
+                        kCameras[rng() % 5], rng() % 6, static_cast<int64_t>(rng() % 8) - 3);
+    };
+
+    CatalogView view;
+    std::vector<CatalogKeys> keys;
+    for (int batch = 0; batch < 6; ++batch) {
+        const size_t added = 1 + rng() % 200;
+        for (size_t i = 0; i < added; ++i) {
+            keys.push_back(randomKeys());
+            view.add(keys.back());
+        }
+        view.update();
+        checkView(view, keys, "after adding");
+
+        // Re-key some images, favouring low IDs, sometimes along with new ones in the same update
+        const size_t changed = 1 + rng() % 20;
+        for (size_t i = 0; i < changed; ++i) {
+            const uint32_t id = static_cast<uint32_t>(rng() % 2 ? rng() % std::min<size_t>(keys.size(), 4)
+                                                                : rng() % keys.size());
+            keys[id] = randomKeys();
+            view.setKeys(id, keys[id]);
+        }
+        if (rng() % 2) {
+            keys.push_back(randomKeys());
+            view.add(keys.back());
+        }
+        view.update();
+        checkView(view, keys, "after re-keying");
+    }
+}
+
+}  // namespace
+
+int main() {
+    testRekeyAheadOfFirst();
+    for (unsigned seed = 1; seed <= 20; ++seed) {
+        testRandom(seed);
+    }
+    return test::finish("catalog_view_test");
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// Shared by the standalone tests of the header-only modules, built and run with: make test
+
+#include <cstdio>
+
+namespace test {
+
+inline int failures = 0;
+
+inline void check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// Print the outcome of a test program and return its exit code
+inline int finish(const char* name) {
+    if (failures > 0) {
+        std::printf("%s: %d check(s) failed\n", name, failures);
+        return 1;
+    }
+    std::printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+}  // namespace test
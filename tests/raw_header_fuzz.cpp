@@ -0,0 +1,496 @@
+// Fuzzes and benchmarks parseRawHeader on synthetic headers of every format it understands:
+// TIFF based raws in both byte orders, JPEG with EXIF, RAF and CR3
+//   raw_header_fuzz                       check the seeds, fuzz them with random mutations and time the parser
+//   raw_header_fuzz --iterations N        as above with N mutated inputs
+//   raw_header_fuzz --write-corpus DIR    write the seeds as the libFuzzer target's starting corpus
+//   raw_header_fuzz FILE...               parse real files as the browser does
+// Built with -DRAW_HEADER_LIBFUZZER it's a libFuzzer target instead (make fuzz, needs clang), whose
+// inputs are the file size as 8 bytes followed by the header
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "../raw_header_parser.h"
+#include "check.h"
+
+namespace {
+
+using test::check;
+
+// What holds for any input: previews lie within the file and the orientation is one LibRaw reports
+bool resultValid(bool parsed, const FileMetadata& out, uint64_t fileSize) {
+    for (const PreviewLocation& preview : out.previews) {
+        if (preview.length < 2 || preview.offset > fileSize || preview.length > fileSize - preview.offset) {
+            return false;
+        }
+    }
+    const int flip = out.orientation;
+    return (flip == 0 || flip == 3 || flip == 5 || flip == 6) && (!parsed || !out.previews.empty());
+}
+
+#ifndef RAW_HEADER_LIBFUZZER
+
+using Bytes = std::vector<uint8_t>;
+
+void put16(Bytes& bytes, size_t position, uint16_t value, bool bigEndian) {
+    if (bytes.size() < position + 2) bytes.resize(position + 2);
+    bytes[position + (bigEndian ? 0 : 1)] = static_cast<uint8_t>(value >> 8);
+    bytes[position + (bigEndian ? 1 : 0)] = static_cast<uint8_t>(value);
+}
+
+void put32(Bytes& bytes, size_t position, uint32_t value, bool bigEndian) {
+    put16(bytes, position + (bigEndian ? 0 : 2), static_cast<uint16_t>(value >> 16), bigEndian);
+    put16(bytes, position + (bigEndian ? 2 : 0), static_cast<uint16_t>(value), bigEndian);
+}
+
+void put64(Bytes& bytes, size_t position, uint64_t value, bool bigEndian) {
+    put32(bytes, position + (bigEndian ? 0 : 4), static_cast<uint32_t>(value >> 32), bigEndian);
+    put32(bytes, position + (bigEndian ? 4 : 0), static_cast<uint32_t>(value), bigEndian);
+}
+
+void append(Bytes& bytes, const Bytes& more) {
+    bytes.insert(bytes.end(), more.begin(), more.end());
+}
+
+void appendText(Bytes& bytes, const char* text) {
+    bytes.insert(bytes.end(), text, text + strlen(text));
+}
+
+// The smallest JPEG jpegDimensions() reads a size from: SOI, a baseline SOF0 and EOI
+Bytes tinyJpeg(uint16_t width, uint16_t height) {
+    Bytes jpeg = {0xFF, 0xD8, 0xFF, 0xC0, 0x00, 0x11, 0x08};
+    put16(jpeg, jpeg.size(), height, true);
+    put16(jpeg, jpeg.size(), width, true);
+    jpeg.push_back(3);
+    for (uint8_t component = 1; component <= 3; ++component) {
+        append(jpeg, {component, 0x11, 0x00});
+    }
+    append(jpeg, {0xFF, 0xD9});
+    return jpeg;
+}
+
+// Writes a TIFF structure bottom up: data and the IFDs it points at first, IFD0 last, so every
+// offset is known when it's written. Offsets are relative to the start of the TIFF header.
+class TiffWriter {
+public:
+    struct Entry {
+        uint16_t tag;
+        uint16_t type;
+        uint32_t count;
+        Bytes data;  // Already in the file's byte order
+    };
+
+    explicit TiffWriter(bool bigEndian) : bigEndian_(bigEndian) {
+        appendText(bytes_, bigEndian ? "MM" : "II");
+        put16(bytes_, 2, 42, bigEndian);
+        put32(bytes_, 4, 0, bigEndian);
+    }
+
+    Entry shortEntry(uint16_t tag, uint16_t value) const {
+        Bytes data;
+        put16(data, 0, value, bigEndian_);
+        return {tag, 3, 1, data};
+    }
+
+    Entry longEntry(uint16_t tag, uint32_t value) const {
+        Bytes data;
+        put32(data, 0, value, bigEndian_);
+        return {tag, 4, 1, data};
+    }
+
+    Entry asciiEntry(uint16_t tag, const char* text) const {
+        Bytes data(text, text + strlen(text) + 1);
+        return {tag, 2, static_cast<uint32_t>(data.size()), data};
+    }
+
+    uint32_t addData(const Bytes& data) {
+        const uint32_t position = static_cast<uint32_t>(bytes_.size());
+        append(bytes_, data);
+        return position;
+    }
+
+    // Entries must be in tag order, like a real file
+    uint32_t addIfd(const std::vector<Entry>& entries, uint32_t nextIfd = 0) {
+        const size_t position = bytes_.size();
+        size_t dataPosition = position + 2 + entries.size() * 12 + 4;
+        put16(bytes_, position, static_cast<uint16_t>(entries.size()), bigEndian_);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const Entry& entry = entries[i];
+            const size_t at = position + 2 + i * 12;
+            put16(bytes_, at, entry.tag, bigEndian_);
+            put16(bytes_, at + 2, entry.type, bigEndian_);
+            put32(bytes_, at + 4, entry.count, bigEndian_);
+            if (entry.data.size() <= 4) {
+                put32(bytes_, at + 8, 0, bigEndian_);
+                std::copy(entry.data.begin(), entry.data.end(), bytes_.begin() + at + 8);
+            } else {
+                put32(bytes_, at + 8, static_cast<uint32_t>(dataPosition), bigEndian_);
+                bytes_.resize(dataPosition);
+                append(bytes_, entry.data);
+                dataPosition = bytes_.size();
+            }
+        }
+        put32(bytes_, position + 2 + entries.size() * 12, nextIfd, bigEndian_);
+        bytes_.resize(dataPosition);
+        return static_cast<uint32_t>(position);
+    }
+
+    Bytes finish(uint32_t firstIfd) {
+        put32(bytes_, 4, firstIfd, bigEndian_);
+        return bytes_;
+    }
+
+private:
+    bool bigEndian_;
+    Bytes bytes_;
+};
+
+// A header to parse, with what parseRawHeader should find in it
+struct Seed {
+    std::string name;
+    Bytes header;
+    uint64_t fileSize;
+    size_t previews;
+    int orientation;
+    bool hasCamera;
+    bool hasCaptureTime;
+};
+
+// NEF/ARW-like: IFD0 with the camera, orientation and a SubIFD holding a strip JPEG preview,
+// the EXIF IFD with the capture time and IFD1 with the thumbnail
+Seed tiffSeed(bool bigEndian) {
+    TiffWriter tiff(bigEndian);
+    const Bytes thumbnail = tinyJpeg(160, 120);
+    const Bytes preview = tinyJpeg(1620, 1080);
+    const uint32_t thumbnailAt = tiff.addData(thumbnail);
+    const uint32_t previewAt = tiff.addData(preview);
+    const uint32_t exif = tiff.addIfd({tiff.asciiEntry(0x9003, "2024:06:01 12:30:45")});
+    const uint32_t subIfd = tiff.addIfd({
+        tiff.longEntry(0x00FE, 1),
+        tiff.longEntry(0x0100, 1620),
+        tiff.longEntry(0x0101, 1080),
+        tiff.shortEntry(0x0103, 6),
+        tiff.longEntry(0x0111, previewAt),
+        tiff.longEntry(0x0117, static_cast<uint32_t>(preview.size())),
+    });
+    const uint32_t ifd1 = tiff.addIfd({
+        tiff.longEntry(0x0201, thumbnailAt),
+        tiff.longEntry(0x0202, static_cast<uint32_t>(thumbnail.size())),
+    });
+    const uint32_t ifd0 = tiff.addIfd({
+        tiff.asciiEntry(0x010F, "NIKON CORPORATION"),
+        tiff.asciiEntry(0x0110, "NIKON Z 6"),
+        tiff.shortEntry(0x0112, 6),
+        tiff.asciiEntry(0x0132, "2024:06:02 08:00:00"),
+        tiff.longEntry(0x014A, subIfd),
+        tiff.longEntry(0x8769, exif),
+    }, ifd1);
+    Bytes header = tiff.finish(ifd0);
+    const uint64_t fileSize = header.size() + 24 * 1024 * 1024;  // Raw data follows the header
+    return {bigEndian ? "tiff-be" : "tiff-le", header, fileSize, 2, 6, true, true};
+}
+
+// The EXIF APP1 segment of a JPEG, holding the orientation and camera in IFD0 and a thumbnail in
+// IFD1. Thumbnail offsets in it are relative to its TIFF header.
+Bytes exifSegment(uint16_t orientation, uint32_t thumbnailLength) {
+    TiffWriter tiff(false);
+    const Bytes thumbnail = tinyJpeg(160, 120);
+    const uint32_t thumbnailAt = tiff.addData(thumbnail);
+    const uint32_t ifd1 = tiff.addIfd({
+        tiff.longEntry(0x0201, thumbnailAt),
+        tiff.longEntry(0x0202, thumbnailLength ? thumbnailLength : static_cast<uint32_t>(thumbnail.size())),
+    });
+    const uint32_t ifd0 = tiff.addIfd({
+        tiff.asciiEntry(0x010F, "FUJIFILM"),
+        tiff.asciiEntry(0x0110, "X-T5"),
+        tiff.shortEntry(0x0112, orientation),
+        tiff.asciiEntry(0x0132, "2023:11:20 16:45:10"),
+    }, ifd1);
+    const Bytes body = tiff.finish(ifd0);
+
+    Bytes segment = {0xFF, 0xE1};
+    put16(segment, 2, static_cast<uint16_t>(2 + 6 + body.size()), true);
+    appendText(segment, "Exif");
+    append(segment, {0, 0});
+    append(segment, body);
+    return segment;
+}
+
+// A JPEG with EXIF, the way a RAW+JPEG sidecar is read
+Seed jpegSeed() {
+    Bytes header = {0xFF, 0xD8};
+    append(header, exifSegment(8, 0));
+    const Bytes image = tinyJpeg(6000, 4000);
+    header.insert(header.end(), image.begin() + 2, image.end());
+    const uint64_t fileSize = header.size();
+    return {"jpeg", header, fileSize, 2, 5, true, true};
+}
+
+// RAF: a fixed header pointing at a JPEG whose EXIF has the orientation and a thumbnail
+Seed rafSeed() {
+    Bytes header;
+    appendText(header, "FUJIFILMCCD-RAW 0201FF393101X-T5");
+    header.resize(160, 0);
+    Bytes jpeg = {0xFF, 0xD8};
+    append(jpeg, exifSegment(3, 0));
+    const Bytes image = tinyJpeg(1920, 1280);
+    jpeg.insert(jpeg.end(), image.begin() + 2, image.end());
+    put32(header, 84, static_cast<uint32_t>(header.size()), true);
+    put32(header, 88, static_cast<uint32_t>(jpeg.size()), true);
+    append(header, jpeg);
+    const uint64_t fileSize = header.size() + 32 * 1024 * 1024;
+    return {"raf", header, fileSize, 2, 3, true, true};
+}
+
+// An ISO base media box: size, type and body
+Bytes box(const char* type, const Bytes& body) {
+    Bytes bytes;
+    put32(bytes, 0, static_cast<uint32_t>(8 + body.size()), true);
+    appendText(bytes, type);
+    append(bytes, body);
+    return bytes;
+}
+
+// CR3: ftyp, then moov holding Canon's uuid box with CMT1, CMT2, THMB and the CTBO table, whose
+// record 2 points at the PRVW box past the end of the header
+Seed cr3Seed() {
+    TiffWriter cmt1(false);
+    const uint32_t ifd0 = cmt1.addIfd({
+        cmt1.asciiEntry(0x010F, "Canon"),
+        cmt1.asciiEntry(0x0110, "Canon EOS R5"),
+        cmt1.shortEntry(0x0112, 1),
+    });
+    TiffWriter cmt2(false);
+    const uint32_t exif = cmt2.addIfd({cmt2.asciiEntry(0x9003, "2022:02:14 09:15:00")});
+
+    const Bytes thumbnail = tinyJpeg(160, 120);
+    Bytes thmb(16, 0);
+    put16(thmb, 4, 160, true);
+    put16(thmb, 6, 120, true);
+    put32(thmb, 8, static_cast<uint32_t>(thumbnail.size()), true);
+    append(thmb, thumbnail);
+
+    const uint64_t previewAt = 512 * 1024;
+    const uint64_t previewBox = 56 + 600 * 1024;
+    Bytes ctbo;
+    put32(ctbo, 0, 3, true);
+    for (uint32_t index = 1; index <= 3; ++index) {
+        const size_t record = ctbo.size();
+        put32(ctbo, record, index, true);
+        put64(ctbo, record + 4, index == 2 ? previewAt : 1024 * 1024 * index, true);
+        put64(ctbo, record + 12, index == 2 ? previewBox : 4096, true);
+    }
+
+    static const uint8_t kCanonUuid[16] = {0x85, 0xc0, 0xb6, 0x87, 0x82, 0x0f, 0x11, 0xe0,
+                                           0x81, 0x11, 0xf4, 0xce, 0x46, 0x2b, 0x6a, 0x48};
+    Bytes canon(kCanonUuid, kCanonUuid + 16);
+    append(canon, box("CMT1", cmt1.finish(ifd0)));
+    append(canon, box("CMT2", cmt2.finish(exif)));
+    append(canon, box("THMB", thmb));
+    append(canon, box("CTBO", ctbo));
+
+    Bytes ftyp;
+    appendText(ftyp, "crx ");
+    append(ftyp, {0, 0, 0, 1});
+    appendText(ftyp, "crx isom");
+
+    Bytes header = box("ftyp", ftyp);
+    append(header, box("moov", box("uuid", canon)));
+    const uint64_t fileSize = 40 * 1024 * 1024;
+    return {"cr3", header, fileSize, 2, 0, true, true};
+}
+
+std::vector<Seed> makeSeeds() {
+    return {tiffSeed(false), tiffSeed(true), jpegSeed(), rafSeed(), cr3Seed()};
+}
+
+void checkSeeds(const std::vector<Seed>& seeds) {
+    for (const Seed& seed : seeds) {
+        FileMetadata out;
+        const bool parsed = parseRawHeader(seed.header.data(), seed.header.size(), seed.fileSize, out);
+        bool matches = parsed && resultValid(parsed, out, seed.fileSize) && out.previews.size() == seed.previews &&
+                       out.orientation == seed.orientation && !out.camera.empty() == seed.hasCamera &&
+                       (out.captureTime != 0) == seed.hasCaptureTime;
+        if (!matches) {
+            std::printf("%s: parsed %d, %zu preview(s), orientation %d, camera '%s', capture time %lld\n",
+                        seed.name.c_str(), parsed, out.previews.size(), out.orientation, out.camera.c_str(),
+                        static_cast<long long>(out.captureTime));
+        }
+        check(matches, "seed parses as built");
+    }
+}
+
+// Byte values that make interesting offsets, counts and lengths
+uint32_t interestingValue(std::mt19937& rng, size_t size) {
+    static const uint32_t kValues[] = {0, 1, 2, 0x7F, 0xFF, 0x100, 0x7FFF, 0xFFFF, 0x10000, 0x7FFFFFFF,
+                                       0x80000000, 0xFFFFFFFE, 0xFFFFFFFF};
+    switch (rng() % 3) {
+        case 0: return static_cast<uint32_t>(size - rng() % 16);  // Near the end of the buffer
+        case 1: return static_cast<uint32_t>(rng() % (size + 1));
+        default: return kValues[rng() % (sizeof(kValues) / sizeof(kValues[0]))];
+    }
+}
+
+Bytes mutate(const Bytes& seed, std::mt19937& rng) {
+    Bytes bytes = seed;
+    const int mutations = 1 + rng() % 8;
+    for (int m = 0; m < mutations && !bytes.empty(); ++m) {
+        const size_t at = rng() % bytes.size();
+        switch (rng() % 6) {
+            case 0: bytes[at] ^= static_cast<uint8_t>(1 << (rng() % 8)); break;
+            case 1: bytes[at] = static_cast<uint8_t>(rng()); break;
+            case 2: put32(bytes, at, interestingValue(rng, bytes.size()), rng() % 2); break;
+            case 3: put16(bytes, at, static_cast<uint16_t>(interestingValue(rng, bytes.size())), rng() % 2); break;
+            case 4: bytes.resize(at); break;
+            default: {
+                // Copy a run over another, like a duplicated entry or box
+                const size_t from = rng() % bytes.size();
+                const size_t length = std::min<size_t>(1 + rng() % 32, bytes.size() - std::max(at, from));
+                std::copy(bytes.begin() + from, bytes.begin() + from + length, bytes.begin() + at);
+                break;
+            }
+        }
+    }
+    // Buffers end where their allocation does, so a sanitizer build catches any read past them
+    bytes.shrink_to_fit();
+    return bytes;
+}
+
+void fuzz(const std::vector<Seed>& seeds, size_t iterations) {
+    std::mt19937 rng(12345);
+    size_t parsed = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        const Seed& seed = seeds[i % seeds.size()];
+        const Bytes bytes = mutate(seed.header, rng);
+        uint64_t fileSize = seed.fileSize;
+        switch (rng() % 4) {
+            case 0: fileSize = bytes.size(); break;
+            case 1: fileSize = rng() % (bytes.size() + 1); break;
+            default: break;
+        }
+        FileMetadata out;
+        const bool ok = parseRawHeader(bytes.data(), bytes.size(), fileSize, out);
+        parsed += ok;
+        if (!resultValid(ok, out, fileSize)) {
+            std::printf("%s mutation %zu: invalid result\n", seed.name.c_str(), i);
+            check(false, "mutated header gives a valid result");
+        }
+    }
+    std::printf("raw_header_fuzz: %zu mutated headers, %zu parsed\n", iterations, parsed);
+}
+
+// Time parsing each seed, the work done per image on a first visit before any decoding
+void bench(const std::vector<Seed>& seeds) {
+    for (const Seed& seed : seeds) {
+        const int runs = 200000;
+        size_t previews = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; ++run) {
+            FileMetadata out;
+            parseRawHeader(seed.header.data(), seed.header.size(), seed.fileSize, out);
+            previews += out.previews.size();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("  %-8s %6zu bytes  %7.0f ns per header\n", seed.name.c_str(), seed.header.size(),
+                    seconds * 1e9 / runs);
+        check(previews == seed.previews * runs, "bench parses");
+    }
+}
+
+bool writeCorpus(const std::vector<Seed>& seeds, const std::string& directory) {
+    for (const Seed& seed : seeds) {
+        const std::string path = directory + "/" + seed.name;
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            std::printf("Can't write %s\n", path.c_str());
+            return false;
+        }
+        uint8_t fileSize[8];
+        memcpy(fileSize, &seed.fileSize, 8);
+        std::fwrite(fileSize, 1, 8, file);
+        std::fwrite(seed.header.data(), 1, seed.header.size(), file);
+        std::fclose(file);
+    }
+    std::printf("Wrote %zu seed(s) to %s\n", seeds.size(), directory.c_str());
+    return true;
+}
+
+// Parse a file as the browser does, from the first kRawHeaderReadSize bytes
+void parseFile(const char* path) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        std::printf("%s: can't open\n", path);
+        test::failures++;
+        return;
+    }
+    Bytes header(kRawHeaderReadSize);
+    header.resize(std::fread(header.data(), 1, header.size(), file));
+    std::fseek(file, 0, SEEK_END);
+    const uint64_t fileSize = static_cast<uint64_t>(std::ftell(file));
+    std::fclose(file);
+    header.shrink_to_fit();
+
+    FileMetadata out;
+    const bool parsed = parseRawHeader(header.data(), header.size(), fileSize, out);
+    std::printf("%s: %s, %zu preview(s), orientation %d, camera '%s'\n", path, parsed ? "parsed" : "not parsed",
+                out.previews.size(), out.orientation, out.camera.c_str());
+    check(resultValid(parsed, out, fileSize), "file gives a valid result");
+}
+
+#endif  // RAW_HEADER_LIBFUZZER
+
+}  // namespace
+
+#ifdef RAW_HEADER_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    // The file size isn't in the header; take it from the first bytes so it gets fuzzed too
+    uint64_t fileSize = size;
+    if (size >= 8) {
+        memcpy(&fileSize, data, 8);
+        data += 8;
+        size -= 8;
+    }
+    FileMetadata out;
+    const bool parsed = parseRawHeader(data, size, fileSize, out);
+    if (!resultValid(parsed, out, fileSize)) {
+        std::abort();
+    }
+    return 0;
+}
+
+#else
+
+int main(int argc, char** argv) {
+    const std::vector<Seed> seeds = makeSeeds();
+    size_t iterations = 300000;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--write-corpus" && i + 1 < argc) {
+            return writeCorpus(seeds, argv[++i]) ? 0 : 1;
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (!files.empty()) {
+        for (const char* path : files) {
+            parseFile(path);
+        }
+    } else {
+        checkSeeds(seeds);
+        fuzz(seeds, iterations);
+        bench(seeds);
+    }
+    return test::finish("raw_header_fuzz");
+}
+
+#endif
@@ -0,0 +1,140 @@
+// Checks the vectorized sRGB output stage byte for byte against the scalar table lookup, and
+// times it against the scalar loop on full rows
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../srgb_output.h"
+#include "check.h"
+
+namespace {
+
+using test::check;
+
+// What every path must produce: the table entry of each value, with opaque alpha for RGBA
+std::vector<uint8_t> expectedRow(const std::vector<uint16_t>& src, size_t pixels, int dstChannels,
+                                 const uint8_t* lut) {
+    std::vector<uint8_t> dst(pixels * dstChannels);
+    for (size_t p = 0; p < pixels; ++p) {
+        for (int c = 0; c < 3; ++c) {
+            dst[p * dstChannels + c] = lut[src[p * 3 + c]];
+        }
+        if (dstChannels == 4) {
+            dst[p * 4 + 3] = 255;
+        }
+    }
+    return dst;
+}
+
+// Convert a row into the middle of a guarded buffer, at an odd address, and check both the
+// bytes written and that nothing either side of the row was touched
+bool convertMatches(const std::vector<uint16_t>& src, size_t pixels, int dstChannels, const uint8_t* lut) {
+    const size_t guard = 64;
+    const size_t size = pixels * dstChannels;
+    std::vector<uint8_t> buffer(guard + 1 + size + guard, 0xA5);
+    uint8_t* dst = buffer.data() + guard + 1;
+    linear16ToSrgb8Row(src.data(), dst, pixels, dstChannels, lut);
+
+    const std::vector<uint8_t> expected = expectedRow(src, pixels, dstChannels, lut);
+    bool matches = std::equal(expected.begin(), expected.end(), dst);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        const bool inRow = i >= guard + 1 && i < guard + 1 + size;
+        if (!inRow && buffer[i] != 0xA5) {
+            std::printf("%zu pixel(s) to %d channels: byte %td outside the row written\n", pixels, dstChannels,
+                        static_cast<ptrdiff_t>(i) - static_cast<ptrdiff_t>(guard + 1));
+            return false;
+        }
+    }
+    if (!matches) {
+        std::printf("%zu pixel(s) to %d channels: bytes differ from the table\n", pixels, dstChannels);
+    }
+    return matches;
+}
+
+// Every 16-bit value, in order and shuffled, through the plain table and contrast curves
+void testAllValues() {
+    std::vector<uint16_t> values(65536 + 2);  // A whole number of RGB pixels
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<uint16_t>(i);
+    }
+    std::vector<uint16_t> shuffled = values;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(7));
+
+    const std::vector<uint8_t> soft = makeSrgbLut16(-0.5f);
+    const std::vector<uint8_t> hard = makeSrgbLut16(0.75f);
+    for (const uint8_t* lut : {srgb_detail::lut16(), soft.data(), hard.data()}) {
+        for (const std::vector<uint16_t>* src : {&values, &shuffled}) {
+            check(convertMatches(*src, src->size() / 3, 3, lut), "every value to RGB");
+            check(convertMatches(*src, src->size() / 3, 4, lut), "every value to RGBA");
+        }
+    }
+
+    bool matches = true;
+    for (size_t i = 0; i < 65536; ++i) {
+        matches = matches && linear16ToSrgb8(static_cast<uint16_t>(i)) == srgb_detail::lut16()[i];
+    }
+    check(matches, "single values match the table");
+}
+
+// Row lengths around the vector widths and the RGBA chunk size, so every tail is exercised
+void testRowLengths() {
+    std::mt19937 rng(11);
+    std::vector<size_t> lengths;
+    for (size_t pixels = 0; pixels <= 70; ++pixels) {
+        lengths.push_back(pixels);
+    }
+    for (size_t pixels : {85, 127, 255, 256, 257, 511, 512, 513, 1001, 6047}) {
+        lengths.push_back(pixels);
+    }
+    for (size_t pixels : lengths) {
+        // Sized exactly, so a sanitizer build catches a read past the source row
+        std::vector<uint16_t> src(pixels * 3);
+        for (uint16_t& value : src) {
+            value = static_cast<uint16_t>(rng());
+        }
+        check(convertMatches(src, pixels, 3, srgb_detail::lut16()), "row to RGB");
+        check(convertMatches(src, pixels, 4, srgb_detail::lut16()), "row to RGBA");
+    }
+}
+
+// Time full rows through the scalar loop and the row function the develop pipelines call
+void bench() {
+    const size_t pixels = 6000;
+    const int rows = 2000;
+    std::mt19937 rng(3);
+    std::vector<uint16_t> src(pixels * 3);
+    for (uint16_t& value : src) {
+        value = static_cast<uint16_t>(rng() % 65536);
+    }
+    std::vector<uint8_t> dst(pixels * 4);
+    const uint8_t* lut = srgb_detail::lut16();
+    static volatile unsigned sink = 0;
+
+    auto time = [&](const char* name, auto&& convert) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int row = 0; row < rows; ++row) {
+            convert();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        sink = sink + dst[rng() % dst.size()];  // Keep the conversions from being optimized away
+        std::printf("  %-10s %6.2f ns per pixel\n", name, seconds * 1e9 / (static_cast<double>(pixels) * rows));
+    };
+    time("scalar RGB", [&]() { srgb_detail::mapScalar(src.data(), dst.data(), pixels * 3, lut); });
+    time("row RGB", [&]() { linear16ToSrgb8Row(src.data(), dst.data(), pixels, 3); });
+    time("row RGBA", [&]() { linear16ToSrgb8Row(src.data(), dst.data(), pixels, 4); });
+}
+
+}  // namespace
+
+int main() {
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(__ARM_NEON) && (defined(__GNUC__) || defined(__clang__))
+    std::printf("srgb_output_test: AVX2 %s, SSSE3 %s\n", srgb_detail::cpuHasAvx2() ? "on" : "off",
+                srgb_detail::cpuHasSsse3() ? "on" : "off");
+#endif
+    testAllValues();
+    testRowLengths();
+    bench();
+    return test::finish("srgb_output_test");
+}